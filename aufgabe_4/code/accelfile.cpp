@@ -0,0 +1,281 @@
+#include "accelfile.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include "mappedfile.h"
+
+static const char ACCEL_MAGIC[8] = { 'R', 'T', 'B', 'V', 'H', '0', '0', '2' };
+
+static const uint64_t ACCEL_PAGE_SIZE = 4096;   //< alignment of the mapped sections
+
+static_assert(sizeof(PlaneRecord) == 6 * sizeof(double), "Plane records are stored as six doubles.");
+
+/**
+ * @brief Fixed size header at the start of every acceleration file.
+ */
+struct AccelHeader
+{
+    char magic[8];                  //< file identification
+    uint64_t hash;                  //< hash of the scene geometry
+    uint64_t materialCount;         //< number of MaterialEntry records following the header
+    uint64_t planeCount;            //< number of planes, stored after the materials
+    uint64_t sphereCount;           //< number of spheres
+    uint64_t nodeCount;             //< number of binary hierarchy nodes
+    uint64_t wideNodeCount;         //< number of 4-wide hierarchy nodes
+    uint64_t nodeOffset;            //< file offset of the binary nodes, page aligned
+    uint64_t wideNodeOffset;        //< file offset of the 4-wide nodes, page aligned
+    uint64_t sphereOffset;          //< file offset of the sphere records, page aligned
+    uint64_t sphereMaterialOffset;  //< file offset of the sphere material indices, page aligned
+};
+
+/**
+ * @brief Material as stored in the file, independent of the layout of the Material class.
+ */
+struct MaterialEntry
+{
+    double color[3];
+    double secondaryColor[3];
+    double specular[3];
+    double shininess;
+    double frequency;
+    uint32_t pattern;
+    uint32_t reserved;
+};
+
+/**
+ * @brief Round a file offset up to the next page.
+ */
+static uint64_t alignToPage(uint64_t offset)
+{
+    return (offset + ACCEL_PAGE_SIZE - 1) / ACCEL_PAGE_SIZE * ACCEL_PAGE_SIZE;
+}
+
+/**
+ * @brief Write zero bytes until the file reaches an offset.
+ */
+static void padTo(std::ofstream& file, uint64_t offset)
+{
+    static const char zeros[ACCEL_PAGE_SIZE] = { 0 };
+    const uint64_t position = static_cast<uint64_t>(file.tellp());
+    if (offset > position)
+        file.write(zeros, static_cast<std::streamsize>(offset - position));
+}
+
+/**
+ * @brief writeAccelFile
+ */
+bool writeAccelFile(const Scene& scene, const std::string& path, uint64_t hash)
+{
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not open " << path << " for writing." << std::endl;
+        return false;
+    }
+
+    AccelHeader header;
+    std::memcpy(header.magic, ACCEL_MAGIC, sizeof(header.magic));
+    header.hash = hash;
+    header.materialCount = scene.materialCount();
+    header.planeCount = scene.planeCount();
+    header.sphereCount = scene.sphereCount();
+    header.nodeCount = scene.nodeCount();
+    header.wideNodeCount = scene.wideNodeCount();
+
+    const uint64_t tablesEnd = sizeof(AccelHeader) + header.materialCount * sizeof(MaterialEntry) +
+        header.planeCount * (sizeof(PlaneRecord) + sizeof(uint32_t));
+    header.nodeOffset = alignToPage(tablesEnd);
+    header.wideNodeOffset = alignToPage(header.nodeOffset + header.nodeCount * sizeof(BVHNode));
+    header.sphereOffset = alignToPage(header.wideNodeOffset + header.wideNodeCount * sizeof(WideBVHNode));
+    header.sphereMaterialOffset = alignToPage(header.sphereOffset + header.sphereCount * sizeof(SphereRecord));
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (size_t i = 0; i < scene.materialCount(); ++i)
+    {
+        const Material& material = scene.materials()[i];
+        MaterialEntry entry;
+        for (int c = 0; c < 3; ++c)
+        {
+            entry.color[c] = material._color[c];
+            entry.secondaryColor[c] = material._secondaryColor[c];
+            entry.specular[c] = material._specular[c];
+        }
+        entry.shininess = material._shininess;
+        entry.frequency = material._frequency;
+        entry.pattern = static_cast<uint32_t>(material._pattern);
+        entry.reserved = 0;
+        file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+    }
+
+    file.write(reinterpret_cast<const char*>(scene.planes()),
+        static_cast<std::streamsize>(scene.planeCount() * sizeof(PlaneRecord)));
+    file.write(reinterpret_cast<const char*>(scene.planeMaterials()),
+        static_cast<std::streamsize>(scene.planeCount() * sizeof(uint32_t)));
+
+    padTo(file, header.nodeOffset);
+    file.write(reinterpret_cast<const char*>(scene.nodes()),
+        static_cast<std::streamsize>(header.nodeCount * sizeof(BVHNode)));
+    padTo(file, header.wideNodeOffset);
+    file.write(reinterpret_cast<const char*>(scene.wideNodes()),
+        static_cast<std::streamsize>(header.wideNodeCount * sizeof(WideBVHNode)));
+    padTo(file, header.sphereOffset);
+    file.write(reinterpret_cast<const char*>(scene.spheres()),
+        static_cast<std::streamsize>(header.sphereCount * sizeof(SphereRecord)));
+    padTo(file, header.sphereMaterialOffset);
+    file.write(reinterpret_cast<const char*>(scene.sphereMaterials()),
+        static_cast<std::streamsize>(header.sphereCount * sizeof(uint32_t)));
+
+    if (!file.good())
+    {
+        std::cerr << "Writing " << path << " failed." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief loadAccelFile
+ */
+bool loadAccelFile(const std::string& path, Scene& scene, uint64_t& hash)
+{
+    std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>(path);
+    if (!mapping->isOpen() || mapping->size() < sizeof(AccelHeader))
+        return false;
+
+    AccelHeader header;
+    std::memcpy(&header, mapping->data(), sizeof(header));
+    if (std::memcmp(header.magic, ACCEL_MAGIC, sizeof(header.magic)) != 0)
+        return false;
+
+    // all sections have to lie within the file
+    const uint64_t size = mapping->size();
+    const uint64_t tablesEnd = sizeof(AccelHeader) + header.materialCount * sizeof(MaterialEntry) +
+        header.planeCount * (sizeof(PlaneRecord) + sizeof(uint32_t));
+    if (tablesEnd > size ||
+        header.nodeOffset % ACCEL_PAGE_SIZE != 0 || header.nodeOffset + header.nodeCount * sizeof(BVHNode) > size ||
+        header.wideNodeOffset % ACCEL_PAGE_SIZE != 0 || header.wideNodeOffset + header.wideNodeCount * sizeof(WideBVHNode) > size ||
+        header.sphereOffset % ACCEL_PAGE_SIZE != 0 || header.sphereOffset + header.sphereCount * sizeof(SphereRecord) > size ||
+        header.sphereMaterialOffset + header.sphereCount * sizeof(uint32_t) > size ||
+        (header.sphereCount > 0) != (header.nodeCount > 0) || (header.sphereCount > 0) != (header.wideNodeCount > 0))
+    {
+        return false;
+    }
+
+    Scene loaded(0, header.planeCount);
+
+    const unsigned char* cursor = mapping->data() + sizeof(AccelHeader);
+    for (uint64_t i = 0; i < header.materialCount; ++i, cursor += sizeof(MaterialEntry))
+    {
+        MaterialEntry entry;
+        std::memcpy(&entry, cursor, sizeof(entry));
+        if (entry.pattern > static_cast<uint32_t>(SurfacePattern::Noise))
+            return false;
+
+        Material material;
+        material._color = Vec3d(entry.color[0], entry.color[1], entry.color[2]);
+        material._secondaryColor = Vec3d(entry.secondaryColor[0], entry.secondaryColor[1], entry.secondaryColor[2]);
+        material._specular = Vec3d(entry.specular[0], entry.specular[1], entry.specular[2]);
+        material._shininess = entry.shininess;
+        material._frequency = entry.frequency;
+        material._pattern = static_cast<SurfacePattern>(entry.pattern);
+        loaded.addMaterial(material);
+    }
+
+    const unsigned char* planeMaterials = cursor + header.planeCount * sizeof(PlaneRecord);
+    for (uint64_t i = 0; i < header.planeCount; ++i)
+    {
+        // point and normal, PlaneRecord itself is not trivially copyable
+        double plane[6];
+        uint32_t material;
+        std::memcpy(plane, cursor + i * sizeof(PlaneRecord), sizeof(plane));
+        std::memcpy(&material, planeMaterials + i * sizeof(uint32_t), sizeof(material));
+        loaded.addPlane(Vec3d(plane[0], plane[1], plane[2]), Vec3d(plane[3], plane[4], plane[5]), material);
+    }
+
+    const unsigned char* base = mapping->data();
+    loaded.useMappedGeometry(mapping,
+        reinterpret_cast<const SphereRecord*>(base + header.sphereOffset),
+        reinterpret_cast<const uint32_t*>(base + header.sphereMaterialOffset),
+        static_cast<size_t>(header.sphereCount),
+        reinterpret_cast<const BVHNode*>(base + header.nodeOffset),
+        static_cast<size_t>(header.nodeCount),
+        reinterpret_cast<const WideBVHNode*>(base + header.wideNodeOffset),
+        static_cast<size_t>(header.wideNodeCount));
+
+    scene = std::move(loaded);
+    hash = header.hash;
+    return true;
+}
+
+/**
+ * @brief accelCachePath
+ */
+std::string accelCachePath(const std::string& directory, uint64_t hash)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "scene-%016llx.bvh", static_cast<unsigned long long>(hash));
+
+    if (directory.empty())
+        return name;
+    if (directory.back() == '/' || directory.back() == '\\')
+        return directory + name;
+    return directory + "/" + name;
+}
+
+/**
+ * @brief Compare the material tables of two scenes field by field.
+ */
+static bool sameMaterials(const Scene& a, const Scene& b)
+{
+    if (a.materialCount() != b.materialCount())
+        return false;
+    for (size_t i = 0; i < a.materialCount(); ++i)
+    {
+        const Material& x = a.materials()[i];
+        const Material& y = b.materials()[i];
+        if (x._color != y._color || x._secondaryColor != y._secondaryColor || x._specular != y._specular ||
+            x._shininess != y._shininess || x._frequency != y._frequency || x._pattern != y._pattern)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief loadOrBuildCachedAccel
+ */
+bool loadOrBuildCachedAccel(const std::string& directory, Scene& scene)
+{
+    const uint64_t hash = scene.geometryHash();
+    const std::string path = accelCachePath(directory, hash);
+
+    // the file name already contains the hash, the header guards against stale or foreign files;
+    // the loaded scene replaces the caller's, so its materials have to be the caller's as well
+    Scene cached(0, 0);
+    uint64_t cachedHash = 0;
+    if (loadAccelFile(path, cached, cachedHash) && cachedHash == hash &&
+        cached.sphereCount() == scene.sphereCount() && cached.planeCount() == scene.planeCount() &&
+        sameMaterials(cached, scene))
+    {
+        scene = std::move(cached);
+        return true;
+    }
+
+    scene.buildAccel();
+
+    // write to a temporary file first, so a concurrent run never maps a partial file
+    const std::string temporary = path + ".tmp";
+    if (writeAccelFile(scene, temporary, hash))
+    {
+        std::remove(path.c_str());
+        if (std::rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            std::cerr << "Could not store the acceleration cache " << path << std::endl;
+            std::remove(temporary.c_str());
+        }
+    }
+    return false;
+}
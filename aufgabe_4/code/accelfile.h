@@ -0,0 +1,52 @@
+#ifndef accelfile_h
+#define accelfile_h
+
+#include <cstdint>
+#include <string>
+
+#include "sceneobject.h"
+
+/**
+ * @brief Write a scene together with its sphere hierarchy to an acceleration file.
+ *
+ *        The file starts with a header and the small tables (materials, planes), which are
+ *        copied into memory on load. The binary and the 4-wide hierarchy, the sphere records
+ *        and the sphere material indices follow in page aligned sections and are mapped, so a
+ *        scene larger than the main memory is paged in on demand while rendering.
+ *
+ * @param scene The scene, buildAccel() must have been called.
+ * @param path The file to write.
+ * @param hash Hash of the scene geometry, stored to identify the scene later.
+ * @return true on success, false otherwise.
+ */
+bool writeAccelFile(const Scene& scene, const std::string& path, uint64_t hash);
+
+/**
+ * @brief Load a scene written by writeAccelFile().
+ * @param path The acceleration file.
+ * @param scene The loaded scene, its spheres and hierarchy reference the mapped file.
+ * @param hash The scene hash stored in the file.
+ * @return true on success, false if the file is missing or malformed.
+ */
+bool loadAccelFile(const std::string& path, Scene& scene, uint64_t& hash);
+
+/**
+ * @brief Get the name of the cached acceleration file of a scene.
+ * @param directory The cache directory.
+ * @param hash Hash of the scene geometry before the hierarchy was built.
+ * @return The path of the cache file, unique per hash.
+ */
+std::string accelCachePath(const std::string& directory, uint64_t hash);
+
+/**
+ * @brief Replace a scene by its cached acceleration file, or build the hierarchy and cache it.
+ *        The cache key is the geometry hash, which covers the materials as well. The cache file is
+ *        only used if the hash stored inside and its material table match the scene.
+ * @param directory The cache directory.
+ * @param scene The scene without hierarchy. On return it has a hierarchy, either mapped from
+ *        the cache or built in memory.
+ * @return true if the cache was hit, false if the hierarchy had to be built.
+ */
+bool loadOrBuildCachedAccel(const std::string& directory, Scene& scene);
+
+#endif // !accelfile_h
@@ -0,0 +1,90 @@
+#ifndef arena_h
+#define arena_h
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+/**
+ * @brief Size of a cache line in bytes. Every arena allocation starts on a cache line boundary.
+ */
+static const size_t CACHE_LINE_SIZE = 64;
+
+/**
+ * @brief Simple bump allocator handing out cache line aligned arrays from one contiguous block.
+ *        Objects placed in the arena are never destroyed individually; the whole block is
+ *        released together with the arena. Only use it for plain records.
+ */
+class Arena
+{
+public:
+    /**
+     * @brief Reserve a single block able to hold 'capacity' bytes of (aligned) allocations.
+     * @param capacity The number of bytes the arena can hand out.
+     */
+    explicit Arena(size_t capacity) :
+        _storage(new unsigned char[capacity + CACHE_LINE_SIZE]),
+        _capacity(capacity), _offset(0)
+    {
+        const uintptr_t address = reinterpret_cast<uintptr_t>(_storage.get());
+        _base = _storage.get() + (CACHE_LINE_SIZE - address % CACHE_LINE_SIZE) % CACHE_LINE_SIZE;
+    }
+
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * @brief Compute the number of bytes needed to place an array of 'count' objects of type T.
+     * @param count The number of array elements.
+     * @return The size of the array rounded up to a whole number of cache lines.
+     */
+    template<typename T>
+    static size_t bytesFor(size_t count)
+    {
+        return (count * sizeof(T) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+    }
+
+    /**
+     * @brief Allocate and default construct an array of 'count' objects of type T.
+     * @param count The number of array elements.
+     * @return Pointer to the first element, aligned to a cache line.
+     */
+    template<typename T>
+    T* allocate(size_t count)
+    {
+        static_assert(alignof(T) <= CACHE_LINE_SIZE, "Arena cannot satisfy the alignment of T.");
+
+        const size_t size = bytesFor<T>(count);
+        if (size > _capacity - _offset)
+            throw std::bad_alloc();
+
+        T* data = reinterpret_cast<T*>(_base + _offset);
+        for (size_t i = 0; i < count; ++i)
+            new (data + i) T();
+
+        _offset += size;
+        return data;
+    }
+
+    /**
+     * @brief Get the number of bytes handed out so far.
+     */
+    size_t used() const { return _offset; }
+
+    /**
+     * @brief Get the total number of bytes the arena can hand out.
+     */
+    size_t capacity() const { return _capacity; }
+
+private:
+    std::unique_ptr<unsigned char[]> _storage;  //< the memory block including alignment slack
+    unsigned char* _base;                       //< first cache line aligned byte of the block
+    size_t _capacity;                           //< usable bytes starting at _base
+    size_t _offset;                             //< bytes already handed out
+};
+
+#endif // !arena_h
@@ -0,0 +1,472 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace
+{
+    const int SAH_BINS = 16;                //< number of bins of the SAH sweep
+    const double SAH_TRAVERSAL_COST = 1.;   //< cost of a node visit relative to a sphere test
+
+    /**
+     * @brief Axis aligned bounding box in double precision, used during the build.
+     */
+    struct Bounds
+    {
+        Bounds() : lo(std::numeric_limits<double>::max()), hi(-std::numeric_limits<double>::max()) {}
+
+        void grow(const Vec3d& p)
+        {
+            lo = Vec3d(std::min(lo[0], p[0]), std::min(lo[1], p[1]), std::min(lo[2], p[2]));
+            hi = Vec3d(std::max(hi[0], p[0]), std::max(hi[1], p[1]), std::max(hi[2], p[2]));
+        }
+
+        void grow(const Bounds& b)
+        {
+            grow(b.lo);
+            grow(b.hi);
+        }
+
+        double area() const
+        {
+            if (hi[0] < lo[0])
+                return 0.;
+            const Vec3d e = hi - lo;
+            return 2. * (e[0] * e[1] + e[1] * e[2] + e[2] * e[0]);
+        }
+
+        Vec3d lo;
+        Vec3d hi;
+    };
+
+    /**
+     * @brief Node of the temporary hierarchy, before it is laid out into treelets.
+     */
+    struct BuildNode
+    {
+        Bounds bounds;
+        int children[2];    //< indices into the build nodes, -1 for leaves
+        uint32_t first;     //< first sphere of a leaf
+        uint32_t count;     //< number of spheres of a leaf
+    };
+
+    /**
+     * @brief State shared by the recursive build.
+     */
+    struct Builder
+    {
+        std::vector<Bounds> sphereBounds;
+        std::vector<Vec3d> centroids;
+        std::vector<uint32_t> order;        //< permutation of the spheres
+        std::vector<BuildNode> nodes;
+
+        int build(uint32_t first, uint32_t count, int depth);
+    };
+
+    /**
+     * @brief Number of levels below a node of 'count' spheres if it is split at the median
+     *        down to the leaves.
+     */
+    int medianSplitDepth(uint32_t count)
+    {
+        int depth = 0;
+        for (; count > BVH_MAX_LEAF_SIZE; count -= count / 2)
+            ++depth;
+        return depth;
+    }
+
+    /**
+     * @brief Recursively build the subtree over order[first, first + count).
+     * @param depth Depth of the subtree's root.
+     * @return Index of the subtree's root within the build nodes.
+     */
+    int Builder::build(uint32_t first, uint32_t count, int depth)
+    {
+        const int index = static_cast<int>(nodes.size());
+        nodes.push_back(BuildNode());
+
+        Bounds bounds;
+        Bounds centroidBounds;
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            bounds.grow(sphereBounds[order[i]]);
+            centroidBounds.grow(centroids[order[i]]);
+        }
+        nodes[index].bounds = bounds;
+        nodes[index].children[0] = nodes[index].children[1] = -1;
+        nodes[index].first = first;
+        nodes[index].count = count;
+
+        if (count <= BVH_MAX_LEAF_SIZE)
+            return index;
+
+        // split along the axis of largest centroid extent
+        const Vec3d extent = centroidBounds.hi - centroidBounds.lo;
+        int axis = 0;
+        if (extent[1] > extent[axis])
+            axis = 1;
+        if (extent[2] > extent[axis])
+            axis = 2;
+
+        uint32_t mid = first + count / 2;
+        if (extent[axis] > 0.)
+        {
+            // bin the centroids
+            Bounds binBounds[SAH_BINS];
+            uint32_t binCounts[SAH_BINS] = { 0 };
+            const double scale = SAH_BINS / extent[axis];
+            auto binOf = [&](uint32_t sphere)
+            {
+                const int bin = static_cast<int>((centroids[sphere][axis] - centroidBounds.lo[axis]) * scale);
+                return std::min(bin, SAH_BINS - 1);
+            };
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                const int bin = binOf(order[i]);
+                binBounds[bin].grow(sphereBounds[order[i]]);
+                ++binCounts[bin];
+            }
+
+            // sweep from the right to get the cost of all right hand sides
+            double rightArea[SAH_BINS];
+            uint32_t rightCount[SAH_BINS];
+            Bounds right;
+            uint32_t n = 0;
+            for (int b = SAH_BINS - 1; b > 0; --b)
+            {
+                right.grow(binBounds[b]);
+                n += binCounts[b];
+                rightArea[b] = right.area();
+                rightCount[b] = n;
+            }
+
+            // sweep from the left and pick the cheapest split
+            Bounds left;
+            n = 0;
+            double bestCost = std::numeric_limits<double>::max();
+            int bestSplit = -1;
+            for (int b = 1; b < SAH_BINS; ++b)
+            {
+                left.grow(binBounds[b - 1]);
+                n += binCounts[b - 1];
+                if (n == 0 || rightCount[b] == 0)
+                    continue;
+
+                const double cost = left.area() * n + rightArea[b] * rightCount[b];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestSplit = b;
+                }
+            }
+
+            // keep a leaf if splitting does not pay off
+            const double leafCost = bounds.area() * count;
+            if (bestSplit > 0 && count <= 2 * BVH_MAX_LEAF_SIZE &&
+                SAH_TRAVERSAL_COST * bounds.area() + bestCost >= leafCost)
+            {
+                return index;
+            }
+
+            if (bestSplit > 0)
+            {
+                uint32_t* split = std::partition(&order[first], &order[first] + count,
+                    [&](uint32_t sphere) { return binOf(sphere) < bestSplit; });
+                mid = static_cast<uint32_t>(split - &order[0]);
+            }
+        }
+
+        if (mid == first || mid == first + count)
+            mid = first + count / 2;
+
+        // a lopsided split has to leave room to finish the larger side by median splits
+        if (depth + 1 + medianSplitDepth(std::max(mid - first, first + count - mid)) > BVH_MAX_DEPTH)
+            mid = first + count / 2;
+
+        // all centroids coincide or binning failed: split in the middle of the order
+        if (extent[axis] <= 0. || mid == first + count / 2)
+        {
+            std::nth_element(&order[first], &order[mid], &order[first] + count,
+                [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+        }
+
+        const int leftChild = build(first, mid - first, depth + 1);
+        const int rightChild = build(mid, first + count - mid, depth + 1);
+        nodes[index].children[0] = leftChild;
+        nodes[index].children[1] = rightChild;
+        return index;
+    }
+
+    /**
+     * @brief Round a coordinate down to the next float.
+     */
+    float roundDown(double value)
+    {
+        float f = static_cast<float>(value);
+        if (static_cast<double>(f) > value)
+            f = std::nextafter(f, -std::numeric_limits<float>::infinity());
+        return f;
+    }
+
+    /**
+     * @brief Round a coordinate up to the next float.
+     */
+    float roundUp(double value)
+    {
+        float f = static_cast<float>(value);
+        if (static_cast<double>(f) < value)
+            f = std::nextafter(f, std::numeric_limits<float>::infinity());
+        return f;
+    }
+
+    /**
+     * @brief Emit the treelet rooted at a build node into the final node array.
+     * @param build The temporary hierarchy.
+     * @param root Index of the treelet root within the build nodes.
+     * @param slot Index of the treelet root within the final nodes, already allocated.
+     * @param nodes The final nodes.
+     */
+    void emitTreelet(const std::vector<BuildNode>& build, int root, uint32_t slot, std::vector<BVHNode>& nodes)
+    {
+        std::vector<std::pair<int, uint32_t>> frontier(1, std::make_pair(root, slot));
+        std::vector<std::pair<int, uint32_t>> deferred;
+        size_t used = 1;
+
+        // breadth-first within the treelet
+        for (size_t k = 0; k < frontier.size(); ++k)
+        {
+            const BuildNode& source = build[frontier[k].first];
+            const uint32_t target = frontier[k].second;
+
+            for (int a = 0; a < 3; ++a)
+            {
+                nodes[target].bmin[a] = roundDown(source.bounds.lo[a]);
+                nodes[target].bmax[a] = roundUp(source.bounds.hi[a]);
+            }
+
+            if (source.children[0] < 0)
+            {
+                nodes[target].child = source.first;
+                nodes[target].count = source.count;
+                continue;
+            }
+
+            // allocate both children next to each other
+            const uint32_t pair = static_cast<uint32_t>(nodes.size());
+            nodes.resize(nodes.size() + 2);
+            nodes[target].child = pair;
+            nodes[target].count = 0;
+
+            std::vector<std::pair<int, uint32_t>>& queue = (used + 2 <= BVH_TREELET_NODES) ? frontier : deferred;
+            queue.push_back(std::make_pair(source.children[0], pair));
+            queue.push_back(std::make_pair(source.children[1], pair + 1));
+            used += 2;
+        }
+
+        // the remaining subtrees form new treelets in depth-first order
+        for (const auto& subtree : deferred)
+            emitTreelet(build, subtree.first, subtree.second, nodes);
+    }
+
+    /**
+     * @brief Ray-box slab test.
+     * @return The entry distance, or infinity if the box is missed or farther than t_max.
+     */
+    inline double boxEntry(const BVHNode& node, const Vec3d& origin, const Vec3d& invDir, double t_max)
+    {
+        double t_enter = 0.;
+        double t_exit = t_max;
+        for (int a = 0; a < 3; ++a)
+        {
+            double t0 = (node.bmin[a] - origin[a]) * invDir[a];
+            double t1 = (node.bmax[a] - origin[a]) * invDir[a];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            t_enter = std::max(t_enter, t0);
+            t_exit = std::min(t_exit, t1);
+        }
+        return (t_enter <= t_exit) ? t_enter : std::numeric_limits<double>::infinity();
+    }
+}
+
+/**
+ * @brief Recompute the bounds of a node from its children or spheres.
+ */
+static void refitNode(BVHNode* nodes, uint32_t index, const SphereRecord* spheres)
+{
+    BVHNode& node = nodes[index];
+    double lo[3] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+    double hi[3] = { -lo[0], -lo[1], -lo[2] };
+
+    if (node.count > 0)
+    {
+        for (uint32_t i = node.child; i < node.child + node.count; ++i)
+        {
+            for (int a = 0; a < 3; ++a)
+            {
+                lo[a] = std::min(lo[a], spheres[i].center[a] - spheres[i].radius);
+                hi[a] = std::max(hi[a], spheres[i].center[a] + spheres[i].radius);
+            }
+        }
+        for (int a = 0; a < 3; ++a)
+        {
+            node.bmin[a] = roundDown(lo[a]);
+            node.bmax[a] = roundUp(hi[a]);
+        }
+        return;
+    }
+
+    // the bounds of the children are already rounded outwards
+    refitNode(nodes, node.child, spheres);
+    refitNode(nodes, node.child + 1, spheres);
+    for (int a = 0; a < 3; ++a)
+    {
+        node.bmin[a] = std::min(nodes[node.child].bmin[a], nodes[node.child + 1].bmin[a]);
+        node.bmax[a] = std::max(nodes[node.child].bmax[a], nodes[node.child + 1].bmax[a]);
+    }
+}
+
+/**
+ * @brief buildBVH
+ */
+std::vector<BVHNode> buildBVH(SphereRecord* spheres, uint32_t* materials, size_t count)
+{
+    std::vector<BVHNode> nodes;
+    if (count == 0)
+        return nodes;
+
+    Builder builder;
+    builder.sphereBounds.resize(count);
+    builder.centroids.resize(count);
+    builder.order.resize(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Vec3d r(spheres[i].radius);
+        builder.sphereBounds[i].grow(spheres[i].center - r);
+        builder.sphereBounds[i].grow(spheres[i].center + r);
+        builder.centroids[i] = spheres[i].center;
+        builder.order[i] = static_cast<uint32_t>(i);
+    }
+    builder.nodes.reserve(2 * count / BVH_MAX_LEAF_SIZE + 1);
+    const int root = builder.build(0, static_cast<uint32_t>(count), 0);
+
+    // reorder the spheres to match the leaves
+    std::vector<SphereRecord> sortedSpheres(count);
+    std::vector<uint32_t> sortedMaterials(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        sortedSpheres[i] = spheres[builder.order[i]];
+        sortedMaterials[i] = materials[builder.order[i]];
+    }
+    std::copy(sortedSpheres.begin(), sortedSpheres.end(), spheres);
+    std::copy(sortedMaterials.begin(), sortedMaterials.end(), materials);
+
+    nodes.reserve(builder.nodes.size());
+    nodes.resize(1);
+    emitTreelet(builder.nodes, root, 0, nodes);
+    return nodes;
+}
+
+/**
+ * @brief Traverse the hierarchy front to back.
+ * @tparam AnyHit Stop at the first hit closer than t_near instead of searching the closest one.
+ */
+template<bool AnyHit>
+static bool traverseBVH(const BVHNode* nodes, const SphereRecord* spheres, const Ray& ray,
+    double& t_near, uint32_t& index)
+{
+    // avoid 0 * inf in the slab test for axis parallel rays
+    Vec3d invDir;
+    for (int a = 0; a < 3; ++a)
+        invDir[a] = (ray.dir[a] != 0.) ? 1. / ray.dir[a] : std::copysign(1.e300, ray.dir[a]);
+
+    if (boxEntry(nodes[0], ray.origin, invDir, t_near) == std::numeric_limits<double>::infinity())
+        return false;
+
+    // stack of nodes still to visit together with their entry distance, at most one per level
+    std::pair<uint32_t, double> stack[BVH_MAX_DEPTH];
+    int stackSize = 0;
+    uint32_t current = 0;
+    bool hit = false;
+
+    while (true)
+    {
+        const BVHNode& node = nodes[current];
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.child; i < node.child + node.count; ++i)
+            {
+                double t = std::numeric_limits<double>::max();
+                if (intersectSphere(spheres[i], ray, t) && t < t_near)
+                {
+                    t_near = t;
+                    index = i;
+                    hit = true;
+                    if (AnyHit)
+                        return true;
+                }
+            }
+        }
+        else
+        {
+            // visit the nearer child first
+            const double t0 = boxEntry(nodes[node.child], ray.origin, invDir, t_near);
+            const double t1 = boxEntry(nodes[node.child + 1], ray.origin, invDir, t_near);
+            const bool hit0 = t0 != std::numeric_limits<double>::infinity();
+            const bool hit1 = t1 != std::numeric_limits<double>::infinity();
+
+            if (hit0 && hit1)
+            {
+                const bool firstNearer = t0 <= t1;
+                assert(stackSize < BVH_MAX_DEPTH);
+                stack[stackSize++] = firstNearer ? std::make_pair(node.child + 1, t1) : std::make_pair(node.child, t0);
+                current = firstNearer ? node.child : node.child + 1;
+                continue;
+            }
+            if (hit0 || hit1)
+            {
+                current = hit0 ? node.child : node.child + 1;
+                continue;
+            }
+        }
+
+        // continue with the next node that may still contain a closer hit
+        do
+        {
+            if (stackSize == 0)
+                return hit;
+            --stackSize;
+        } while (stack[stackSize].second >= t_near);
+        current = stack[stackSize].first;
+    }
+}
+
+/**
+ * @brief intersectBVH
+ */
+bool intersectBVH(const BVHNode* nodes, const SphereRecord* spheres, const Ray& ray,
+    double& t_near, uint32_t& index)
+{
+    return traverseBVH<false>(nodes, spheres, ray, t_near, index);
+}
+
+/**
+ * @brief occludedBVH
+ */
+bool occludedBVH(const BVHNode* nodes, const SphereRecord* spheres, const Ray& ray,
+    double t_max, uint32_t& index)
+{
+    return traverseBVH<true>(nodes, spheres, ray, t_max, index);
+}
+
+/**
+ * @brief refitBVH
+ */
+void refitBVH(BVHNode* nodes, size_t nodeCount, const SphereRecord* spheres)
+{
+    if (nodeCount > 0)
+        refitNode(nodes, 0, spheres);
+}
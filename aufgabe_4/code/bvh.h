@@ -0,0 +1,81 @@
+#ifndef bvh_h
+#define bvh_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "sceneobject.h"
+#include "util.h"
+
+/**
+ * @brief Maximum number of spheres in a leaf of the hierarchy.
+ */
+static const uint32_t BVH_MAX_LEAF_SIZE = 4;
+
+/**
+ * @brief Maximum depth of a leaf of the hierarchy, the root has depth 0. It bounds the
+ *        traversal stacks of the binary and the wide hierarchy.
+ */
+static const int BVH_MAX_DEPTH = 64;
+
+/**
+ * @brief Number of nodes filling one 4 KiB page. Nodes are laid out in treelets of this size.
+ */
+static const size_t BVH_TREELET_NODES = 4096 / sizeof(BVHNode);
+
+/**
+ * @brief Build a bounding volume hierarchy over a set of spheres using the binned
+ *        surface area heuristic.
+ *
+ *        The spheres (and their material indices) are reordered, so the spheres of every
+ *        leaf are stored contiguously in depth-first order of the hierarchy. The nodes are
+ *        grouped into treelets: starting at a treelet root, nodes are emitted breadth-first
+ *        until BVH_TREELET_NODES nodes are used, the remaining subtrees start new treelets,
+ *        which follow in depth-first order. A ray therefore touches few distinct pages
+ *        while descending, which matters when the hierarchy is paged in on demand.
+ *        Lopsided splits, e.g. of clustered or exponentially spaced spheres, are replaced by
+ *        median splits where needed to keep every leaf within BVH_MAX_DEPTH.
+ *
+ * @param spheres The spheres, reordered in place.
+ * @param materials The material index per sphere, reordered in place.
+ * @param count The number of spheres.
+ * @return The nodes of the hierarchy, the root is node 0. Empty if there are no spheres.
+ */
+std::vector<BVHNode> buildBVH(SphereRecord* spheres, uint32_t* materials, size_t count);
+
+/**
+ * @brief Find the closest intersection of a ray with the spheres of a hierarchy.
+ * @param nodes The nodes of the hierarchy.
+ * @param spheres The spheres in the order produced by buildBVH().
+ * @param ray The ray to trace.
+ * @param t_near In: only hits closer than t_near are reported. Out: distance of the closest hit.
+ * @param index Index of the closest sphere hit.
+ * @return true if a sphere closer than the incoming t_near was hit.
+ */
+bool intersectBVH(const BVHNode* nodes, const SphereRecord* spheres, const Ray& ray,
+    double& t_near, uint32_t& index);
+
+/**
+ * @brief Check whether a ray hits any sphere of a hierarchy closer than t_max.
+ * @param nodes The nodes of the hierarchy.
+ * @param spheres The spheres in the order produced by buildBVH().
+ * @param ray The ray to trace.
+ * @param t_max Only hits closer than t_max count.
+ * @param index Index of the first sphere found in between.
+ * @return true if a sphere closer than t_max was hit.
+ */
+bool occludedBVH(const BVHNode* nodes, const SphereRecord* spheres, const Ray& ray,
+    double t_max, uint32_t& index);
+
+/**
+ * @brief Update the bounds of a hierarchy to spheres that moved or changed their radius.
+ *        The topology stays the same, so the hierarchy degrades as spheres move far from
+ *        where it was built; rebuild it with buildBVH() then.
+ * @param nodes The nodes of the hierarchy, updated in place.
+ * @param nodeCount The number of nodes.
+ * @param spheres The spheres in the order produced by buildBVH().
+ */
+void refitBVH(BVHNode* nodes, size_t nodeCount, const SphereRecord* spheres);
+
+#endif // !bvh_h
@@ -0,0 +1,115 @@
+#include "camera.h"
+
+#include <cmath>
+
+/**
+ * @brief Camera::Camera
+ */
+Camera::Camera(const Vec3d& position) :
+    _position(position), _side(1., 0., 0.), _up(0., 1., 0.), _forward(0., 0., -1.),
+    _l(-1.), _r(+1.), _b(-1.), _t(+1.), _d(+2.)
+{
+}
+
+/**
+ * @brief Camera::lookAt
+ */
+Camera Camera::lookAt(const Vec3d& position, const Vec3d& target, double fov, double aspect)
+{
+    Camera camera(position);
+    camera._forward = (target - position).normalize();
+
+    // looking straight up or down, 'up' in the image is taken from -z instead of +y
+    camera._side = camera._forward.cross(Vec3d(0., 1., 0.));
+    if (camera._side.length() < 1e-9)
+        camera._side = camera._forward.cross(Vec3d(0., 0., -1.));
+    camera._side.normalize();
+    camera._up = camera._side.cross(camera._forward);
+
+    const double halfHeight = std::tan(fov * 3.14159265358979323846 / 360.);
+    camera._t = halfHeight;
+    camera._b = -halfHeight;
+    camera._r = halfHeight * aspect;
+    camera._l = -halfHeight * aspect;
+    camera._d = 1.;
+    return camera;
+}
+
+/**
+ * @brief Camera::hash
+ */
+uint64_t Camera::hash(uint64_t hash) const
+{
+    const double values[17] = { _position[0], _position[1], _position[2], _side[0], _side[1], _side[2],
+        _up[0], _up[1], _up[2], _forward[0], _forward[1], _forward[2], _l, _r, _b, _t, _d };
+    return hashBytes(values, sizeof(values), hash);
+}
+
+/**
+ * @brief Camera::moved
+ */
+Camera Camera::moved(const Vec3d& offset) const
+{
+    Camera camera(*this);
+    camera._position += offset;
+    return camera;
+}
+
+/**
+ * @brief Camera::primaryRay
+ */
+Ray Camera::primaryRay(const Vec3i& viewport, double x, double y) const
+{
+    const double u = _l + (_r - _l) * x / viewport[0];
+    const double v = _t + (_b - _t) * y / viewport[1];
+
+    Ray ray;
+    ray.origin = _position;
+    ray.dir = _side * u + _up * v + _forward * _d;
+    ray.dir = ray.dir.normalize();
+    return ray;
+}
+
+/**
+ * @brief Camera::project
+ */
+bool Camera::project(const Vec3i& viewport, const Vec3d& point, double& x, double& y) const
+{
+    const Vec3d q = point - _position;
+    const double depth = q.dot(_forward);
+    if (depth <= 0.)
+        return false;
+
+    const double u = q.dot(_side) * _d / depth;
+    const double v = q.dot(_up) * _d / depth;
+    x = (u - _l) / (_r - _l) * viewport[0];
+    y = (v - _t) / (_b - _t) * viewport[1];
+    return true;
+}
+
+/**
+ * @brief Camera::frustum
+ */
+Frustum Camera::frustum(const Vec3i& viewport, double x0, double y0, double x1, double y1) const
+{
+    const Vec3d corners[4] =
+    {
+        primaryRay(viewport, x0, y0).dir,
+        primaryRay(viewport, x1, y0).dir,
+        primaryRay(viewport, x1, y1).dir,
+        primaryRay(viewport, x0, y1).dir
+    };
+    const Vec3d center = primaryRay(viewport, 0.5 * (x0 + x1), 0.5 * (y0 + y1)).dir;
+
+    Frustum frustum;
+    frustum.apex = _position;
+    for (int k = 0; k < 4; ++k)
+    {
+        // the plane through two neighbouring corner rays, facing the center ray
+        Vec3d normal = corners[k].cross(corners[(k + 1) % 4]).normalize();
+        if (normal.dot(center) < 0.)
+            normal = -normal;
+        frustum.normals[k] = normal;
+    }
+    return frustum;
+}
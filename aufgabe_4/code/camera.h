@@ -0,0 +1,120 @@
+#ifndef camera_h
+#define camera_h
+
+#include "util.h"
+#include "vec3.h"
+
+/**
+ * @brief The side planes of the pyramid of primary rays through a rectangle of pixels.
+ */
+struct Frustum
+{
+    Vec3d apex;         //< camera position
+    Vec3d normals[4];   //< unit normals of the side planes, pointing inwards
+
+    /**
+     * @brief Check whether a sphere touches the frustum, conservatively: spheres close to an
+     *        edge of the frustum may pass although they lie outside.
+     * @param center Center of the sphere.
+     * @param radius Radius of the sphere.
+     * @return false if no ray of the frustum can hit the sphere.
+     */
+    bool intersectsSphere(const Vec3d& center, double radius) const
+    {
+        const Vec3d offset = center - apex;
+        // allow for the rounding of the ray directions
+        const double margin = radius + 1e-9 * offset.length();
+        for (int k = 0; k < 4; ++k)
+        {
+            if (normals[k].dot(offset) < -margin)
+                return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * @brief The Camera class. A pinhole camera mapping pixel positions onto a view plane.
+ *        The view plane spans [l,r] x [b,t] in the camera's side and up directions, at
+ *        distance d along its viewing direction. Both spans are mapped onto the resolution,
+ *        so the aspect ratio of the plane has to match the one of the image to avoid stretching.
+ */
+class Camera
+{
+public:
+    /**
+     * @brief Construct the default camera, looking along -z with +y up.
+     *        Its view plane spans [-1,1] x [-1,1] at distance 2.
+     * @param position Camera position in world coordinates.
+     */
+    explicit Camera(const Vec3d& position = Vec3d(0.));
+
+    /**
+     * @brief Construct a camera looking at a point, keeping +y up.
+     * @param position Camera position in world coordinates.
+     * @param target The point in the center of the image.
+     * @param fov Vertical field of view in degrees.
+     * @param aspect Width divided by height of the image.
+     * @return The camera.
+     */
+    static Camera lookAt(const Vec3d& position, const Vec3d& target, double fov, double aspect);
+
+    /**
+     * @brief Get a copy of the camera moved by an offset, keeping its orientation.
+     */
+    Camera moved(const Vec3d& offset) const;
+
+    /**
+     * @brief Get the camera position in world coordinates.
+     */
+    const Vec3d& position() const { return _position; }
+
+    /**
+     * @brief Generate the primary ray through a point on the view plane.
+     * @param viewport Size of the framebuffer.
+     * @param x Horizontal position in pixel units, i + 0.5 is the center of pixel column i.
+     * @param y Vertical position in pixel units, j + 0.5 is the center of pixel row j.
+     * @return The normalized ray starting at the camera position.
+     */
+    Ray primaryRay(const Vec3i& viewport, double x, double y) const;
+
+    /**
+     * @brief Project a point onto the view plane, the inverse of primaryRay().
+     * @param viewport Size of the framebuffer.
+     * @param point The point to project.
+     * @param x Horizontal position in pixel units.
+     * @param y Vertical position in pixel units.
+     * @return false if the point lies behind the camera.
+     */
+    bool project(const Vec3i& viewport, const Vec3d& point, double& x, double& y) const;
+
+    /**
+     * @brief Get the frustum of all primary rays through a rectangle of the view plane.
+     * @param viewport Size of the framebuffer.
+     * @param x0 Left edge in pixel units.
+     * @param y0 Top edge in pixel units.
+     * @param x1 Right edge in pixel units, greater than x0.
+     * @param y1 Bottom edge in pixel units, greater than y0.
+     * @return The frustum.
+     */
+    Frustum frustum(const Vec3i& viewport, double x0, double y0, double x1, double y1) const;
+
+    /**
+     * @brief Hash the position, orientation and view plane of the camera.
+     * @param hash The hash to continue from.
+     * @return The updated hash.
+     */
+    uint64_t hash(uint64_t hash = HASH_SEED) const;
+
+private:
+    Vec3d _position;    //< camera position
+    Vec3d _side;        //< unit vector pointing right in the image
+    Vec3d _up;          //< unit vector pointing up in the image
+    Vec3d _forward;     //< unit viewing direction
+
+    double _l, _r;      //< horizontal extent of the view plane
+    double _b, _t;      //< vertical extent of the view plane
+    double _d;          //< distance of the view plane to the camera
+};
+
+#endif // !camera_h
@@ -0,0 +1,83 @@
+#include "cgimage.h"
+
+#include <fstream>
+#include <iostream>
+
+#include "util.h"
+
+// the pixels are written to files as they are stored
+static_assert(sizeof(RGBImage::tuple_type) == 3 * sizeof(float), "RGB pixels have to be packed floats.");
+
+/**
+ * @brief renderImage
+ */
+void renderImage(const Scene& scene, const std::vector<Pointlight>& lights, const Camera& camera,
+    const AdaptiveSampling& sampling, const ShadingSettings& shading, RGBImage& image)
+{
+    const int width = static_cast<int>(image.get_width());
+    const Vec3i viewport(width, static_cast<int>(image.get_height()), 0);
+    RGBImage::tuple_type* pixels = image.data();
+
+    // tiles do not overlap, so the threads write disjoint pixels
+    renderTiles(viewport, scene, lights, camera, sampling, shading,
+        [pixels, width](const Tile& tile, const Vec3d* colors)
+        {
+            for (int j = tile.y0; j < tile.y1; ++j)
+            {
+                RGBImage::tuple_type* row = pixels + static_cast<size_t>(j) * width;
+                for (int i = tile.x0; i < tile.x1; ++i, ++colors)
+                {
+                    row[i][0] = static_cast<float>((*colors)[0]);
+                    row[i][1] = static_cast<float>((*colors)[1]);
+                    row[i][2] = static_cast<float>((*colors)[2]);
+                }
+            }
+        });
+}
+
+/**
+ * @brief saveImage
+ */
+bool saveImage(const std::string& name, const RGBImage& image)
+{
+    const size_t width = image.get_width();
+    const size_t height = image.get_height();
+    const RGBImage::tuple_type* pixels = image.data();
+
+    const size_t dot = name.find_last_of('.');
+    const std::string extension = (dot == std::string::npos) ? "" : name.substr(dot);
+
+    std::ofstream os(name, std::ios::out | std::ios::binary);
+    if (extension == ".pfm")
+    {
+        // rows bottom to top
+        os << "PF\n" << width << " " << height << "\n-1.0\n";
+        for (size_t j = height; j-- > 0;)
+            os.write(reinterpret_cast<const char*>(pixels + j * width), static_cast<std::streamsize>(width * sizeof(*pixels)));
+    }
+    else if (extension == ".raw")
+    {
+        os.write(reinterpret_cast<const char*>(pixels), static_cast<std::streamsize>(width * height * sizeof(*pixels)));
+    }
+    else
+    {
+        os << "P6\n" << width << " " << height << "\n255\n";
+        std::vector<char> row(width * 3);
+        for (size_t j = 0; j < height; ++j)
+        {
+            for (size_t i = 0; i < width; ++i)
+            {
+                const RGBImage::tuple_type& pixel = pixels[i + j * width];
+                quantize(Vec3d(pixel[0], pixel[1], pixel[2]), row[i * 3 + 0], row[i * 3 + 1], row[i * 3 + 2]);
+            }
+            os.write(row.data(), static_cast<std::streamsize>(row.size()));
+        }
+    }
+
+    if (!os)
+    {
+        std::cerr << "Could not write the image " << name << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef cgimage_h
+#define cgimage_h
+
+#include <string>
+#include <vector>
+
+#include "Image.h"
+
+#include "camera.h"
+#include "pointlight.h"
+#include "renderer.h"
+#include "sceneobject.h"
+#include "tracer.h"
+
+/**
+ * @brief Float RGB image of the image library of exercise 7. Holds linear colors as the
+ *        renderer computes them, not clamped to [0,1], like the PFM output does.
+ */
+typedef cg::image<cg::color_space_t::RGB> RGBImage;
+
+/**
+ * @brief Render a frame straight into an image of the image library, so its filters and
+ *        writers work on the render output in place. Each finished tile is written into the
+ *        image's pixel storage by the thread that rendered it; no framebuffer of the whole
+ *        frame is allocated and nothing is copied afterwards.
+ *        The image's size is the viewport. Pixels are sampled like renderTiles() does.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param camera The camera.
+ * @param sampling Number of samples per pixel.
+ * @param shading Settings of the shading.
+ * @param image The image receiving the frame.
+ */
+void renderImage(const Scene& scene, const std::vector<Pointlight>& lights, const Camera& camera,
+    const AdaptiveSampling& sampling, const ShadingSettings& shading, RGBImage& image);
+
+/**
+ * @brief Save an image of the image library in the format selected by the file extension,
+ *        like saveImage() does for a framebuffer: .pfm and .raw store the floats as they are,
+ *        PPM clamps and quantizes them like quantize(). cg::image_io::save_rgb_image() expects
+ *        colors within [0,1] and is therefore not used for rendered images.
+ * @param name The file name of the image.
+ * @param image The image.
+ * @return true on success, false otherwise.
+ */
+bool saveImage(const std::string& name, const RGBImage& image);
+
+#endif // !cgimage_h
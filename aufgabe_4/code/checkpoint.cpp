@@ -0,0 +1,192 @@
+#include "checkpoint.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+static const char CHECKPOINT_MAGIC[8] = { 'R', 'T', 'C', 'K', 'P', 'T', '0', '1' };
+
+/**
+ * @brief Fixed size header at the start of every checkpoint file.
+ */
+struct CheckpointHeader
+{
+    char magic[8];      //< file identification
+    uint32_t width;     //< viewport width
+    uint32_t height;    //< viewport height
+    uint32_t tileSize;  //< edge length of a tile
+    uint32_t reserved;  //< padding, always 0
+    uint64_t hash;      //< hash of the scene and the render settings
+};
+
+/**
+ * @brief Fixed size part of a tile record, followed by the sums and sample counts.
+ */
+struct TileRecordHeader
+{
+    uint32_t index;         //< row-major index of the tile
+    uint32_t pixelCount;    //< number of pixels of the tile
+};
+
+/**
+ * @brief Append a tile record to a checkpoint file.
+ * @param file The checkpoint file.
+ * @param record The accumulated samples of the tile.
+ */
+static void writeRecord(std::ofstream& file, const TileRecord& record)
+{
+    TileRecordHeader header;
+    header.index = record.index;
+    header.pixelCount = static_cast<uint32_t>(record.samples.size());
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(record.sums.data()),
+        static_cast<std::streamsize>(record.sums.size() * sizeof(Vec3d)));
+    file.write(reinterpret_cast<const char*>(record.samples.data()),
+        static_cast<std::streamsize>(record.samples.size() * sizeof(uint32_t)));
+}
+
+/**
+ * @brief CheckpointWriter::CheckpointWriter
+ */
+CheckpointWriter::CheckpointWriter(const CheckpointSettings& settings, const Vec3i& viewport,
+    int tileSize, uint64_t hash, const std::vector<TileRecord>& restored) :
+    _interval(settings.interval), _stop(false)
+{
+    // the old checkpoint stays in place until the new one holds all of its tiles
+    const std::string temporary = settings.path + ".tmp";
+    std::ofstream file(temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+    CheckpointHeader header;
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.width = static_cast<uint32_t>(viewport[0]);
+    header.height = static_cast<uint32_t>(viewport[1]);
+    header.tileSize = static_cast<uint32_t>(tileSize);
+    header.reserved = 0;
+    header.hash = hash;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& record : restored)
+        writeRecord(file, record);
+    file.close();
+
+    // rename() does not replace an existing file on Windows
+    bool replaced = file && std::rename(temporary.c_str(), settings.path.c_str()) == 0;
+    if (file && !replaced)
+    {
+        std::remove(settings.path.c_str());
+        replaced = std::rename(temporary.c_str(), settings.path.c_str()) == 0;
+    }
+
+    if (!replaced)
+    {
+        std::cerr << "Could not write checkpoint file " << settings.path << std::endl;
+        std::remove(temporary.c_str());
+    }
+    else
+    {
+        _file.open(settings.path.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+        if (!_file.is_open())
+            std::cerr << "Could not open checkpoint file " << settings.path << std::endl;
+    }
+
+    _thread = std::thread(&CheckpointWriter::run, this);
+}
+
+/**
+ * @brief CheckpointWriter::~CheckpointWriter
+ */
+CheckpointWriter::~CheckpointWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wakeup.notify_one();
+    _thread.join();
+}
+
+/**
+ * @brief CheckpointWriter::tileFinished
+ */
+void CheckpointWriter::tileFinished(TileRecord&& record)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pending.push_back(std::move(record));
+}
+
+/**
+ * @brief CheckpointWriter::run
+ */
+void CheckpointWriter::run()
+{
+    bool stop = false;
+    while (!stop)
+    {
+        std::vector<TileRecord> records;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeup.wait_for(lock, std::chrono::duration<double>(_interval), [this] { return _stop; });
+            stop = _stop;
+            records.swap(_pending);
+        }
+
+        if (records.empty() || !_file.is_open())
+            continue;
+
+        // file I/O happens outside the lock, render threads are never blocked by it
+        for (const auto& record : records)
+            writeRecord(_file, record);
+        _file.flush();
+    }
+}
+
+/**
+ * @brief loadCheckpoint
+ */
+bool loadCheckpoint(const std::string& path, const Vec3i& viewport, int tileSize, uint64_t hash,
+    std::vector<TileRecord>& records)
+{
+    records.clear();
+
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    CheckpointHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.width != static_cast<uint32_t>(viewport[0]) ||
+        header.height != static_cast<uint32_t>(viewport[1]) ||
+        header.tileSize != static_cast<uint32_t>(tileSize) ||
+        header.hash != hash)
+    {
+        return false;
+    }
+
+    const size_t maxPixels = static_cast<size_t>(tileSize) * tileSize;
+    TileRecordHeader recordHeader;
+    while (file.read(reinterpret_cast<char*>(&recordHeader), sizeof(recordHeader)))
+    {
+        if (recordHeader.pixelCount > maxPixels)
+            break;
+
+        TileRecord record;
+        record.index = recordHeader.index;
+        record.sums.resize(recordHeader.pixelCount);
+        record.samples.resize(recordHeader.pixelCount);
+
+        // a truncated record at the end of the file is the remainder of an interrupted write
+        if (!file.read(reinterpret_cast<char*>(record.sums.data()),
+                static_cast<std::streamsize>(record.sums.size() * sizeof(Vec3d))) ||
+            !file.read(reinterpret_cast<char*>(record.samples.data()),
+                static_cast<std::streamsize>(record.samples.size() * sizeof(uint32_t))))
+        {
+            break;
+        }
+
+        records.push_back(std::move(record));
+    }
+
+    return true;
+}
@@ -0,0 +1,106 @@
+#ifndef checkpoint_h
+#define checkpoint_h
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tiles.h"
+#include "vec3.h"
+
+/**
+ * @brief Settings of the render checkpointing.
+ */
+struct CheckpointSettings
+{
+    CheckpointSettings() : interval(10.), resume(false) {}
+
+    std::string path;   //< checkpoint file, checkpointing is disabled if empty
+    double interval;    //< seconds between two writes of the checkpoint
+    bool resume;        //< continue from an existing checkpoint
+};
+
+/**
+ * @brief Accumulated samples of one finished tile.
+ */
+struct TileRecord
+{
+    uint32_t index;                 //< row-major index of the tile
+    std::vector<Vec3d> sums;        //< sum of all samples per pixel, row-major within the tile
+    std::vector<uint32_t> samples;  //< number of samples per pixel
+};
+
+/**
+ * @brief The CheckpointWriter class.
+ *        Render threads hand over finished tiles, which only costs a copy under a short lock.
+ *        A background thread appends them to the checkpoint file every 'interval' seconds.
+ *
+ *        The file starts with a header identifying the render (viewport, tile size and a hash
+ *        of scene and settings) followed by one record per finished tile. Records are only
+ *        ever appended, so a crash can at most lose a truncated last record.
+ *        The tiles restored from a previous checkpoint are written before the writer starts,
+ *        into a new file that replaces the old one only once it is complete, so the progress
+ *        saved so far survives a crash at any time.
+ */
+class CheckpointWriter
+{
+public:
+    /**
+     * @brief Start the background writer.
+     * @param settings Checkpoint file and interval.
+     * @param viewport Size of the framebuffer.
+     * @param tileSize Edge length of a tile in pixels.
+     * @param hash Hash of the scene and the render settings.
+     * @param restored Tiles restored from the previous checkpoint, written synchronously.
+     */
+    CheckpointWriter(const CheckpointSettings& settings, const Vec3i& viewport, int tileSize,
+        uint64_t hash, const std::vector<TileRecord>& restored);
+
+    /**
+     * @brief Write all pending tiles and stop the background thread.
+     */
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    /**
+     * @brief Queue a finished tile for writing. Safe to call from several threads.
+     * @param record The accumulated samples of the tile.
+     */
+    void tileFinished(TileRecord&& record);
+
+private:
+    /**
+     * @brief Main loop of the background thread.
+     */
+    void run();
+
+    std::ofstream _file;                //< the checkpoint file, only touched by the background thread
+    double _interval;                   //< seconds between two writes
+
+    std::mutex _mutex;                  //< guards _pending and _stop
+    std::condition_variable _wakeup;    //< signals _stop to the background thread
+    std::vector<TileRecord> _pending;   //< finished tiles not written yet
+    bool _stop;                         //< set on destruction
+
+    std::thread _thread;                //< the background thread
+};
+
+/**
+ * @brief Read a checkpoint written by CheckpointWriter.
+ * @param path The checkpoint file.
+ * @param viewport Size of the framebuffer, must match the checkpoint.
+ * @param tileSize Edge length of a tile in pixels, must match the checkpoint.
+ * @param hash Hash of the scene and the render settings, must match the checkpoint.
+ * @param records All complete tile records of the checkpoint.
+ * @return true if the checkpoint belongs to this render, false otherwise.
+ */
+bool loadCheckpoint(const std::string& path, const Vec3i& viewport, int tileSize, uint64_t hash,
+    std::vector<TileRecord>& records);
+
+#endif // !checkpoint_h
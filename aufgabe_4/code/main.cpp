@@ -1,252 +1,666 @@
-#include <algorithm>
-#include <cmath>
-#include <limits>
-#include <memory>
-#include <tuple>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "accelfile.h"
+#include "camera.h"
+#include "checkpoint.h"
+#include "mappedfile.h"
 #include "pointlight.h"
+#include "relight.h"
+#include "renderer.h"
 #include "scene.h"
+#include "scenefile.h"
 #include "sceneobject.h"
+#include "shadowmap.h"
+#include "tracer.h"
 #include "util.h"
 #include "vec3.h"
 
+#ifdef HAVE_CG_IMAGE
+#include "cgimage.h"
+#endif
+
 const static int SEED = 42;
 
 const static int WIDTH = 600;
 const static int HEIGHT = 600;
-const static int MAX_DEPTH = 5;
-
-//////////
-// TODO 2:
-// Compute Phong lighting
-//
-Vec3d computePhongLighting(
-    Vec3d const& view_direction,
-    Vec3d const& surface_normal,
-    Vec3d const& light_direction,
-    PhongCoefficients const& phong_coeff,
-    Vec3d const& light_color,
-    double light_intensity)
+
+const static double DEFAULT_FOV = 53.130102354155979;  // vertical field of view of the default camera, 2 atan(1/2)
+
+/**
+ * @brief Command line options of the ray tracer.
+ */
+struct Options
 {
-    Vec3d n = surface_normal; n.normalize();
-    Vec3d v = view_direction; v.normalize();
-    Vec3d l = light_direction; l.normalize();
-
-    Vec3d I_ambient = phong_coeff.k_a * light_intensity;
-    double diff = std::max(0.0, n.dot(l));
-    Vec3d I_diffuse = phong_coeff.k_d * diff * light_intensity;
-    Vec3d r = (-l).reflect(n);
-    double spec_angle = std::max(0.0, r.dot(v));
-    double spec = pow(spec_angle, phong_coeff.n);
-    Vec3d I_specular = light_color * phong_coeff.k_s * spec * light_intensity;
-
-    return I_ambient + I_diffuse + I_specular;
-}
+    Options() : width(WIDTH), height(HEIGHT), progressive(false), deadline(0.), output("./result.ppm"),
+        streaming(false), cgImage(false), spheres(0), buildBVH(true), wideBVH(true), lights(0), aimed(false), fov(0.) {}
+
+    int width;                      //< horizontal resolution
+    int height;                     //< vertical resolution
+    bool progressive;               //< use the progressive renderer instead of render()
+    double deadline;                //< time budget of the progressive renderer in seconds
+    AdaptiveSampling sampling;      //< anti-aliasing settings of render()
+    CheckpointSettings checkpoint;  //< checkpointing of render()
+    std::string output;             //< image written by render()
+    bool streaming;                 //< stream the output instead of keeping a framebuffer
+    bool cgImage;                   //< render into an image of the image library instead of a framebuffer
+    size_t spheres;                 //< render a point cloud of this many spheres instead of the default scene
+    std::string scene;              //< scene description to render instead of the default scene
+    std::string writeScene;         //< file to describe the scene and its lights in
+    std::string accel;              //< acceleration file to map the scene from
+    std::string writeAccel;         //< acceleration file to write the scene to
+    std::string accelCache;         //< directory caching the acceleration files of generated scenes
+    bool buildBVH;                  //< build a hierarchy over the spheres, otherwise test them one by one
+    bool wideBVH;                   //< trace through the 4-wide instead of the binary hierarchy
+    size_t lights;                  //< use this many random lights instead of the default ones
+    std::vector<std::pair<size_t, Pointlight>> lightChanges;    //< lights replaced by index
+    ShadingSettings shading;        //< settings of castRay()
+    std::string relight;            //< relight cache to shade again for changed lights
+    SequenceSettings sequence;      //< camera fly-through instead of a single frame
+    Vec3d cameraPos;                //< camera position
+    bool aimed;                     //< the camera looks at 'target' instead of along -z
+    Vec3d target;                   //< point the camera looks at
+    double fov;                     //< vertical field of view in degrees, 0 keeps the default view plane
+    CropSettings crop;              //< part of the frame traced by render()
+    std::string cameras;            //< camera list rendered in one run instead of a single camera
+};
 
 /**
- * @brief Method to check a ray for intersections with any object of the scene.
- * @param ray The ray to trace.
- * @param objects Vector of pointers to all scene objects.
- * @param t_near The intersection distance from the ray origin to the closest point hit.
- * @param hitObject The closest object hit.
- * @return true on hit, false otherwise
+ * @brief Print the command line usage.
+ * @param program Name of the executable.
  */
-bool trace(const Ray& ray,
-    const std::vector<std::shared_ptr<SceneObject>>& objects,
-    double& t_near, std::shared_ptr<SceneObject>& hitObject)
+void printUsage(const std::string& program)
 {
-    t_near = std::numeric_limits<double>::max();
+    std::cerr << "Usage: " << program << " [options]\n"
+        << "  --size <width> <height>  image resolution (default 600 600)\n"
+        << "  --progressive <seconds>  render progressively until the deadline is reached,\n"
+        << "                           writing progressive_<pass>.ppm after each pass\n"
+        << "  --aa <base> <max>        adaptive anti-aliasing with base and maximum samples per pixel\n"
+        << "  --aa-threshold <error>   stop refining a pixel once another sample lowers the\n"
+           "                           variance of its luminance by less than error^2 (default 0.001)\n"
+        << "  --checkpoint <file>      periodically save finished tiles to the file\n"
+        << "  --checkpoint-interval <seconds>\n"
+        << "                           time between two checkpoint writes (default 10)\n"
+        << "  --resume                 skip the tiles already saved in the checkpoint\n"
+        << "  --camera <x> <y> <z>     camera position (default 0 0 0)\n"
+        << "  --look-at <x> <y> <z>    point in the center of the image, the camera looks along -z otherwise\n"
+        << "  --fov <degrees>          vertical field of view, the aspect ratio follows the resolution\n"
+        << "                           (default: the fixed view plane of " << DEFAULT_FOV << " degrees)\n"
+        << "  --cameras <file>         render a frame per camera listed in the file, sharing the scene and\n"
+        << "                           one tile pool; frames are written to <output>_<camera>.<extension>\n"
+        << "  --crop <x> <y> <width> <height>\n"
+        << "                           trace only this pixel rectangle of the frame and write it as an image\n"
+        << "  --merge                  patch the crop rectangle into the existing output image of the\n"
+        << "                           whole frame (PPM or PFM) instead, rewriting only its rows\n"
+        << "  --output <file>          image written by the renderer (default ./result.ppm),\n"
+        << "                           .pfm and .raw store unclamped floats for the Tonemap tool\n"
+        << "  --stream                 write the PPM output in scanline order while rendering,\n"
+        << "                           without keeping the whole framebuffer in memory\n"
+        << "  --spheres <count>        render a random point cloud of spheres instead of the default scene\n"
+        << "  --scene <file>           render the scene and lights described in the file\n"
+        << "  --write-scene <file>     describe the scene and its lights in the file, e.g. for RenderClient\n"
+        << "  --write-accel <file>     save the scene and its hierarchy to an acceleration file\n"
+        << "  --accel <file>           map the scene from an acceleration file, geometry is paged\n"
+        << "                           in on demand, so it does not need to fit into memory\n"
+        << "  --accel-cache <dir>      reuse the hierarchy stored in the directory if the scene hash\n"
+        << "                           matches, otherwise build it and store it there\n"
+        << "  --bvh <binary|wide|none> hierarchy to trace through (default wide), none skips building\n"
+        << "                           one and tests every sphere, e.g. for small scenes changing per frame\n"
+        << "  --lights <count>         use random point lights instead of the default 16\n"
+        << "  --sort-hits              trace the primary rays of a tile first and shade their hits\n"
+        << "                           binned by material (fixed sample counts only)\n"
+        << "  --tile-culling           trace the primary rays of a tile only against the spheres inside\n"
+        << "                           the tile's frustum\n"
+        << "  --max-depth <count>      maximum number of reflections along a path, 0 shades primary\n"
+        << "                           hits only (default " << MAX_DEPTH << ")\n"
+        << "  --no-shadows             let every light reach every surface, casting no shadow rays\n"
+        << "  --generic-kernel         trace with the kernel checking the settings at every hit, instead\n"
+        << "                           of one compiled for them\n"
+        << "  --no-shadow-cache        always traverse the scene for shadow rays, instead of testing\n"
+        << "                           the last occluder of each light first\n"
+        << "  --cull-lights            skip the shadow rays of lights too weak to change the 8 bit\n"
+        << "                           output, judged by their unshadowed contribution\n"
+        << "  --light-samples <count>  shade each hit point with this many stochastically chosen lights,\n"
+        << "                           picked in proportion to their unshadowed contribution\n"
+        << "  --light-candidates <count>\n"
+        << "                           lights the samples are chosen from (default 32)\n"
+        << "  --shadow-map-res <texels>\n"
+        << "                           approximate shadows by depth cube maps of this resolution per\n"
+        << "                           face instead of shadow rays\n"
+        << "  --shadow-map-bias <texels>\n"
+        << "                           depth bias of the shadow map lookups (default 1)\n"
+        << "  --set-light <index> <x> <y> <z> <r> <g> <b> <intensity>\n"
+        << "                           replace a light by one with the given position, color and intensity\n"
+        << "  --relight <file>         keep the primary hits and reflection chains of a frame in the file;\n"
+        << "                           if it holds a frame of the same scene and size, only the lights that\n"
+        << "                           changed since are evaluated again, shadow rays only for moved ones\n"
+        << "                           (default camera and shading only)\n"
+        << "  --sequence <frames> <dx> <dy> <dz>\n"
+        << "                           render a camera fly-through, moving the camera by (dx, dy, dz)\n"
+        << "                           each frame; frames are written to <output>_<frame>.<extension>\n"
+        << "  --reproject-angle <degrees>\n"
+        << "                           reuse a pixel of the previous frame only while the direction its\n"
+        << "                           point is seen from changed less than this (default 1)\n"
+        << "  --no-reproject           trace every frame of a sequence from scratch\n";
+#ifdef HAVE_CG_IMAGE
+    std::cerr << "  --cg-image               render into a float image of the image library of exercise 7\n"
+        << "                           instead of a framebuffer (no crop, checkpoint or --sort-hits)\n";
+#endif
+}
 
-    // Check all objects if they got hit by the traced ray.
-    // If any object got hit, return the one closest to the camera as 'hitObject'.
-    for (auto& o : objects)
+/**
+ * @brief Parse the command line.
+ * @param argc Number of arguments.
+ * @param argv Arguments.
+ * @param options The parsed options.
+ * @return true on success, false if an argument was invalid.
+ */
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i)
     {
-        double t = std::numeric_limits<double>::max();
+        const std::string arg = argv[i];
 
-        if (o->intersect(ray, t) && t < t_near)
+        if (arg == "--size" && i + 2 < argc)
+        {
+            options.width = std::atoi(argv[++i]);
+            options.height = std::atoi(argv[++i]);
+        }
+        else if (arg == "--progressive" && i + 1 < argc)
+        {
+            options.progressive = true;
+            options.deadline = std::atof(argv[++i]);
+        }
+        else if (arg == "--aa" && i + 2 < argc)
+        {
+            options.sampling.baseSamples = std::atoi(argv[++i]);
+            options.sampling.maxSamples = std::atoi(argv[++i]);
+        }
+        else if (arg == "--aa-threshold" && i + 1 < argc)
+        {
+            options.sampling.threshold = std::atof(argv[++i]);
+        }
+        else if (arg == "--checkpoint" && i + 1 < argc)
+        {
+            options.checkpoint.path = argv[++i];
+        }
+        else if (arg == "--checkpoint-interval" && i + 1 < argc)
+        {
+            options.checkpoint.interval = std::atof(argv[++i]);
+        }
+        else if (arg == "--resume")
+        {
+            options.checkpoint.resume = true;
+        }
+        else if (arg == "--camera" && i + 3 < argc)
+        {
+            const double x = std::atof(argv[++i]);
+            const double y = std::atof(argv[++i]);
+            const double z = std::atof(argv[++i]);
+            options.cameraPos = Vec3d(x, y, z);
+        }
+        else if (arg == "--look-at" && i + 3 < argc)
+        {
+            const double x = std::atof(argv[++i]);
+            const double y = std::atof(argv[++i]);
+            const double z = std::atof(argv[++i]);
+            options.target = Vec3d(x, y, z);
+            options.aimed = true;
+        }
+        else if (arg == "--fov" && i + 1 < argc)
+        {
+            options.fov = std::atof(argv[++i]);
+            if (options.fov <= 0. || options.fov >= 180.)
+                return false;
+        }
+        else if (arg == "--cameras" && i + 1 < argc)
+        {
+            options.cameras = argv[++i];
+        }
+        else if (arg == "--crop" && i + 4 < argc)
+        {
+            const int x = std::atoi(argv[++i]);
+            const int y = std::atoi(argv[++i]);
+            const int width = std::atoi(argv[++i]);
+            const int height = std::atoi(argv[++i]);
+            options.crop.window = CropWindow(x, y, x + width, y + height);
+            if (x < 0 || y < 0 || options.crop.window.empty())
+                return false;
+        }
+        else if (arg == "--merge")
+        {
+            options.crop.merge = true;
+        }
+        else if (arg == "--output" && i + 1 < argc)
+        {
+            options.output = argv[++i];
+        }
+        else if (arg == "--stream")
+        {
+            options.streaming = true;
+        }
+#ifdef HAVE_CG_IMAGE
+        else if (arg == "--cg-image")
+        {
+            options.cgImage = true;
+        }
+#endif
+        else if (arg == "--spheres" && i + 1 < argc)
+        {
+            options.spheres = static_cast<size_t>(std::atol(argv[++i]));
+        }
+        else if (arg == "--scene" && i + 1 < argc)
+        {
+            options.scene = argv[++i];
+        }
+        else if (arg == "--write-scene" && i + 1 < argc)
         {
-            hitObject = o;
-            t_near = t;
+            options.writeScene = argv[++i];
+        }
+        else if (arg == "--write-accel" && i + 1 < argc)
+        {
+            options.writeAccel = argv[++i];
+        }
+        else if (arg == "--accel" && i + 1 < argc)
+        {
+            options.accel = argv[++i];
+        }
+        else if (arg == "--accel-cache" && i + 1 < argc)
+        {
+            options.accelCache = argv[++i];
+        }
+        else if (arg == "--bvh" && i + 1 < argc)
+        {
+            const std::string type = argv[++i];
+            if (type != "binary" && type != "wide" && type != "none")
+                return false;
+            options.buildBVH = (type != "none");
+            options.wideBVH = (type == "wide");
+        }
+        else if (arg == "--lights" && i + 1 < argc)
+        {
+            options.lights = static_cast<size_t>(std::atol(argv[++i]));
+        }
+        else if (arg == "--sort-hits")
+        {
+            options.shading.sortHits = true;
+        }
+        else if (arg == "--tile-culling")
+        {
+            options.shading.tileCulling = true;
+        }
+        else if (arg == "--max-depth" && i + 1 < argc)
+        {
+            options.shading.maxDepth = std::atoi(argv[++i]);
+            if (options.shading.maxDepth < 0)
+                return false;
+        }
+        else if (arg == "--no-shadows")
+        {
+            options.shading.shadows = false;
+        }
+        else if (arg == "--generic-kernel")
+        {
+            options.shading.specializedKernels = false;
+        }
+        else if (arg == "--no-shadow-cache")
+        {
+            options.shading.shadowCache = false;
+        }
+        else if (arg == "--cull-lights")
+        {
+            options.shading.lightCulling = true;
+        }
+        else if (arg == "--light-samples" && i + 1 < argc)
+        {
+            options.shading.lightSamples = std::atoi(argv[++i]);
+        }
+        else if (arg == "--light-candidates" && i + 1 < argc)
+        {
+            options.shading.lightCandidates = std::atoi(argv[++i]);
+        }
+        else if (arg == "--shadow-map-res" && i + 1 < argc)
+        {
+            options.shading.shadowMapResolution = std::atoi(argv[++i]);
+        }
+        else if (arg == "--shadow-map-bias" && i + 1 < argc)
+        {
+            options.shading.shadowMapBias = std::atof(argv[++i]);
+        }
+        else if (arg == "--set-light" && i + 8 < argc)
+        {
+            const size_t index = static_cast<size_t>(std::atol(argv[++i]));
+            double values[7];
+            for (int k = 0; k < 7; ++k)
+                values[k] = std::atof(argv[++i]);
+            options.lightChanges.push_back(std::make_pair(index, Pointlight(Vec3d(values[0], values[1], values[2]),
+                Vec3d(values[3], values[4], values[5]), values[6])));
+        }
+        else if (arg == "--relight" && i + 1 < argc)
+        {
+            options.relight = argv[++i];
+        }
+        else if (arg == "--sequence" && i + 4 < argc)
+        {
+            options.sequence.frames = std::atoi(argv[++i]);
+            const double dx = std::atof(argv[++i]);
+            const double dy = std::atof(argv[++i]);
+            const double dz = std::atof(argv[++i]);
+            options.sequence.step = Vec3d(dx, dy, dz);
+        }
+        else if (arg == "--reproject-angle" && i + 1 < argc)
+        {
+            options.sequence.maxAngle = std::atof(argv[++i]);
+        }
+        else if (arg == "--no-reproject")
+        {
+            options.sequence.reproject = false;
+        }
+        else
+        {
+            return false;
         }
     }
 
-    return (hitObject != nullptr);
-}
+    // only render() traces crop windows, and only into a framebuffer
+    const CropWindow& window = options.crop.window;
+    if (!window.empty() && (window.x1 > options.width || window.y1 > options.height || options.progressive ||
+        options.sequence.frames > 0 || !options.relight.empty() || options.streaming ||
+        !options.checkpoint.path.empty()))
+    {
+        return false;
+    }
+    if (options.crop.merge && window.empty())
+        return false;
 
-/**
- * @brief Cast a ray into the scene. If the ray hits at least one object,
- *        the color of the object closest to the camera is returned.
- * @param ray The ray that's being cast.
- * @param objects All scene objects.
- * @return The color of a hit object that is closest to the camera.
- *         Return dark blue if no object was hit.
- */
-Vec3d castRay(const Ray& ray, const std::vector<std::shared_ptr<SceneObject>>& objects,
-    const std::vector<Pointlight>& lights)
-{
-    // set the background color as dark blue
-    Vec3d hitColor(0, 0, 0.2);
+    // a camera list renders whole frames into framebuffers, with the cameras given by the list
+    if (!options.cameras.empty() && (options.progressive || options.sequence.frames > 0 ||
+        !options.relight.empty() || options.streaming || !options.checkpoint.path.empty() || !window.empty() ||
+        options.aimed || options.fov > 0. || options.cameraPos != Vec3d(0.)))
+    {
+        return false;
+    }
 
-    // early exit if maximum recursive depth is reached - return background color
-    if (ray.depth > MAX_DEPTH)
-        return hitColor;
+    // the image library's image replaces the framebuffer of a single frame rendered by renderTiles()
+    if (options.cgImage && (options.progressive || options.sequence.frames > 0 || !options.relight.empty() ||
+        options.streaming || !options.checkpoint.path.empty() || !window.empty() || !options.cameras.empty() ||
+        options.shading.sortHits))
+    {
+        return false;
+    }
 
-    // pointer to the object that was hit by the ray
-    std::shared_ptr<SceneObject> hitObject = nullptr;
+    // the relight cache is recorded for the default camera and follows complete shadowed paths,
+    // casting a shadow ray to every light
+    if (!options.relight.empty() && (options.aimed || options.fov > 0. || options.cameraPos != Vec3d(0.) ||
+        options.shading.maxDepth != MAX_DEPTH || !options.shading.shadows || options.shading.lightCulling ||
+        options.shading.lightSamples > 0 || options.shading.shadowMapResolution > 0))
+    {
+        return false;
+    }
 
-    // intersection distance from the ray origin to the point hit
-    double t = std::numeric_limits<double>::max();
+    // shadow maps only replace shadow rays
+    if (!options.shading.shadows && options.shading.shadowMapResolution > 0)
+        return false;
 
-    // Trace the ray. If an object gets hit, calculate the hit point and
-    // retrieve the surface color 'hitColor' from the 'hitObject' object that was hit
-    if (trace(ray, objects, t, hitObject))
-    {
-        hitColor = Vec3d();
+    // the staged renderer shades a fixed number of samples per pixel
+    if (options.shading.sortHits && options.sampling.maxSamples > options.sampling.baseSamples)
+        return false;
 
-        // Intersection point with the hit object
-        const Vec3d p_hit = ray.origin + ray.dir * t;
+    // tiles are culled by render() and the renderer of camera lists only
+    if (options.shading.tileCulling && (options.progressive || options.sequence.frames > 0 || !options.relight.empty()))
+        return false;
 
-        //////////
-        // TODO 3:
-        // Compute local lighting. The result is added to "hitColor".
-        //
-        // For each light source (given by funtion parameter lights)
-        //
-        //   a) Cast a shadow ray from the hitpoint to the light-source (use the trace function)
-        //
-        //   b) If not in shadow, compute local lighting using the function "computePhongLighting"
-        //      Else apply ambient term only
-        //
-        //      For a more realistic image, use inverse square attentuation for the light intensity.
-        //
-        
-        for (const auto& light : lights)
-        {
-            Vec3d lightDir = light._position - p_hit;
-            double distToLight = lightDir.length();
-            lightDir = lightDir; lightDir.normalize();
+    // a hierarchy can only be cached, stored or mapped once it is built
+    if (!options.buildBVH && (!options.accel.empty() || !options.writeAccel.empty() || !options.accelCache.empty()))
+        return false;
 
-            Ray shadowRay;
-            shadowRay.origin = p_hit + surface_normal * 1e-4;
-            shadowRay.dir = lightDir;
+    // resuming needs to know where the checkpoint is
+    if (options.checkpoint.resume && options.checkpoint.path.empty())
+        return false;
 
-            double t_shadow;
-            std::shared_ptr<SceneObject> shadowHit = nullptr;
+    // streaming writes quantized scanlines, which only the PPM format allows for
+    const size_t dot = options.output.find_last_of('.');
+    const std::string extension = (dot == std::string::npos) ? "" : options.output.substr(dot);
+    if (options.streaming && (extension == ".pfm" || extension == ".raw"))
+        return false;
 
-            bool inShadow = trace(shadowRay, objects, t_shadow, shadowHit)
-                            && t_shadow < distToLight;
+    // a mapped scene cannot be combined with generating one
+    if (!options.scene.empty() && options.spheres > 0)
+        return false;
+    if (!options.accel.empty() && (options.spheres > 0 || !options.scene.empty() || !options.writeAccel.empty() || !options.accelCache.empty()))
+        return false;
 
-            double intensity = light._intensity / (distToLight * distToLight);
+    return options.width > 0 && options.height > 0;
+}
 
-            if (!inShadow)
-            {
-                hitColor += computePhongLighting(
-                    (ray.origin - p_hit).normalize(),
-                    surface_normal,
-                    lightDir,
-                    phong,
-                    light._color,
-                    intensity
-                );
-            }
-            else
+/**
+ * @brief Print the paging and file I/O caused while rendering a frame.
+ * @param frame Name of the frame.
+ * @param io Difference of the counters before and after the frame.
+ */
+void printIOStats(const std::string& frame, const IOCounters& io)
+{
+    std::cout << frame << ": " << io.majorFaults << " major / " << io.minorFaults << " minor page faults, "
+        << io.readBytes / (1024. * 1024.) << " MB read" << std::endl;
+}
+
+/**
+ * @brief main routine.
+ *        Generates the scene and invokes the rendering.
+ * @return
+ */
+int main(int argc, char* argv[])
+{
+    const auto programStart = std::chrono::steady_clock::now();
+
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // Generate the scene objects, or map them from an acceleration file
+    Scene scene(0, 0);
+    std::vector<Pointlight> sceneLights;
+    if (!options.accel.empty())
+    {
+        uint64_t hash = 0;
+        if (!loadAccelFile(options.accel, scene, hash))
+        {
+            std::cerr << "Could not load the acceleration file " << options.accel << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        std::string text, error;
+        if (!options.scene.empty())
+        {
+            if (!readTextFile(options.scene, text) || !parseSceneText(text, scene, sceneLights, error))
             {
-                hitColor += std::get<0>(phong) * intensity; // ambient
+                std::cerr << "Could not load the scene " << options.scene << (error.empty() ? "" : ": " + error) << std::endl;
+                return 1;
             }
         }
+        else
+        {
+            scene = (options.spheres > 0) ? create_point_cloud(options.spheres, SEED) : create_scene_objects();
+        }
+        const uint64_t hash = scene.geometryHash();
 
-        // END TODO 3
-        /////////////
-
-        //////////
-        // TODO 4:
-        // Compute reflection.
-        //
-        // Build a reflection for the hitpoint of the hit object. 
-        // Use this ray to make a recursive call to "castRay" and add the result of the call to "hitColor".
-        //
-        
-        if (std::get<2>(phong).length() > 0.0) // k_s > 0
+        if (!options.accelCache.empty())
         {
-            Vec3d v = (ray.origin - p_hit).normalize();
-            Vec3d r = (-v).reflect(surface_normal).normalize();
+            const bool hit = loadOrBuildCachedAccel(options.accelCache, scene);
+            std::cout << "acceleration cache " << (hit ? "hit: " : "miss: ")
+                << accelCachePath(options.accelCache, hash) << std::endl;
+        }
+        else if (options.buildBVH)
+        {
+            scene.buildAccel();
+        }
 
-            Ray reflectionRay;
-            reflectionRay.origin = p_hit + surface_normal * 1e-4;
-            reflectionRay.dir = r;
-            reflectionRay.depth = ray.depth + 1;
+        if (!options.writeAccel.empty() && !writeAccelFile(scene, options.writeAccel, hash))
+            return 1;
+    }
 
-            hitColor += 0.5 * castRay(reflectionRay, objects, lights);
-        }
+    scene.useWideBVH(options.wideBVH);
 
+    const std::chrono::duration<double> setup = std::chrono::steady_clock::now() - programStart;
+    std::cout << "scene ready after " << setup.count() << " s" << std::endl;
 
-        // END TODO 4
-        /////////////
+    // Let there be light
+    auto lights = (options.lights > 0) ? create_random_lights(options.lights, SEED) :
+        (!options.scene.empty() ? sceneLights : create_scene_lights());
+    for (const auto& change : options.lightChanges)
+    {
+        if (change.first >= lights.size())
+        {
+            std::cerr << "There is no light " << change.first << ", the scene has " << lights.size() << "." << std::endl;
+            return 1;
+        }
+        lights[change.first] = change.second;
     }
 
-    return hitColor;
-}
+    if (!options.writeScene.empty())
+    {
+        std::ofstream file(options.writeScene.c_str());
+        writeSceneText(file, scene, lights);
+        if (!file)
+        {
+            std::cerr << "Could not write the scene to " << options.writeScene << std::endl;
+            return 1;
+        }
+    }
 
-/**
- * @brief The rendering method, loop over all pixels in the framebuffer, shooting
- *        a ray through each pixel with the origing being the camera position.
- * @param viewport Size of the framebuffer.
- * @param objects Vector of pointers to all objects contained in the scene.
- */
-void render(const Vec3i viewport, const std::vector<std::shared_ptr<SceneObject>>& objects,
-    const std::vector<Pointlight>& lights)
-{
-    std::vector<Vec3d> framebuffer(static_cast<size_t>(viewport[0]) * viewport[1]);
+    // Approximate the shadows by depth cube maps, rendered once per light
+    std::vector<ShadowCubeMap> shadowMaps;
+    if (options.shading.shadowMapResolution > 0)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        shadowMaps = buildShadowMaps(scene, lights, options.shading.shadowMapResolution);
+        options.shading.shadowMaps = &shadowMaps;
+
+        size_t bytes = 0;
+        for (const auto& map : shadowMaps)
+            bytes += map.bytes();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "shadow maps built in " << elapsed.count() << " s, "
+            << bytes / (1024. * 1024.) << " MB" << std::endl;
+    }
 
-    // camera position in world coordinates
-    const Vec3d cameraPos(0., 0., 0.);
+    std::cout << "trace kernel: " << (selectTraceKernels(options.shading).specialized ? "specialized" : "generic")
+        << ", depth " << options.shading.maxDepth << std::endl;
 
-    // view plane parameters
-    const double l = -1.;   // left
-    const double r = +1.;   // right
-    const double b = -1.;   // bottom
-    const double t = +1.;   // top
-    const double d = +2.;   // distance to camera
+    // Start rendering
+    const Vec3i viewport(options.width, options.height, 0);
+    Camera camera(options.cameraPos);
+    if (options.aimed || options.fov > 0.)
+    {
+        const Vec3d target = options.aimed ? options.target : options.cameraPos + Vec3d(0., 0., -1.);
+        camera = Camera::lookAt(options.cameraPos, target, (options.fov > 0.) ? options.fov : DEFAULT_FOV,
+            static_cast<double>(options.width) / options.height);
+    }
 
-    // Cast a ray from 'cameraPos' through the center(!) of each pixel on the viewplane.
-    // Use the view plane parametrization given above (l,r,b,t,d).
-    #pragma omp parallel for
-    for (int j = 0; j < viewport[1]; ++j)
+    IOCounters io = IOCounters::now();
+    if (!options.cameras.empty())
     {
-        for (int i = 0; i < viewport[0]; ++i)
+        std::string text, error;
+        std::vector<Camera> cameras;
+        if (!readTextFile(options.cameras, text) ||
+            !parseCameraText(text, static_cast<double>(options.width) / options.height, cameras, error))
         {
-            double u = l + (r - l) * (i + 0.5) / viewport[0];
-            double v = t + (b - t) * (j + 0.5) / viewport[1];
-
-            Ray ray;
-            ray.origin = cameraPos;
-            ray.dir = Vec3d(u, v, -d) - cameraPos;
-            ray.dir = ray.dir.normalize();
-            framebuffer.at(i + j * static_cast<size_t>(viewport[0])) = castRay(ray, objects, lights);
+            std::cerr << "Could not load the cameras " << options.cameras << (error.empty() ? "" : ": " + error) << std::endl;
+            return 1;
         }
-    }
 
-    // save the framebuffer an a PPM image
-    saveAsPPM("./result.ppm", viewport, framebuffer);
-}
+        std::vector<std::string> outputs;
+        for (size_t c = 0; c < cameras.size(); ++c)
+            outputs.push_back(frameFileName(options.output, static_cast<int>(c)));
 
-/**
- * @brief main routine.
- *        Generates the scene and invokes the rendering.
- * @return
- */
-int main()
-{
-    // Generate the scene objects
-    const auto objects = create_scene_objects();
+        const auto start = std::chrono::steady_clock::now();
+        renderCameras(viewport, scene, lights, cameras, options.sampling, options.shading, outputs);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << cameras.size() << " frames rendered in " << elapsed.count() << " s" << std::endl;
+        printIOStats("frames", IOCounters::now() - io);
+    }
+#ifdef HAVE_CG_IMAGE
+    else if (options.cgImage)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        RGBImage image(static_cast<unsigned int>(options.width), static_cast<unsigned int>(options.height));
+        renderImage(scene, lights, camera, options.sampling, options.shading, image);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "frame rendered in " << elapsed.count() << " s" << std::endl;
+        printIOStats("frame", IOCounters::now() - io);
+
+        if (!saveImage(options.output, image))
+            return 1;
+    }
+#endif
+    else if (options.progressive)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        renderProgressive(viewport, scene, lights, camera, options.deadline, options.shading,
+            [&](int pass, const std::vector<Vec3d>& framebuffer)
+            {
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                std::cout << "pass " << pass << " finished after " << elapsed.count() << " s" << std::endl;
+                const IOCounters now = IOCounters::now();
+                printIOStats("pass " + std::to_string(pass), now - io);
+                io = now;
+                saveAsPPM("./progressive_" + std::to_string(pass) + ".ppm", viewport, framebuffer);
+            });
+    }
+    else if (options.sequence.frames > 0)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        renderSequence(viewport, scene, lights, camera, options.sequence, options.shading, options.output);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << options.sequence.frames << " frames rendered in " << elapsed.count() << " s" << std::endl;
+    }
+    else if (!options.relight.empty())
+    {
+        const auto start = std::chrono::steady_clock::now();
+        RelightCache cache;
+        if (loadRelightCache(options.relight, cache) && cache.viewport[0] == viewport[0] &&
+            cache.viewport[1] == viewport[1] && cache.lights.size() == lights.size() &&
+            cache.sceneHash == scene.geometryHash())
+        {
+            const size_t changed = relight(cache, scene, lights, options.shading);
+            std::cout << "relit " << changed << " of " << lights.size() << " lights" << std::endl;
+        }
+        else
+        {
+            renderRelightable(viewport, scene, lights, options.shading, cache);
+            std::cout << "recorded " << cache.vertices.size() << " path vertices" << std::endl;
+        }
 
-    // Let there be light
-    const auto lights = create_scene_lights();
+        std::vector<Vec3d> framebuffer;
+        cache.resolve(framebuffer);
+        saveImage(options.output, viewport, framebuffer);
 
-    // Start rendering
-    const Vec3i viewport(WIDTH, HEIGHT, 0);
-    render(viewport, objects, lights);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "frame rendered in " << elapsed.count() << " s" << std::endl;
+
+        if (!saveRelightCache(options.relight, cache))
+            std::cerr << "Could not write the relight cache " << options.relight << std::endl;
+    }
+    else
+    {
+        const auto start = std::chrono::steady_clock::now();
+        render(viewport, scene, lights, camera, options.crop, options.sampling, options.checkpoint,
+            options.output, options.streaming, options.shading);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "frame rendered in " << elapsed.count() << " s" << std::endl;
+        printIOStats("frame", IOCounters::now() - io);
+    }
 
     return 0;
 }
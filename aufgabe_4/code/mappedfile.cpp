@@ -0,0 +1,102 @@
+#include "mappedfile.h"
+
+#include <fstream>
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief MappedFile::MappedFile
+ */
+MappedFile::MappedFile(const std::string& path) :
+    _data(nullptr), _size(0)
+{
+#ifdef HAVE_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            _data = static_cast<unsigned char*>(data);
+            _size = static_cast<size_t>(info.st_size);
+        }
+    }
+    close(fd);
+#else
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return;
+
+    _copy.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    if (!_copy.empty() && file.read(reinterpret_cast<char*>(_copy.data()), static_cast<std::streamsize>(_copy.size())))
+    {
+        _data = _copy.data();
+        _size = _copy.size();
+    }
+#endif
+}
+
+/**
+ * @brief MappedFile::~MappedFile
+ */
+MappedFile::~MappedFile()
+{
+#ifdef HAVE_MMAP
+    if (_data)
+        munmap(_data, _size);
+#endif
+}
+
+/**
+ * @brief IOCounters::now
+ */
+IOCounters IOCounters::now()
+{
+    IOCounters counters;
+
+#ifdef HAVE_MMAP
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        counters.majorFaults = usage.ru_majflt;
+        counters.minorFaults = usage.ru_minflt;
+    }
+#endif
+
+    // Linux only: bytes actually fetched from the storage layer
+    std::ifstream io("/proc/self/io");
+    std::string key;
+    uint64_t value = 0;
+    while (io >> key >> value)
+    {
+        if (key == "read_bytes:")
+            counters.readBytes = value;
+    }
+
+    return counters;
+}
+
+/**
+ * @brief IOCounters::operator-
+ */
+IOCounters IOCounters::operator-(const IOCounters& rhs) const
+{
+    IOCounters difference;
+    difference.majorFaults = majorFaults - rhs.majorFaults;
+    difference.minorFaults = minorFaults - rhs.minorFaults;
+    difference.readBytes = readBytes - rhs.readBytes;
+    return difference;
+}
@@ -0,0 +1,75 @@
+#ifndef mappedfile_h
+#define mappedfile_h
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The MappedFile class.
+ *        Maps a whole file into memory, so its pages are loaded on demand by the OS.
+ *        Pages are mapped copy-on-write; the file itself is never modified.
+ *        On platforms without mmap the file is read into memory instead.
+ */
+class MappedFile
+{
+public:
+    /**
+     * @brief Map a file.
+     * @param path The file to map.
+     */
+    explicit MappedFile(const std::string& path);
+
+    /**
+     * @brief Unmap the file.
+     */
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Check whether the file has been mapped successfully.
+     */
+    bool isOpen() const { return _data != nullptr; }
+
+    /**
+     * @brief Get the mapped bytes.
+     */
+    unsigned char* data() const { return _data; }
+
+    /**
+     * @brief Get the size of the file in bytes.
+     */
+    size_t size() const { return _size; }
+
+private:
+    unsigned char* _data;               //< first byte of the mapping
+    size_t _size;                       //< size of the mapping
+    std::vector<unsigned char> _copy;   //< file content if mmap is not available
+};
+
+/**
+ * @brief Counters of the paging and file I/O caused by this process.
+ */
+struct IOCounters
+{
+    IOCounters() : majorFaults(0), minorFaults(0), readBytes(0) {}
+
+    long majorFaults;   //< page faults that needed I/O
+    long minorFaults;   //< page faults served without I/O
+    uint64_t readBytes; //< bytes fetched from the storage layer, 0 if unknown
+
+    /**
+     * @brief Read the current counters of this process.
+     */
+    static IOCounters now();
+
+    /**
+     * @brief Difference of two snapshots.
+     */
+    IOCounters operator-(const IOCounters& rhs) const;
+};
+
+#endif // !mappedfile_h
@@ -0,0 +1,75 @@
+#include "material.h"
+
+#include <tuple>
+
+#include "texture.h"
+#include "vec3.h"
+
+/**
+ * @brief Material::Material
+ */
+Material::Material() :
+    Material(Vec3d(1.0, 1.0, 1.0))
+{
+}
+
+/**
+ * @brief Material::Material
+ * @param color Base color, used for the ambient and diffuse coefficients.
+ */
+Material::Material(const Vec3d& color) :
+    _color(color), _secondaryColor(color), _specular(1.), _shininess(42.), _frequency(0.),
+    _pattern(SurfacePattern::Solid)
+{
+}
+
+/**
+ * @brief Material::checker
+ */
+Material Material::checker(const Vec3d& color, const Vec3d& secondaryColor, double frequency)
+{
+    return patterned(SurfacePattern::Checker, color, secondaryColor, frequency);
+}
+
+/**
+ * @brief Material::patterned
+ */
+Material Material::patterned(SurfacePattern pattern, const Vec3d& color, const Vec3d& secondaryColor,
+    double frequency)
+{
+    Material material(color);
+    material._secondaryColor = secondaryColor;
+    material._frequency = frequency;
+    material._pattern = pattern;
+    return material;
+}
+
+/**
+ * @brief Material::getSurfaceColor
+ */
+Vec3d Material::getSurfaceColor(const Vec3d& p_hit) const
+{
+    switch (this->_pattern)
+    {
+    case SurfacePattern::Checker:
+        return checkerPattern(p_hit, this->_frequency) ? this->_color : this->_secondaryColor;
+    case SurfacePattern::Stripes:
+        return stripePattern(p_hit, this->_frequency) ? this->_color : this->_secondaryColor;
+    case SurfacePattern::Noise:
+    {
+        const double t = valueNoise(p_hit * this->_frequency);
+        return this->_color * (1. - t) + this->_secondaryColor * t;
+    }
+    default:
+        return this->_color;
+    }
+}
+
+/**
+ * @brief Material::getPhongCoefficients
+ */
+PhongCoefficients Material::getPhongCoefficients(const Vec3d& p_hit) const
+{
+    const Vec3d color = getSurfaceColor(p_hit);
+    return PhongCoefficients(color, color, this->_specular, this->_shininess);
+}
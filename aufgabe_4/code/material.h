@@ -0,0 +1,82 @@
+#ifndef material_h
+#define material_h
+
+#include <tuple>
+
+#include "vec3.h"
+
+// Store phong coefficient k_a, k_d, k_s and n in a tuple
+typedef std::tuple<Vec3d, Vec3d, Vec3d, double> PhongCoefficients;
+
+/**
+ * @brief Surface pattern modulating the color of a material.
+ */
+enum class SurfacePattern
+{
+    Solid,      //< uniform base color
+    Checker,    //< chess board pattern in the xz-plane alternating base and secondary color
+    Stripes,    //< stripes orthogonal to the x-axis alternating base and secondary color
+    Noise       //< value noise blending between base and secondary color
+};
+
+/**
+ * @brief The Material class.
+ *        Materials are kept in a separate table of the scene and referenced by index from the
+ *        primitive records, so the data touched during intersection stays small.
+ */
+class Material
+{
+public:
+    /**
+     * @brief Construct a white material.
+     */
+    Material();
+
+    /**
+     * @brief Construct a solid material with user-defined color.
+     * @param color Base color, used for the ambient and diffuse coefficients.
+     */
+    Material(const Vec3d& color);
+
+    /**
+     * @brief Construct a chess board material.
+     * @param color Color of the 'white' fields.
+     * @param secondaryColor Color of the 'black' fields.
+     * @param frequency Number of field pairs per unit length.
+     */
+    static Material checker(const Vec3d& color, const Vec3d& secondaryColor, double frequency);
+
+    /**
+     * @brief Construct a material with a procedural pattern, see texture.h.
+     * @param pattern The pattern.
+     * @param color Base color of the pattern.
+     * @param secondaryColor Second color of the pattern.
+     * @param frequency Number of pattern periods per unit length.
+     */
+    static Material patterned(SurfacePattern pattern, const Vec3d& color, const Vec3d& secondaryColor,
+        double frequency);
+
+    /**
+     * @brief Get the surface color of the material.
+     * @param p_hit The point on the surface that was hit.
+     * @return The surface color at p_hit.
+     */
+    Vec3d getSurfaceColor(const Vec3d& p_hit) const;
+
+    /**
+     * @brief Get the phong coefficients of the material. The pattern is evaluated once and
+     *        its color used for both the ambient and the diffuse coefficient.
+     * @param p_hit The point on the surface that was hit.
+     * @return The phong coefficients at p_hit.
+     */
+    PhongCoefficients getPhongCoefficients(const Vec3d& p_hit) const;
+
+    Vec3d _color;               //< base color (k_a, k_d)
+    Vec3d _secondaryColor;      //< second pattern color
+    Vec3d _specular;            //< specular coefficient k_s
+    double _shininess;          //< specular exponent n
+    double _frequency;          //< pattern frequency
+    SurfacePattern _pattern;    //< pattern applied to the base color
+};
+
+#endif // !material_h
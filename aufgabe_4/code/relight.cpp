@@ -0,0 +1,357 @@
+#include "relight.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <tuple>
+
+#include "camera.h"
+
+static const char RELIGHT_MAGIC[8] = { 'R', 'T', 'R', 'L', 'I', 'T', '0', '1' };
+
+/**
+ * @brief Fixed size header at the start of every relight cache file.
+ */
+struct RelightHeader
+{
+    char magic[8];          //< file identification
+    uint32_t width;         //< horizontal resolution
+    uint32_t height;        //< vertical resolution
+    uint64_t sceneHash;     //< hash of the scene geometry
+    uint64_t lightCount;    //< number of LightEntry records following the header
+    uint64_t vertexCount;   //< number of vertices, stored after the per pixel data
+};
+
+/**
+ * @brief Light as stored in the file.
+ */
+struct LightEntry
+{
+    double position[3];
+    double color[3];
+    double intensity;
+};
+
+/**
+ * @brief RelightCache::resolve
+ */
+void RelightCache::resolve(std::vector<Vec3d>& framebuffer) const
+{
+    framebuffer.assign(pathLength.size(), Vec3d());
+
+    size_t vertex = 0;
+    for (size_t i = 0; i < pathLength.size(); ++i)
+    {
+        Vec3d color(escape[i][0], escape[i][1], escape[i][2]);
+        for (uint8_t k = 0; k < pathLength[i]; ++k, ++vertex)
+        {
+            const RelightVertex& v = vertices[vertex];
+            color += Vec3d(v.throughput[0] * v.lighting[0], v.throughput[1] * v.lighting[1],
+                v.throughput[2] * v.lighting[2]);
+        }
+        framebuffer[i] = color;
+    }
+}
+
+/**
+ * @brief Write a vector as a block of raw bytes.
+ */
+template<typename T>
+static void writeBlock(std::ofstream& file, const std::vector<T>& data)
+{
+    file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(T)));
+}
+
+/**
+ * @brief Read a block of raw bytes into a vector of a given size.
+ */
+template<typename T>
+static bool readBlock(std::ifstream& file, std::vector<T>& data, size_t count)
+{
+    data.resize(count);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(count * sizeof(T))));
+}
+
+/**
+ * @brief saveRelightCache
+ */
+bool saveRelightCache(const std::string& path, const RelightCache& cache)
+{
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return false;
+
+    RelightHeader header;
+    std::memcpy(header.magic, RELIGHT_MAGIC, sizeof(header.magic));
+    header.width = static_cast<uint32_t>(cache.viewport[0]);
+    header.height = static_cast<uint32_t>(cache.viewport[1]);
+    header.sceneHash = cache.sceneHash;
+    header.lightCount = cache.lights.size();
+    header.vertexCount = cache.vertices.size();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<LightEntry> lights(cache.lights.size());
+    for (size_t l = 0; l < lights.size(); ++l)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            lights[l].position[a] = cache.lights[l].getPosition()[a];
+            lights[l].color[a] = cache.lights[l].getColor()[a];
+        }
+        lights[l].intensity = cache.lights[l].getIntensity();
+    }
+
+    writeBlock(file, lights);
+    writeBlock(file, cache.pathLength);
+    writeBlock(file, cache.escape);
+    writeBlock(file, cache.vertices);
+    writeBlock(file, cache.visibility);
+    return static_cast<bool>(file);
+}
+
+/**
+ * @brief loadRelightCache
+ */
+bool loadRelightCache(const std::string& path, RelightCache& cache)
+{
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    RelightHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, RELIGHT_MAGIC, sizeof(header.magic)) != 0)
+    {
+        return false;
+    }
+
+    cache.viewport = Vec3i(static_cast<int>(header.width), static_cast<int>(header.height), 0);
+    cache.sceneHash = header.sceneHash;
+
+    std::vector<LightEntry> lights;
+    if (!readBlock(file, lights, header.lightCount))
+        return false;
+
+    cache.lights.clear();
+    for (const auto& light : lights)
+    {
+        cache.lights.push_back(Pointlight(Vec3d(light.position[0], light.position[1], light.position[2]),
+            Vec3d(light.color[0], light.color[1], light.color[2]), light.intensity));
+    }
+
+    const size_t pixelCount = static_cast<size_t>(header.width) * header.height;
+    return readBlock(file, cache.pathLength, pixelCount) &&
+        readBlock(file, cache.escape, pixelCount) &&
+        readBlock(file, cache.vertices, header.vertexCount) &&
+        readBlock(file, cache.visibility, header.vertexCount * cache.visibilityWords());
+}
+
+/**
+ * @brief Shade a relight vertex with a single light.
+ * @param vertex The vertex.
+ * @param light The light.
+ * @param visible Whether the light is visible from the vertex.
+ * @return The contribution of the light, the ambient term only if the light is hidden.
+ */
+static Vec3d shadeVertex(const RelightVertex& vertex, const Pointlight& light, bool visible)
+{
+    const Vec3d position(vertex.position[0], vertex.position[1], vertex.position[2]);
+    Vec3d lightDir = light.getPosition() - position;
+    const double distToLight = lightDir.length();
+    lightDir.normalize();
+    const double intensity = light.getIntensity() / (distToLight * distToLight);
+
+    const PhongCoefficients phong(
+        Vec3d(vertex.ambient[0], vertex.ambient[1], vertex.ambient[2]),
+        Vec3d(vertex.diffuse[0], vertex.diffuse[1], vertex.diffuse[2]),
+        Vec3d(vertex.specular[0], vertex.specular[1], vertex.specular[2]),
+        vertex.shininess);
+    if (!visible)
+        return std::get<0>(phong) * intensity;
+
+    return computePhongLighting(Vec3d(vertex.view[0], vertex.view[1], vertex.view[2]),
+        Vec3d(vertex.normal[0], vertex.normal[1], vertex.normal[2]), lightDir, phong, light.getColor(), intensity);
+}
+
+/**
+ * @brief Sum up the contributions of all lights at a relight vertex.
+ * @param vertex The vertex.
+ * @param lights All light sources.
+ * @param visibility The visibility bits of the vertex, one per light.
+ * @return The lighting of the vertex.
+ */
+static Vec3d sumLighting(const RelightVertex& vertex, const std::vector<Pointlight>& lights, const uint64_t* visibility)
+{
+    Vec3d lighting;
+    for (size_t l = 0; l < lights.size(); ++l)
+        lighting += shadeVertex(vertex, lights[l], (visibility[l / 64] >> (l % 64)) & 1);
+    return lighting;
+}
+
+/**
+ * @brief Check whether a light is hidden from a relight vertex by casting a shadow ray.
+ */
+static bool vertexOccluded(const RelightVertex& vertex, const Scene& scene, size_t light, const Pointlight& pointlight,
+    TraceContext& context)
+{
+    const Vec3d position(vertex.position[0], vertex.position[1], vertex.position[2]);
+    const Vec3d normal(vertex.normal[0], vertex.normal[1], vertex.normal[2]);
+    Vec3d lightDir = pointlight.getPosition() - position;
+    const double distToLight = lightDir.length();
+    lightDir.normalize();
+
+    Ray shadowRay;
+    shadowRay.origin = position + normal * 1e-4;
+    shadowRay.dir = lightDir;
+    return context.shadows.occluded(scene, light, shadowRay, distToLight);
+}
+
+/**
+ * @brief Convert a color or direction to single precision for the relight cache.
+ */
+static Vec3f toFloat(const Vec3d& v)
+{
+    return Vec3f(static_cast<float>(v[0]), static_cast<float>(v[1]), static_cast<float>(v[2]));
+}
+
+/**
+ * @brief renderRelightable
+ */
+void renderRelightable(const Vec3i viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const ShadingSettings& shading, RelightCache& cache)
+{
+    const int width = viewport[0];
+    const int height = viewport[1];
+
+    cache.viewport = viewport;
+    cache.sceneHash = scene.geometryHash();
+    cache.lights = lights;
+    cache.pathLength.assign(static_cast<size_t>(width) * height, 0);
+    cache.escape.assign(cache.pathLength.size(), Vec3f());
+
+    const size_t words = cache.visibilityWords();
+    std::vector<std::vector<RelightVertex>> rowVertices(height);
+    std::vector<std::vector<uint64_t>> rowVisibility(height);
+
+    #pragma omp parallel
+    {
+        TraceContext context(lights.size(), shading);
+
+        #pragma omp for schedule(dynamic)
+        for (int j = 0; j < height; ++j)
+        {
+            for (int i = 0; i < width; ++i)
+            {
+                const size_t index = i + j * static_cast<size_t>(width);
+                Ray ray = Camera().primaryRay(viewport, i + 0.5, j + 0.5);
+                Vec3d throughput(1.);
+
+                // follow the reflection chain of castRay() iteratively
+                while (true)
+                {
+                    Hit hit;
+                    if (ray.depth > MAX_DEPTH || !scene.intersect(ray, hit))
+                    {
+                        cache.escape[index] = toFloat(throughput * BACKGROUND_COLOR);
+                        break;
+                    }
+
+                    const Vec3d p_hit = ray.origin + ray.dir * hit.t;
+                    const Vec3d surface_normal = scene.getSurfaceNormal(hit, p_hit);
+                    const PhongCoefficients phong = scene.getMaterial(hit).getPhongCoefficients(p_hit);
+                    const Vec3d& k_s = std::get<2>(phong);
+
+                    RelightVertex vertex;
+                    vertex.position = toFloat(p_hit);
+                    vertex.normal = toFloat(surface_normal);
+                    vertex.view = toFloat((ray.origin - p_hit).normalize());
+                    vertex.ambient = toFloat(std::get<0>(phong));
+                    vertex.diffuse = toFloat(std::get<1>(phong));
+                    vertex.specular = toFloat(k_s);
+                    vertex.shininess = static_cast<float>(std::get<3>(phong));
+                    vertex.throughput = toFloat(throughput);
+
+                    std::vector<uint64_t>& visibility = rowVisibility[j];
+                    const size_t first = visibility.size();
+                    visibility.resize(first + words, 0);
+
+                    for (size_t l = 0; l < lights.size(); ++l)
+                    {
+                        if (!vertexOccluded(vertex, scene, l, lights[l], context))
+                            visibility[first + l / 64] |= uint64_t(1) << (l % 64);
+                    }
+                    vertex.lighting = toFloat(sumLighting(vertex, lights, &visibility[first]));
+
+                    rowVertices[j].push_back(vertex);
+                    ++cache.pathLength[index];
+
+                    if (k_s.length() <= 0.0)
+                        break;
+
+                    Ray reflectionRay;
+                    reflectionRay.origin = p_hit + surface_normal * 1e-4;
+                    reflectionRay.dir = (-(ray.origin - p_hit).normalize()).reflect(surface_normal).normalize();
+                    reflectionRay.depth = ray.depth + 1;
+                    throughput = throughput * k_s;
+                    ray = reflectionRay;
+                }
+            }
+        }
+    }
+
+    cache.vertices.clear();
+    cache.visibility.clear();
+    for (int j = 0; j < height; ++j)
+    {
+        cache.vertices.insert(cache.vertices.end(), rowVertices[j].begin(), rowVertices[j].end());
+        cache.visibility.insert(cache.visibility.end(), rowVisibility[j].begin(), rowVisibility[j].end());
+        std::vector<RelightVertex>().swap(rowVertices[j]);
+        std::vector<uint64_t>().swap(rowVisibility[j]);
+    }
+}
+
+/**
+ * @brief relight
+ */
+size_t relight(RelightCache& cache, const Scene& scene, const std::vector<Pointlight>& lights,
+    const ShadingSettings& shading)
+{
+    std::vector<size_t> changed;
+    std::vector<char> moved(lights.size(), 0);
+    for (size_t l = 0; l < lights.size(); ++l)
+    {
+        const Pointlight& before = cache.lights[l];
+        const Pointlight& after = lights[l];
+        moved[l] = before.getPosition() != after.getPosition();
+        if (moved[l] || before.getColor() != after.getColor() || before.getIntensity() != after.getIntensity())
+            changed.push_back(l);
+    }
+
+    if (!changed.empty())
+    {
+        const long long vertexCount = static_cast<long long>(cache.vertices.size());
+
+        #pragma omp parallel
+        {
+            TraceContext context(lights.size(), shading);
+
+            #pragma omp for schedule(static)
+            for (long long v = 0; v < vertexCount; ++v)
+            {
+                RelightVertex& vertex = cache.vertices[v];
+                for (size_t l : changed)
+                {
+                    if (moved[l])
+                        cache.setVisible(v, l, !vertexOccluded(vertex, scene, l, lights[l], context));
+                }
+
+                // sum up all lights again like renderRelightable() does, instead of patching the
+                // stored sum, which would accumulate rounding errors over successive changes
+                vertex.lighting = toFloat(sumLighting(vertex, lights, &cache.visibility[v * cache.visibilityWords()]));
+            }
+        }
+    }
+
+    cache.lights = lights;
+    return changed.size();
+}
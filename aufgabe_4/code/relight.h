@@ -0,0 +1,123 @@
+#ifndef relight_h
+#define relight_h
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "pointlight.h"
+#include "sceneobject.h"
+#include "tracer.h"
+#include "vec3.h"
+
+/**
+ * @brief A hit point along the path of a pixel's primary ray, with everything the light loop
+ *        needs to shade it again.
+ */
+struct RelightVertex
+{
+    Vec3f position;     //< point on the surface that was hit
+    Vec3f normal;       //< surface normal at the hit point
+    Vec3f view;         //< direction from the hit point towards the ray origin
+    Vec3f ambient;      //< phong coefficients of the material at the hit point
+    Vec3f diffuse;
+    Vec3f specular;
+    float shininess;
+    Vec3f throughput;   //< product of the reflection coefficients of all earlier vertices
+    Vec3f lighting;     //< sum of the contributions of all lights, as recorded
+};
+
+/**
+ * @brief The RelightCache class.
+ *        Primary visibility of a frame and its reflection chains, stored per pixel, together with
+ *        the lights the frame was shaded with and whether each light was visible from each vertex.
+ *        As long as camera and geometry stay the same, a frame for changed lights follows by
+ *        re-evaluating only the changed lights at the stored vertices.
+ */
+struct RelightCache
+{
+    RelightCache() : sceneHash(0) {}
+
+    Vec3i viewport;                         //< size of the framebuffer
+    uint64_t sceneHash;                     //< hash of the scene geometry
+    std::vector<Pointlight> lights;         //< lights the vertices are shaded with
+    std::vector<uint8_t> pathLength;        //< number of vertices per pixel, row-major
+    std::vector<Vec3f> escape;              //< background reached by the end of each pixel's path
+    std::vector<RelightVertex> vertices;    //< vertices of all pixels, pixel after pixel
+    std::vector<uint64_t> visibility;       //< one bit per light and vertex, set if the light is visible
+
+    /**
+     * @brief Number of 64 bit words of visibility bits per vertex.
+     */
+    size_t visibilityWords() const { return (lights.size() + 63) / 64; }
+
+    /**
+     * @brief Check whether a light was visible from a vertex.
+     */
+    bool visible(size_t vertex, size_t light) const
+    {
+        return (visibility[vertex * visibilityWords() + light / 64] >> (light % 64)) & 1;
+    }
+
+    /**
+     * @brief Set whether a light is visible from a vertex.
+     */
+    void setVisible(size_t vertex, size_t light, bool visible)
+    {
+        uint64_t& word = visibility[vertex * visibilityWords() + light / 64];
+        const uint64_t bit = uint64_t(1) << (light % 64);
+        word = visible ? (word | bit) : (word & ~bit);
+    }
+
+    /**
+     * @brief Sum up the vertices of every pixel into a framebuffer.
+     * @param framebuffer The color of every pixel, resized to the viewport.
+     */
+    void resolve(std::vector<Vec3d>& framebuffer) const;
+};
+
+/**
+ * @brief Save a relight cache.
+ * @param path The file to write.
+ * @param cache The cache.
+ * @return true on success, false if the file could not be written.
+ */
+bool saveRelightCache(const std::string& path, const RelightCache& cache);
+
+/**
+ * @brief Load a relight cache.
+ * @param path The file to read.
+ * @param cache The loaded cache.
+ * @return true on success, false if the file is missing or invalid.
+ */
+bool loadRelightCache(const std::string& path, RelightCache& cache);
+
+/**
+ * @brief Render a frame of the default camera like castRay() does for one ray through each pixel center with all lights,
+ *        keeping the vertices of every pixel's path and the visibility of every light from them.
+ * @param viewport Size of the framebuffer.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param shading Settings of the shading, only the occluder cache is used.
+ * @param cache The recorded frame.
+ */
+void renderRelightable(const Vec3i viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const ShadingSettings& shading, RelightCache& cache);
+
+/**
+ * @brief Shade a recorded frame again for changed lights.
+ *        Shadow rays are cast only for lights that moved; for lights that only changed color or
+ *        intensity the recorded visibility still holds. The lighting of every vertex is then
+ *        summed up again over all lights from the visibility bits, so the result does not depend
+ *        on the changes made before and equals a frame recorded with the new lights.
+ * @param cache The recorded frame, updated to the new lights.
+ * @param scene The scene containing all objects, unchanged since the frame was recorded.
+ * @param lights All light sources, as many as recorded.
+ * @param shading Settings of the shading, only the occluder cache is used.
+ * @return The number of lights that changed.
+ */
+size_t relight(RelightCache& cache, const Scene& scene, const std::vector<Pointlight>& lights,
+    const ShadingSettings& shading);
+
+#endif // !relight_h
@@ -0,0 +1,958 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <tuple>
+#include <utility>
+
+#include "streamwriter.h"
+#include "tiles.h"
+#include "util.h"
+
+/**
+ * @brief A pixel of the previous frame of a sequence, kept for reprojection.
+ */
+struct ReprojectedPixel
+{
+    ReprojectedPixel() : valid(false), depth(0.) {}
+
+    bool valid;         //< the pixel saw a surface
+    Hit hit;            //< the primitive seen through the pixel center
+    Vec3d point;        //< the point seen through the pixel center, where it was shaded
+    Vec3d normal;       //< surface normal at the point
+    Vec3d view;         //< direction from the point towards the camera the point was shaded for
+    Vec3d local;        //< local lighting of the point, without its reflection
+    Vec3d specular;     //< reflection coefficients at the point
+    double depth;       //< distance to the current camera while reprojecting
+};
+
+/**
+ * @brief Trace the reflection of a primary hit point, as castRay() does.
+ * @param point The point on the surface that was hit.
+ * @param normal The normal at the hit point.
+ * @param view Direction from the hit point towards the camera.
+ * @param k_s Reflection coefficients at the hit point.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param context State of the calling thread.
+ * @return The reflected color, weighted by the reflection coefficients.
+ */
+static Vec3d primaryReflection(const Vec3d& point, const Vec3d& normal, const Vec3d& view, const Vec3d& k_s,
+    const Scene& scene, const std::vector<Pointlight>& lights, TraceContext& context)
+{
+    if (k_s.length() <= 0.0)
+        return Vec3d();
+
+    Ray reflectionRay;
+    reflectionRay.origin = point + normal * 1e-4;
+    reflectionRay.dir = (-view).reflect(normal).normalize();
+    reflectionRay.depth = 1;
+    return k_s * castRay(reflectionRay, scene, lights, context, std::max(k_s[0], std::max(k_s[1], k_s[2])));
+}
+
+/**
+ * @brief Sample a pixel adaptively, as configured by the AdaptiveSampling settings.
+ * @param viewport Size of the framebuffer.
+ * @param i Column of the pixel.
+ * @param j Row of the pixel.
+ * @param camera The camera.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param sampling Settings of the anti-aliasing.
+ * @param context State of the calling thread.
+ * @param candidates The only spheres the primary rays may hit, nullptr to trace the scene.
+ * @param sum Sum of the colors of all samples.
+ * @return The number of samples taken.
+ */
+static int samplePixel(const Vec3i& viewport, int i, int j, const Camera& camera, const Scene& scene,
+    const std::vector<Pointlight>& lights, const AdaptiveSampling& sampling, TraceContext& context,
+    const std::vector<uint32_t>* candidates, Vec3d& sum)
+{
+    const int baseSamples = std::max(1, sampling.baseSamples);
+    const int maxSamples = std::max(baseSamples, sampling.maxSamples);
+
+    double mean = 0.;   // running mean of the luminance
+    double m2 = 0.;     // running sum of squared differences from the mean
+    int n = 0;
+
+    while (n < maxSamples)
+    {
+        if (n >= baseSamples)
+        {
+            // the next sample lowers the variance s^2/n of the mean luminance by s^2/(n (n + 1)),
+            // stopping at the same gain everywhere spends samples in proportion to s
+            if (n < 2 || std::sqrt(m2 / (n - 1) / (n * (n + 1.))) <= sampling.threshold)
+                break;
+        }
+
+        double dx, dy;
+        samplePosition(n, dx, dy);
+        context.random = SampleRandom(i + j * static_cast<uint64_t>(viewport[0]), n);
+        const Ray ray = camera.primaryRay(viewport, i + dx, j + dy);
+        Vec3d color;
+        if (candidates)
+        {
+            Hit hit;
+            color = scene.intersect(ray, candidates->data(), candidates->size(), hit) ?
+                context.kernels.shadeHit(ray, hit, scene, lights, context, 1.) : BACKGROUND_COLOR;
+        }
+        else
+        {
+            color = context.kernels.castRay(ray, scene, lights, context, 1.);
+        }
+        sum += color;
+
+        const double luminance = 0.2126 * color[0] + 0.7152 * color[1] + 0.0722 * color[2];
+        ++n;
+        const double delta = luminance - mean;
+        mean += delta / n;
+        m2 += delta * (luminance - mean);
+    }
+
+    return n;
+}
+
+/**
+ * @brief A primary ray of a tile waiting to be shaded.
+ */
+struct PendingHit
+{
+    Ray ray;            //< the primary ray
+    Hit hit;            //< its closest hit, of type None if the ray left the scene
+    uint32_t pixel;     //< index of the pixel within the tile
+    uint32_t sample;    //< number of the sample within the pixel
+};
+
+/**
+ * @brief Counters of the hit sorting, to weigh its overhead against its gain.
+ */
+struct HitSortStats
+{
+    HitSortStats() : hits(0), bins(0), tiles(0), changesBefore(0), changesAfter(0), binningSeconds(0.),
+        totalSeconds(0.) {}
+
+    uint64_t hits;              //< primary rays shaded
+    uint64_t bins;              //< non-empty bins, summed over all tiles
+    uint64_t tiles;             //< tiles rendered
+    uint64_t changesBefore;     //< material changes between consecutive hits in pixel order
+    uint64_t changesAfter;      //< material changes between consecutive hits in shading order
+    double binningSeconds;      //< time spent sorting the hits
+    double totalSeconds;        //< time spent on the tiles, including the sorting
+
+    HitSortStats& operator+=(const HitSortStats& rhs)
+    {
+        hits += rhs.hits;
+        bins += rhs.bins;
+        tiles += rhs.tiles;
+        changesBefore += rhs.changesBefore;
+        changesAfter += rhs.changesAfter;
+        binningSeconds += rhs.binningSeconds;
+        totalSeconds += rhs.totalSeconds;
+        return *this;
+    }
+};
+
+/**
+ * @brief Buffers of the hit sorting, reused for all tiles of a thread.
+ */
+struct HitBinning
+{
+    std::vector<PendingHit> pending;    //< hits in pixel order
+    std::vector<uint32_t> keys;         //< bin of each pending hit
+    std::vector<uint32_t> offsets;      //< start of each bin within 'sorted'
+    std::vector<PendingHit> sorted;     //< hits in bin order
+    std::vector<Vec3d> colors;          //< shaded color per pixel and sample
+    HitSortStats stats;                 //< counters of the thread
+};
+
+/**
+ * @brief Counters of the frustum culling of tiles.
+ */
+struct TileCullingStats
+{
+    TileCullingStats() : tiles(0), candidates(0), seconds(0.) {}
+
+    uint64_t tiles;         //< tiles culled
+    uint64_t candidates;    //< candidate spheres, summed over all tiles
+    double seconds;         //< time spent building the candidate lists
+
+    TileCullingStats& operator+=(const TileCullingStats& rhs)
+    {
+        tiles += rhs.tiles;
+        candidates += rhs.candidates;
+        seconds += rhs.seconds;
+        return *this;
+    }
+};
+
+/**
+ * @brief Candidate spheres of the current tile, reused for all tiles of a thread.
+ */
+struct TileCandidates
+{
+    std::vector<uint32_t> spheres;  //< spheres touching the tile's frustum, ascending
+    TileCullingStats stats;         //< counters of the thread
+};
+
+/**
+ * @brief Find the spheres the primary rays of a tile may hit, if ShadingSettings::tileCulling
+ *        is set, by testing every sphere against the frustum through the tile's pixels.
+ *        The cost grows with the number of spheres per tile instead of a hierarchy build
+ *        per frame, which pays off for small scenes whose spheres move every frame.
+ * @param viewport Size of the framebuffer.
+ * @param tile The tile.
+ * @param camera The camera.
+ * @param scene The scene containing all objects.
+ * @param shading Settings of the shading.
+ * @param candidates Buffers and counters of the calling thread.
+ * @return The candidate spheres, nullptr if the primary rays are traced through the scene.
+ */
+static const std::vector<uint32_t>* cullTile(const Vec3i& viewport, const Tile& tile, const Camera& camera,
+    const Scene& scene, const ShadingSettings& shading, TileCandidates& candidates)
+{
+    if (!shading.tileCulling)
+        return nullptr;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // samples lie anywhere within their pixel
+    const Frustum frustum = camera.frustum(viewport, tile.x0, tile.y0, tile.x1, tile.y1);
+    candidates.spheres.clear();
+    const SphereRecord* spheres = scene.spheres();
+    for (size_t i = 0; i < scene.sphereCount(); ++i)
+    {
+        if (frustum.intersectsSphere(spheres[i].center, spheres[i].radius))
+            candidates.spheres.push_back(static_cast<uint32_t>(i));
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    ++candidates.stats.tiles;
+    candidates.stats.candidates += candidates.spheres.size();
+    candidates.stats.seconds += elapsed.count();
+    return &candidates.spheres;
+}
+
+/**
+ * @brief Render a tile in stages: trace the primary rays of all its pixels and samples, bin
+ *        the hits by material with a counting sort, shade them bin by bin and sum the samples
+ *        of each pixel. Rays leaving the scene form a bin of their own. Every sample keeps its
+ *        random sequence and the samples are summed in their order, so the result equals the
+ *        one of samplePixel() with a fixed number of samples.
+ * @param viewport Size of the framebuffer.
+ * @param tile The tile.
+ * @param camera The camera.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param samples Number of samples per pixel.
+ * @param context State of the calling thread.
+ * @param candidates The only spheres the primary rays may hit, nullptr to trace the scene.
+ * @param binning Buffers and counters of the calling thread.
+ * @param sums Sum of the colors of all samples per pixel of the tile, row-major within the tile.
+ */
+static void renderTileSorted(const Vec3i& viewport, const Tile& tile, const Camera& camera, const Scene& scene,
+    const std::vector<Pointlight>& lights, int samples, TraceContext& context,
+    const std::vector<uint32_t>* candidates, HitBinning& binning, Vec3d* sums)
+{
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+
+    const int tileWidth = tile.x1 - tile.x0;
+    const uint32_t missBin = static_cast<uint32_t>(scene.materialCount());
+
+    // trace the primary rays
+    binning.pending.clear();
+    binning.keys.clear();
+    uint32_t k = 0;
+    for (int j = tile.y0; j < tile.y1; ++j)
+    {
+        for (int i = tile.x0; i < tile.x1; ++i, ++k)
+        {
+            for (int n = 0; n < samples; ++n)
+            {
+                double dx, dy;
+                samplePosition(n, dx, dy);
+
+                PendingHit pending;
+                pending.ray = camera.primaryRay(viewport, i + dx, j + dy);
+                pending.pixel = k;
+                pending.sample = static_cast<uint32_t>(n);
+                const bool hit = candidates ?
+                    scene.intersect(pending.ray, candidates->data(), candidates->size(), pending.hit) :
+                    scene.intersect(pending.ray, pending.hit);
+                const uint32_t key = hit ? scene.getMaterialIndex(pending.hit) : missBin;
+
+                if (!binning.keys.empty() && binning.keys.back() != key)
+                    ++binning.stats.changesBefore;
+                binning.pending.push_back(pending);
+                binning.keys.push_back(key);
+            }
+        }
+    }
+    const Clock::time_point traced = Clock::now();
+
+    // counting sort by material, stable within a bin
+    binning.offsets.assign(missBin + 2, 0);
+    for (const uint32_t key : binning.keys)
+        ++binning.offsets[key + 1];
+    uint32_t bins = 0;
+    for (uint32_t b = 0; b <= missBin; ++b)
+    {
+        bins += (binning.offsets[b + 1] > 0) ? 1 : 0;
+        binning.offsets[b + 1] += binning.offsets[b];
+    }
+    binning.sorted.resize(binning.pending.size());
+    for (size_t h = 0; h < binning.pending.size(); ++h)
+        binning.sorted[binning.offsets[binning.keys[h]]++] = binning.pending[h];
+    const Clock::time_point binned = Clock::now();
+
+    // shade bin by bin
+    binning.colors.resize(binning.sorted.size());
+    for (const PendingHit& pending : binning.sorted)
+    {
+        const uint64_t pixel = (tile.x0 + pending.pixel % tileWidth) +
+            (tile.y0 + pending.pixel / tileWidth) * static_cast<uint64_t>(viewport[0]);
+        context.random = SampleRandom(pixel, pending.sample);
+        binning.colors[pending.pixel * static_cast<size_t>(samples) + pending.sample] =
+            (pending.hit.type == PrimitiveType::None) ? BACKGROUND_COLOR :
+            context.kernels.shadeHit(pending.ray, pending.hit, scene, lights, context, 1.);
+    }
+
+    for (uint32_t p = 0; p < k; ++p)
+    {
+        sums[p] = Vec3d();
+        for (int n = 0; n < samples; ++n)
+            sums[p] += binning.colors[p * static_cast<size_t>(samples) + n];
+    }
+
+    const std::chrono::duration<double> sortTime = binned - traced;
+    const std::chrono::duration<double> total = Clock::now() - start;
+    binning.stats.hits += binning.pending.size();
+    binning.stats.bins += bins;
+    binning.stats.tiles += 1;
+    binning.stats.changesAfter += (bins > 0) ? bins - 1 : 0;
+    binning.stats.binningSeconds += sortTime.count();
+    binning.stats.totalSeconds += total.count();
+}
+
+/**
+ * @brief Print the statistics of the hit sorting of a frame.
+ * @param stats The counters summed over all threads.
+ */
+static void printHitSortStats(const HitSortStats& stats)
+{
+    if (stats.tiles == 0)
+        return;
+
+    std::cout << "hit sorting: " << static_cast<double>(stats.bins) / stats.tiles << " material bins per tile, "
+        << stats.changesBefore << " material changes between consecutive hits in pixel order, "
+        << stats.changesAfter << " after sorting; binning took " << stats.binningSeconds << " s of "
+        << stats.totalSeconds << " s (" << 100. * stats.binningSeconds / stats.totalSeconds << "%)" << std::endl;
+}
+
+/**
+ * @brief Print the statistics of the frustum culling of a frame.
+ * @param stats The counters summed over all threads.
+ * @param sphereCount Number of spheres in the scene.
+ */
+static void printTileCullingStats(const TileCullingStats& stats, size_t sphereCount)
+{
+    if (stats.tiles == 0)
+        return;
+
+    std::cout << "tile culling: " << static_cast<double>(stats.candidates) / stats.tiles << " of "
+        << sphereCount << " spheres per tile, building the lists took " << stats.seconds << " s" << std::endl;
+}
+
+/**
+ * @brief printShadowStats
+ */
+void printShadowStats(const ShadowCacheStats& stats)
+{
+    if (stats.rays == 0 && stats.skipped == 0)
+        return;
+
+    std::cout << "shadow rays: " << stats.rays << ", occluded " << 100. * stats.occluded / stats.rays << "%";
+    if (stats.occluded > 0)
+        std::cout << ", answered by the occluder cache " << 100. * stats.cacheHits / stats.occluded << "%";
+    if (stats.skipped > 0)
+        std::cout << ", " << stats.skipped << " skipped by light culling";
+    std::cout << std::endl;
+}
+
+/**
+ * @brief samplePosition
+ */
+void samplePosition(int k, double& dx, double& dy)
+{
+    // generalized golden ratio for two dimensions
+    const double a1 = 0.7548776662466927;
+    const double a2 = 0.5698402909980532;
+    dx = std::fmod(0.5 + a1 * k, 1.);
+    dy = std::fmod(0.5 + a2 * k, 1.);
+}
+
+/**
+ * @brief renderHash
+ */
+uint64_t renderHash(const Vec3i& viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const Camera& camera, const AdaptiveSampling& sampling, const ShadingSettings& shading)
+{
+    uint64_t hash = scene.geometryHash();
+    for (const auto& light : lights)
+    {
+        const double values[7] = { light.getPosition()[0], light.getPosition()[1], light.getPosition()[2],
+            light.getColor()[0], light.getColor()[1], light.getColor()[2], light.getIntensity() };
+        hash = hashBytes(values, sizeof(values), hash);
+    }
+
+    hash = camera.hash(hash);
+
+    const int settings[4] = { viewport[0], viewport[1], sampling.baseSamples, sampling.maxSamples };
+    hash = hashBytes(settings, sizeof(settings), hash);
+    hash = hashBytes(&sampling.threshold, sizeof(sampling.threshold), hash);
+
+    // the cache of occluders, hit sorting, tile culling and the kernels do not change the image
+    const int shadingSettings[6] = { shading.maxDepth, shading.shadows, shading.lightCulling,
+        shading.lightSamples, shading.lightCandidates, shading.shadowMapResolution };
+    hash = hashBytes(shadingSettings, sizeof(shadingSettings), hash);
+    return hashBytes(&shading.shadowMapBias, sizeof(shading.shadowMapBias), hash);
+}
+
+/**
+ * @brief render
+ */
+void render(const Vec3i viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const Camera& camera, const CropSettings& crop, const AdaptiveSampling& sampling,
+    const CheckpointSettings& checkpoint, const std::string& output, bool streaming, const ShadingSettings& shading)
+{
+    // the framebuffer only holds the crop window
+    const CropWindow window = crop.window.within(viewport);
+    const Vec3i region(window.width(), window.height(), 0);
+    const size_t pixelCount = static_cast<size_t>(region[0]) * region[1];
+    TileScheduler scheduler(viewport, TILE_SIZE, window);
+    std::atomic<size_t> totalSamples(0);
+
+    const int baseSamples = std::max(1, sampling.baseSamples);
+    const int maxSamples = std::max(baseSamples, sampling.maxSamples);
+
+    std::vector<Vec3d> framebuffer;
+    std::unique_ptr<StreamingPPMWriter> stream;
+    if (streaming)
+        stream.reset(new StreamingPPMWriter(output, viewport, TILE_SIZE, STREAM_WINDOW));
+    else
+        framebuffer.resize(pixelCount);
+
+    // load the tiles finished by a previous run
+    std::vector<TileRecord> restored;
+    std::vector<const TileRecord*> restoredTiles(scheduler.tileCount(), nullptr);
+    // hashing reads all geometry, which is not paged in for mapped scenes otherwise
+    const bool checkpointing = checkpoint.resume || !checkpoint.path.empty();
+    const uint64_t hash = checkpointing ? renderHash(viewport, scene, lights, camera, sampling, shading) : 0;
+    if (checkpoint.resume)
+    {
+        std::vector<TileRecord> records;
+        if (!loadCheckpoint(checkpoint.path, viewport, TILE_SIZE, hash, records))
+            std::cerr << "No matching checkpoint found in " << checkpoint.path << ", starting from scratch." << std::endl;
+
+        for (auto& record : records)
+        {
+            if (record.index >= scheduler.tileCount())
+                continue;
+
+            const Tile tile = scheduler.tile(record.index);
+            if (record.samples.size() != static_cast<size_t>(tile.x1 - tile.x0) * (tile.y1 - tile.y0))
+                continue;
+
+            restored.push_back(std::move(record));
+        }
+        for (const auto& record : restored)
+            restoredTiles[record.index] = &record;
+        std::cout << "resumed " << restored.size() << " of " << scheduler.tileCount() << " tiles" << std::endl;
+    }
+
+    // the restored tiles are written to the new checkpoint right away, not with the rendered ones
+    std::unique_ptr<CheckpointWriter> writer;
+    if (!checkpoint.path.empty())
+        writer.reset(new CheckpointWriter(checkpoint, viewport, TILE_SIZE, hash, restored));
+
+    // Cast rays from the camera through each pixel on the viewplane, starting at its center(!).
+    ShadowCacheStats shadowStats;
+    HitSortStats sortStats;
+    TileCullingStats cullingStats;
+    #pragma omp parallel
+    {
+        TraceContext context(lights.size(), shading);
+        HitBinning binning;
+        TileCandidates candidates;
+        std::vector<Vec3d> sums;
+        std::vector<Vec3d> colors;
+        Tile tile;
+        while (scheduler.next(tile))
+        {
+            colors.resize(static_cast<size_t>(tile.x1 - tile.x0) * (tile.y1 - tile.y0));
+
+            TileRecord record;
+            record.index = static_cast<uint32_t>(tile.index);
+            size_t tileSamples = 0;
+
+            if (restoredTiles[tile.index])
+            {
+                // the tile has been finished by a previous run
+                const TileRecord& finished = *restoredTiles[tile.index];
+                for (size_t k = 0; k < colors.size(); ++k)
+                {
+                    colors[k] = finished.sums[k] / finished.samples[k];
+                    tileSamples += finished.samples[k];
+                }
+            }
+            else if (shading.sortHits)
+            {
+                // every pixel gets the base samples, refinement is not supported
+                sums.resize(colors.size());
+                const std::vector<uint32_t>* tileSpheres = cullTile(viewport, tile, camera, scene, shading, candidates);
+                renderTileSorted(viewport, tile, camera, scene, lights, baseSamples, context, tileSpheres, binning, sums.data());
+                for (size_t k = 0; k < colors.size(); ++k)
+                {
+                    colors[k] = sums[k] / baseSamples;
+                    tileSamples += baseSamples;
+
+                    if (writer)
+                    {
+                        record.sums.push_back(sums[k]);
+                        record.samples.push_back(static_cast<uint32_t>(baseSamples));
+                    }
+                }
+            }
+            else
+            {
+                const std::vector<uint32_t>* tileSpheres = cullTile(viewport, tile, camera, scene, shading, candidates);
+                size_t k = 0;
+                for (int j = tile.y0; j < tile.y1; ++j)
+                {
+                    for (int i = tile.x0; i < tile.x1; ++i, ++k)
+                    {
+                        Vec3d sum;
+                        const int n = samplePixel(viewport, i, j, camera, scene, lights, sampling, context, tileSpheres, sum);
+
+                        colors[k] = sum / n;
+                        tileSamples += n;
+
+                        if (writer)
+                        {
+                            record.sums.push_back(sum);
+                            record.samples.push_back(static_cast<uint32_t>(n));
+                        }
+                    }
+                }
+            }
+
+            if (stream)
+            {
+                stream->writeTile(tile, colors.data());
+            }
+            else
+            {
+                size_t k = 0;
+                for (int j = tile.y0; j < tile.y1; ++j)
+                    for (int i = tile.x0; i < tile.x1; ++i, ++k)
+                        framebuffer.at((i - window.x0) + (j - window.y0) * static_cast<size_t>(region[0])) = colors[k];
+            }
+
+            totalSamples += tileSamples;
+            if (writer && !restoredTiles[tile.index])
+                writer->tileFinished(std::move(record));
+        }
+
+        #pragma omp critical
+        {
+            shadowStats += context.shadows.stats();
+            sortStats += binning.stats;
+            cullingStats += candidates.stats;
+        }
+    }
+    printShadowStats(shadowStats);
+    printHitSortStats(sortStats);
+    printTileCullingStats(cullingStats, scene.sphereCount());
+
+    if (maxSamples > 1)
+    {
+        std::cout << "average samples per pixel: "
+            << static_cast<double>(totalSamples) / pixelCount << std::endl;
+    }
+
+    if (stream)
+    {
+        if (!stream->complete())
+            std::cerr << "Streaming the image to " << output << " failed." << std::endl;
+    }
+    else if (crop.merge)
+    {
+        if (!patchImage(output, viewport, window.x0, window.y0, region, framebuffer))
+            std::cerr << "Could not merge the crop window into " << output << std::endl;
+    }
+    else
+    {
+        // save the framebuffer as image
+        saveImage(output, region, framebuffer);
+    }
+
+    // the image is complete, the checkpoint is not needed anymore
+    if (writer)
+    {
+        writer.reset();
+        std::remove(checkpoint.path.c_str());
+    }
+}
+
+/**
+ * @brief renderTiles
+ */
+void renderTiles(const Vec3i viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const Camera& camera, const AdaptiveSampling& sampling, const ShadingSettings& shading,
+    const TileCallback& onTile)
+{
+    TileScheduler scheduler(viewport, TILE_SIZE);
+
+    #pragma omp parallel
+    {
+        TraceContext context(lights.size(), shading);
+        TileCandidates candidates;
+        std::vector<Vec3d> colors;
+        Tile tile;
+        while (scheduler.next(tile))
+        {
+            colors.resize(static_cast<size_t>(tile.x1 - tile.x0) * (tile.y1 - tile.y0));
+
+            const std::vector<uint32_t>* tileSpheres = cullTile(viewport, tile, camera, scene, shading, candidates);
+            size_t k = 0;
+            for (int j = tile.y0; j < tile.y1; ++j)
+            {
+                for (int i = tile.x0; i < tile.x1; ++i, ++k)
+                {
+                    Vec3d sum;
+                    const int n = samplePixel(viewport, i, j, camera, scene, lights, sampling, context, tileSpheres, sum);
+                    colors[k] = sum / n;
+                }
+            }
+
+            onTile(tile, colors.data());
+        }
+    }
+}
+
+/**
+ * @brief renderCameras
+ */
+void renderCameras(const Vec3i viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const std::vector<Camera>& cameras, const AdaptiveSampling& sampling, const ShadingSettings& shading,
+    const std::vector<std::string>& outputs)
+{
+    assert(outputs.size() == cameras.size());
+
+    const size_t pixelCount = static_cast<size_t>(viewport[0]) * viewport[1];
+    const TileScheduler scheduler(viewport, TILE_SIZE);
+    const size_t tileCount = scheduler.tileCount();
+    const int baseSamples = std::max(1, sampling.baseSamples);
+    const int maxSamples = std::max(baseSamples, sampling.maxSamples);
+
+    // one pool over the tiles of all frames, frame after frame
+    std::atomic<size_t> nextTile(0);
+    std::vector<std::vector<Vec3d>> framebuffers(cameras.size(), std::vector<Vec3d>(pixelCount));
+    std::unique_ptr<std::atomic<size_t>[]> remaining(new std::atomic<size_t>[cameras.size()]);
+    for (size_t c = 0; c < cameras.size(); ++c)
+        remaining[c] = tileCount;
+    std::atomic<size_t> totalSamples(0);
+
+    const auto start = std::chrono::steady_clock::now();
+    ShadowCacheStats shadowStats;
+    HitSortStats sortStats;
+    TileCullingStats cullingStats;
+    #pragma omp parallel
+    {
+        TraceContext context(lights.size(), shading);
+        HitBinning binning;
+        TileCandidates candidates;
+        std::vector<Vec3d> sums;
+        for (size_t index = nextTile++; index < cameras.size() * tileCount; index = nextTile++)
+        {
+            const size_t c = index / tileCount;
+            const Tile tile = scheduler.tile(index % tileCount);
+            const Camera& camera = cameras[c];
+            std::vector<Vec3d>& framebuffer = framebuffers[c];
+            size_t tileSamples = 0;
+            const std::vector<uint32_t>* tileSpheres = cullTile(viewport, tile, camera, scene, shading, candidates);
+
+            if (shading.sortHits)
+            {
+                sums.resize(static_cast<size_t>(tile.x1 - tile.x0) * (tile.y1 - tile.y0));
+                renderTileSorted(viewport, tile, camera, scene, lights, baseSamples, context, tileSpheres, binning, sums.data());
+                size_t k = 0;
+                for (int j = tile.y0; j < tile.y1; ++j)
+                    for (int i = tile.x0; i < tile.x1; ++i, ++k)
+                        framebuffer[i + j * static_cast<size_t>(viewport[0])] = sums[k] / baseSamples;
+                tileSamples = sums.size() * baseSamples;
+            }
+            else
+            {
+                for (int j = tile.y0; j < tile.y1; ++j)
+                {
+                    for (int i = tile.x0; i < tile.x1; ++i)
+                    {
+                        Vec3d sum;
+                        const int n = samplePixel(viewport, i, j, camera, scene, lights, sampling, context, tileSpheres, sum);
+                        framebuffer[i + j * static_cast<size_t>(viewport[0])] = sum / n;
+                        tileSamples += n;
+                    }
+                }
+            }
+            totalSamples += tileSamples;
+
+            // the last tile of a frame completes its image
+            if (--remaining[c] == 0)
+            {
+                saveImage(outputs[c], viewport, framebuffer);
+                std::vector<Vec3d>().swap(framebuffer);
+
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                #pragma omp critical
+                std::cout << "camera " << c << " written to " << outputs[c] << " after " << elapsed.count() << " s" << std::endl;
+            }
+        }
+
+        #pragma omp critical
+        {
+            shadowStats += context.shadows.stats();
+            sortStats += binning.stats;
+            cullingStats += candidates.stats;
+        }
+    }
+    printShadowStats(shadowStats);
+    printHitSortStats(sortStats);
+    printTileCullingStats(cullingStats, scene.sphereCount());
+
+    if (maxSamples > 1)
+    {
+        std::cout << "average samples per pixel: "
+            << static_cast<double>(totalSamples) / (pixelCount * cameras.size()) << std::endl;
+    }
+}
+
+/**
+ * @brief renderProgressive
+ */
+void renderProgressive(const Vec3i viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const Camera& camera, double seconds, const ShadingSettings& shading, const PassCallback& onPass)
+{
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point deadline = Clock::now() +
+        std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+
+    const int width = viewport[0];
+    const int height = viewport[1];
+    const int block = PROGRESSIVE_BLOCK_SIZE;
+
+    std::vector<Vec3d> framebuffer(static_cast<size_t>(width) * height);
+    std::vector<Vec3d> accum(framebuffer.size());
+    std::vector<int> samples(framebuffer.size(), 0);
+
+    // pass 0: one ray per block, upsampled by replication
+    #pragma omp parallel
+    {
+        TraceContext context(lights.size(), shading);
+
+        #pragma omp for
+        for (int bj = 0; bj < height; bj += block)
+        {
+            for (int bi = 0; bi < width; bi += block)
+            {
+                const size_t index = bi + bj * static_cast<size_t>(width);
+                context.random = SampleRandom(index, 0);
+                accum[index] = castRay(camera.primaryRay(viewport, bi + 0.5, bj + 0.5), scene, lights, context, 1.);
+                samples[index] = 1;
+
+                for (int j = bj; j < std::min(bj + block, height); ++j)
+                    for (int i = bi; i < std::min(bi + block, width); ++i)
+                        framebuffer[i + j * static_cast<size_t>(width)] = accum[index];
+            }
+        }
+    }
+    onPass(0, framebuffer);
+
+    // pass 1: trace all pixels not covered by pass 0
+    // pass 2+: add one stratified sample per pixel
+    for (int pass = 1; pass < 2 + PROGRESSIVE_AA_SAMPLES && Clock::now() < deadline; ++pass)
+    {
+        // offsets of the anti-aliasing samples, a 4x4 stratified pattern in bit reversed order,
+        // stratum 0 in pass 2 up to stratum 15 in the last pass
+        const int stratum = (pass >= 2) ? pass - 2 : 0;
+        const int sx = ((stratum & 1) << 1) | ((stratum & 2) >> 1);
+        const int sy = ((stratum & 4) >> 1) | ((stratum & 8) >> 3);
+        const double dx = (pass == 1) ? 0.5 : (sx + 0.5) / 4.;
+        const double dy = (pass == 1) ? 0.5 : (sy + 0.5) / 4.;
+
+        #pragma omp parallel
+        {
+            TraceContext context(lights.size(), shading);
+
+            #pragma omp for schedule(dynamic)
+            for (int j = 0; j < height; ++j)
+            {
+                if (Clock::now() >= deadline)
+                    continue;
+
+                for (int i = 0; i < width; ++i)
+                {
+                    const size_t index = i + j * static_cast<size_t>(width);
+                    if (pass == 1 && samples[index] > 0)
+                        continue;
+
+                    context.random = SampleRandom(index, pass);
+                    accum[index] += castRay(camera.primaryRay(viewport, i + dx, j + dy), scene, lights, context, 1.);
+                    ++samples[index];
+                    framebuffer[index] = accum[index] / samples[index];
+                }
+            }
+        }
+        onPass(pass, framebuffer);
+    }
+}
+
+/**
+ * @brief frameFileName
+ */
+std::string frameFileName(const std::string& output, int frame)
+{
+    char number[16];
+    std::snprintf(number, sizeof(number), "_%04d", frame);
+
+    const size_t dot = output.find_last_of('.');
+    const size_t slash = output.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return output + number;
+    return output.substr(0, dot) + number + output.substr(dot);
+}
+
+/**
+ * @brief renderSequence
+ */
+void renderSequence(const Vec3i viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const Camera& camera, const SequenceSettings& sequence, const ShadingSettings& shading, const std::string& output)
+{
+    const int width = viewport[0];
+    const int height = viewport[1];
+    const size_t pixelCount = static_cast<size_t>(width) * height;
+    const double cosMaxAngle = std::cos(sequence.maxAngle * 3.14159265358979323846 / 180.);
+
+    std::vector<ReprojectedPixel> previous(pixelCount);
+    std::vector<ReprojectedPixel> current(pixelCount);
+    std::vector<Vec3d> framebuffer(pixelCount);
+
+    for (int frame = 0; frame < sequence.frames; ++frame)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const Camera frameCamera = camera.moved(sequence.step * static_cast<double>(frame));
+        const Vec3d& cameraPos = frameCamera.position();
+
+        // splat the points of the previous frame into the new camera
+        for (auto& pixel : current)
+            pixel.valid = false;
+        if (frame > 0 && sequence.reproject)
+        {
+            for (const auto& pixel : previous)
+            {
+                double x, y;
+                if (!pixel.valid || !frameCamera.project(viewport, pixel.point, x, y))
+                    continue;
+
+                const int i = static_cast<int>(std::floor(x));
+                const int j = static_cast<int>(std::floor(y));
+                if (i < 0 || j < 0 || i >= width || j >= height)
+                    continue;
+
+                ReprojectedPixel& target = current[i + j * static_cast<size_t>(width)];
+                const double depth = (pixel.point - cameraPos).length();
+                if (!target.valid || depth < target.depth)
+                {
+                    target = pixel;
+                    target.depth = depth;
+                }
+            }
+        }
+
+        size_t traced = 0;
+        size_t reflected = 0;
+        #pragma omp parallel reduction(+:traced, reflected)
+        {
+            TraceContext context(lights.size(), shading);
+
+            #pragma omp for schedule(dynamic)
+            for (int j = 0; j < height; ++j)
+            {
+                for (int i = 0; i < width; ++i)
+                {
+                    const size_t index = i + j * static_cast<size_t>(width);
+                    const Ray ray = frameCamera.primaryRay(viewport, i + 0.5, j + 0.5);
+                    ReprojectedPixel& pixel = current[index];
+
+                    double t = 0.;
+                    if (pixel.valid)
+                    {
+                        // the pixel center has to see the point's primitive close to the point...
+                        const double footprint = (pixel.point - cameraPos).length() * 1.5 / std::min(width, height);
+                        pixel.valid = scene.intersectPrimitive(pixel.hit, ray, t) &&
+                            (ray.origin + ray.dir * t - pixel.point).length() <= footprint &&
+                            -ray.dir.dot(pixel.view) >= cosMaxAngle;
+
+                        // ...with nothing in front of it
+                        Hit occluder;
+                        pixel.valid = pixel.valid && !scene.occluded(ray, t * (1. - 1e-6), occluder);
+                    }
+
+                    context.random = SampleRandom(index, frame);
+                    if (pixel.valid)
+                    {
+                        // the local lighting is kept, the reflection starts at the exact hit point
+                        const Vec3d point = ray.origin + ray.dir * t;
+                        framebuffer[index] = pixel.local + primaryReflection(point, scene.getSurfaceNormal(pixel.hit, point),
+                            -ray.dir, pixel.specular, scene, lights, context);
+                        reflected += (pixel.specular.length() > 0.0) ? 1 : 0;
+                        continue;
+                    }
+
+                    // trace the pixel like castRay(), keeping its local lighting
+                    ++traced;
+                    pixel.valid = scene.intersect(ray, pixel.hit);
+                    if (!pixel.valid)
+                    {
+                        framebuffer[index] = BACKGROUND_COLOR;
+                        continue;
+                    }
+
+                    pixel.point = ray.origin + ray.dir * pixel.hit.t;
+                    pixel.normal = scene.getSurfaceNormal(pixel.hit, pixel.point);
+                    pixel.view = (ray.origin - pixel.point).normalize();
+                    const PhongCoefficients phong = scene.getMaterial(pixel.hit).getPhongCoefficients(pixel.point);
+                    pixel.specular = std::get<2>(phong);
+                    pixel.local = shadeLocal(pixel.point, pixel.normal, pixel.view, phong, scene, lights, 1., context);
+                    framebuffer[index] = pixel.local + primaryReflection(pixel.point, pixel.normal, pixel.view,
+                        pixel.specular, scene, lights, context);
+                }
+            }
+        }
+
+        std::swap(previous, current);
+        saveImage(frameFileName(output, frame), viewport, framebuffer);
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "frame " << frame << ": re-traced " << 100. * traced / pixelCount
+            << "% of the pixels, reused " << 100. * (pixelCount - traced) / pixelCount
+            << "% tracing " << 100. * reflected / pixelCount << "% reflections only, in "
+            << elapsed.count() << " s" << std::endl;
+    }
+}
@@ -0,0 +1,214 @@
+#ifndef renderer_h
+#define renderer_h
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "checkpoint.h"
+#include "pointlight.h"
+#include "sceneobject.h"
+#include "shadowcache.h"
+#include "tiles.h"
+#include "tracer.h"
+#include "vec3.h"
+
+const static int TILE_SIZE = 16;
+const static int STREAM_WINDOW = 4;            // tile rows buffered when streaming the output
+
+const static int PROGRESSIVE_BLOCK_SIZE = 4;   // pass 0 traces one pixel per block
+const static int PROGRESSIVE_AA_SAMPLES = 16;  // stratified samples per pixel after the center sample
+
+/**
+ * @brief Settings of the adaptive anti-aliasing.
+ *        Every pixel gets 'baseSamples' samples. Afterwards samples are added one by one
+ *        as long as the next one lowers the variance of the pixel's mean luminance by more
+ *        than threshold^2, or until 'maxSamples' is reached.
+ *        This spends samples in proportion to the pixel's standard deviation rather than
+ *        its variance, so noisy edges do not exhaust 'maxSamples' while smooth regions
+ *        stay at 'baseSamples'. The defaults trace a single ray through each pixel center.
+ */
+struct AdaptiveSampling
+{
+    AdaptiveSampling() : baseSamples(1), maxSamples(1), threshold(0.001) {}
+
+    int baseSamples;    //< samples shot into every pixel, at least 2 for refinement to kick in
+    int maxSamples;     //< upper bound of samples per pixel
+    double threshold;   //< square root of the smallest variance reduction worth another sample
+};
+
+/**
+ * @brief Region of the frame traced by render().
+ *        Only the pixels inside the window are traced. They are written as an image of the
+ *        window's size, or, if 'merge' is set, patched into the existing image of the whole frame.
+ */
+struct CropSettings
+{
+    CropSettings() : merge(false) {}
+
+    CropWindow window;  //< pixels to trace, empty for the whole frame
+    bool merge;         //< patch the pixels into the existing output image instead
+};
+
+/**
+ * @brief Settings of the camera sequence renderer.
+ */
+struct SequenceSettings
+{
+    SequenceSettings() : frames(0), reproject(true), maxAngle(1.) {}
+
+    int frames;         //< number of frames, 0 renders a single frame instead
+    Vec3d step;         //< camera movement from one frame to the next
+    bool reproject;     //< reuse the pixels of the previous frame that are still valid
+    double maxAngle;    //< largest change of the view direction onto a reused point, in degrees
+};
+
+/**
+ * @brief Print the statistics of the shadow rays of a frame.
+ * @param stats The counters summed over all threads.
+ */
+void printShadowStats(const ShadowCacheStats& stats);
+
+/**
+ * @brief Get the position of a sample within its pixel.
+ *        Sample 0 is the pixel center, the others follow the R2 low discrepancy sequence.
+ * @param k Index of the sample.
+ * @param dx Horizontal offset in [0,1).
+ * @param dy Vertical offset in [0,1).
+ */
+void samplePosition(int k, double& dx, double& dy);
+
+/**
+ * @brief Hash everything that determines the rendered image, used to validate checkpoints.
+ * @param viewport Size of the framebuffer.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param camera The camera.
+ * @param sampling Number of samples per pixel.
+ * @param shading Settings of the shading, only those changing the image are hashed.
+ * @return The hash.
+ */
+uint64_t renderHash(const Vec3i& viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const Camera& camera, const AdaptiveSampling& sampling, const ShadingSettings& shading);
+
+/**
+ * @brief The rendering method, loop over all pixels in the framebuffer, shooting
+ *        rays through each pixel with the origing being the camera position.
+ *        Tiles of the framebuffer are distributed to the threads by a TileScheduler.
+ *        If checkpointing is enabled, finished tiles are persisted in the background and
+ *        a resumed render skips the tiles found in the checkpoint.
+ *        In streaming mode no framebuffer is allocated; finished tiles are passed on to a
+ *        StreamingPPMWriter which writes the image in scanline order.
+ *        A crop window restricts the tiles to the window; it cannot be combined with
+ *        checkpointing or streaming.
+ *        With ShadingSettings::sortHits every tile is rendered in stages, shading the primary
+ *        hits binned by material, for a fixed number of 'baseSamples' samples per pixel.
+ * @param viewport Size of the framebuffer.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param camera The camera.
+ * @param crop The part of the frame to trace.
+ * @param sampling Number of samples per pixel.
+ * @param checkpoint Checkpoint file and interval.
+ * @param output File name of the image, the extension selects the format (.ppm, .pfm, .raw).
+ * @param streaming Stream the image to the (PPM) output instead of keeping a framebuffer.
+ * @param shading Settings of the shading.
+ */
+void render(const Vec3i viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const Camera& camera, const CropSettings& crop, const AdaptiveSampling& sampling, const CheckpointSettings& checkpoint, const std::string& output,
+    bool streaming, const ShadingSettings& shading);
+
+/**
+ * @brief Callback receiving a finished tile and the colors of its pixels, row-major within the tile.
+ *        It is called from all rendering threads at once.
+ */
+typedef std::function<void(const Tile&, const Vec3d*)> TileCallback;
+
+/**
+ * @brief Render a frame without keeping a framebuffer, handing each finished tile to a
+ *        callback, e.g. a StreamingPPMWriter. Tiles are rendered in the row-major order
+ *        of a TileScheduler and sampled like render() does.
+ * @param viewport Size of the framebuffer.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param camera The camera.
+ * @param sampling Number of samples per pixel.
+ * @param shading Settings of the shading.
+ * @param onTile Called with every finished tile.
+ */
+void renderTiles(const Vec3i viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const Camera& camera, const AdaptiveSampling& sampling, const ShadingSettings& shading,
+    const TileCallback& onTile);
+
+/**
+ * @brief Render the scene from several cameras in one run, e.g. a turntable or the faces of a
+ *        light probe. The tiles of all frames form a single work pool, handed out frame by
+ *        frame, so threads done with the last tiles of one frame continue with the next one
+ *        instead of waiting for it. Every image is written by the thread finishing its last
+ *        tile, while the others keep rendering. Pixels are sampled like render() does.
+ * @param viewport Size of the framebuffers.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param cameras The cameras.
+ * @param sampling Number of samples per pixel.
+ * @param shading Settings of the shading.
+ * @param outputs File name of the image per camera, the extension selects the format.
+ */
+void renderCameras(const Vec3i viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const std::vector<Camera>& cameras, const AdaptiveSampling& sampling, const ShadingSettings& shading,
+    const std::vector<std::string>& outputs);
+
+/**
+ * @brief Callback receiving the framebuffer after each pass of the progressive renderer.
+ *        The first parameter is the number of the pass, starting at 0.
+ */
+typedef std::function<void(int, const std::vector<Vec3d>&)> PassCallback;
+
+/**
+ * @brief Progressive rendering method.
+ *        Pass 0 traces one pixel out of each 4x4 block and fills the block with it.
+ *        Pass 1 traces the remaining pixels at full resolution.
+ *        Every further pass adds one anti-aliasing sample per pixel, until each 4x4 stratum
+ *        of every pixel has been sampled once.
+ *        Rendering stops as soon as the deadline is reached; an interrupted pass is still
+ *        handed to the callback, as every pixel holds the average of its samples so far.
+ * @param viewport Size of the framebuffer.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param camera The camera.
+ * @param seconds Wall-clock time budget. The coarse pass 0 is always completed.
+ * @param shading Settings of the shading.
+ * @param onPass Called with the framebuffer after each pass.
+ */
+void renderProgressive(const Vec3i viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const Camera& camera, double seconds, const ShadingSettings& shading, const PassCallback& onPass);
+
+/**
+ * @brief Get the file name of a frame of a sequence, the frame number is inserted before the extension.
+ */
+std::string frameFileName(const std::string& output, int frame);
+
+/**
+ * @brief Render a camera fly-through of a static scene, one ray through each pixel center.
+ *        The surface points seen in a frame are splatted into the next frame's camera, the
+ *        closest one per pixel wins. A pixel reuses its splatted point if the ray through the
+ *        pixel center hits the point's primitive within a pixel and a half of the point, an
+ *        any-hit query finds nothing in front of it, and the direction it is seen from stayed
+ *        within 'maxAngle' of the one it was shaded for. A reused point keeps its local
+ *        lighting, so neither the closest hit nor the shadow rays are traced again; only the
+ *        reflection, which moves with the camera, is traced from the exact hit point. All other
+ *        pixels, i.e. disoccluded ones, holes and the background, are traced from scratch.
+ * @param viewport Size of the framebuffer.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param camera The camera of the first frame.
+ * @param sequence Number of frames and camera movement.
+ * @param shading Settings of the shading.
+ * @param output File name of the images, the frame number is appended.
+ */
+void renderSequence(const Vec3i viewport, const Scene& scene, const std::vector<Pointlight>& lights,
+    const Camera& camera, const SequenceSettings& sequence, const ShadingSettings& shading, const std::string& output);
+
+#endif // !renderer_h
@@ -0,0 +1,475 @@
+#include "renderserver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+
+#include "scenefile.h"
+#include "streamwriter.h"
+#include "util.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_UNIX_SOCKETS
+#include <cerrno>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+static const size_t MAX_LINE_LENGTH = 1024;             //< longest command line accepted
+static const size_t MAX_SCENE_SIZE = 1ull << 30;        //< largest scene text accepted
+static const int MAX_RESOLUTION = 1 << 15;              //< largest image edge accepted
+
+/**
+ * @brief SceneCache::SceneCache
+ */
+SceneCache::SceneCache(size_t capacity) :
+    _capacity(capacity > 0 ? capacity : 1)
+{
+}
+
+/**
+ * @brief SceneCache::find
+ */
+std::shared_ptr<const CachedScene> SceneCache::find(uint64_t hash)
+{
+    const auto it = _index.find(hash);
+    if (it == _index.end())
+        return nullptr;
+
+    _entries.splice(_entries.begin(), _entries, it->second);
+    return it->second->second;
+}
+
+/**
+ * @brief SceneCache::insert
+ */
+void SceneCache::insert(uint64_t hash, std::shared_ptr<const CachedScene> scene)
+{
+    const auto it = _index.find(hash);
+    if (it != _index.end())
+    {
+        _entries.erase(it->second);
+        _index.erase(it);
+    }
+
+    _entries.push_front(std::make_pair(hash, std::move(scene)));
+    _index[hash] = _entries.begin();
+
+    while (_entries.size() > _capacity)
+    {
+        _index.erase(_entries.back().first);
+        _entries.pop_back();
+    }
+}
+
+#ifdef HAVE_UNIX_SOCKETS
+
+namespace
+{
+    /**
+     * @brief Send a block of bytes, retrying until all of it is sent.
+     */
+    bool sendAll(int fd, const char* data, size_t size)
+    {
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+        while (size > 0)
+        {
+            const ssize_t sent = send(fd, data, size, flags);
+            if (sent < 0 && errno == EINTR)
+                continue;
+            if (sent <= 0)
+                return false;
+
+            data += sent;
+            size -= static_cast<size_t>(sent);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Send a line of text, the newline is appended.
+     */
+    bool sendLine(int fd, const std::string& line)
+    {
+        const std::string text = line + "\n";
+        return sendAll(fd, text.data(), text.size());
+    }
+
+    /**
+     * @brief Receive a block of bytes of known size.
+     */
+    bool receiveAll(int fd, char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            const ssize_t received = recv(fd, data, size, 0);
+            if (received < 0 && errno == EINTR)
+                continue;
+            if (received <= 0)
+                return false;
+
+            data += received;
+            size -= static_cast<size_t>(received);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Receive a line of text, without its newline. Lines are short, so they are read
+     *        byte by byte, which leaves any binary data following the line in the socket.
+     */
+    bool receiveLine(int fd, std::string& line)
+    {
+        line.clear();
+        char c;
+        while (receiveAll(fd, &c, 1))
+        {
+            if (c == '\n')
+                return true;
+            if (line.size() >= MAX_LINE_LENGTH)
+                return false;
+            line += c;
+        }
+        return false;
+    }
+
+    /**
+     * @brief The SocketBuffer class. A stream buffer sending everything written to it over a socket.
+     */
+    class SocketBuffer : public std::streambuf
+    {
+    public:
+        explicit SocketBuffer(int fd) : _fd(fd), _buffer(1 << 16)
+        {
+            setp(_buffer.data(), _buffer.data() + _buffer.size());
+        }
+
+    protected:
+        int_type overflow(int_type c) override
+        {
+            if (!flush())
+                return traits_type::eof();
+
+            if (!traits_type::eq_int_type(c, traits_type::eof()))
+            {
+                *pptr() = traits_type::to_char_type(c);
+                pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override
+        {
+            return flush() ? 0 : -1;
+        }
+
+    private:
+        bool flush()
+        {
+            const size_t size = static_cast<size_t>(pptr() - pbase());
+            setp(_buffer.data(), _buffer.data() + _buffer.size());
+            return sendAll(_fd, _buffer.data(), size);
+        }
+
+        int _fd;                    //< the connected socket
+        std::vector<char> _buffer;  //< bytes not yet sent
+    };
+
+    /**
+     * @brief Fill in the address of a socket path.
+     */
+    bool socketAddress(const std::string& path, sockaddr_un& address)
+    {
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+        {
+            std::cerr << "Invalid socket path " << path << std::endl;
+            return false;
+        }
+
+        std::memcpy(address.sun_path, path.c_str(), path.size());
+        return true;
+    }
+
+    /**
+     * @brief Connect to the render server.
+     * @return The connected socket, -1 on failure.
+     */
+    int connectToServer(const std::string& path)
+    {
+        sockaddr_un address;
+        if (!socketAddress(path, address))
+            return -1;
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            std::cerr << "Could not connect to the render server at " << path << std::endl;
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    /**
+     * @brief Render a job for the client and stream the image back.
+     * @param fd The connected socket.
+     * @param command The arguments of the RENDER command.
+     * @param cache The scenes kept between jobs.
+     * @return false if the connection broke down.
+     */
+    bool serveRender(int fd, std::istringstream& command, SceneCache& cache)
+    {
+        uint64_t hash = 0;
+        RenderJob job;
+        double x, y, z;
+        if (!(command >> std::hex >> hash >> std::dec >> job.viewport[0] >> job.viewport[1] >> x >> y >> z >>
+            job.sampling.baseSamples >> job.sampling.maxSamples) ||
+            job.viewport[0] <= 0 || job.viewport[1] <= 0 ||
+            job.viewport[0] > MAX_RESOLUTION || job.viewport[1] > MAX_RESOLUTION)
+        {
+            return sendLine(fd, "ERROR invalid render job");
+        }
+        job.cameraPos = Vec3d(x, y, z);
+
+        const auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<const CachedScene> cached = cache.find(hash);
+        const bool hit = (cached != nullptr);
+        if (!hit)
+        {
+            // fetch the scene from the client
+            std::string line, keyword;
+            size_t size = 0;
+            if (!sendLine(fd, "NEED") || !receiveLine(fd, line) ||
+                !(std::istringstream(line) >> keyword >> size) || keyword != "SCENE" || size > MAX_SCENE_SIZE)
+            {
+                return false;
+            }
+
+            std::string text(size, '\0');
+            if (!receiveAll(fd, &text[0], size))
+                return false;
+            if (hashBytes(text.data(), text.size()) != hash)
+                return sendLine(fd, "ERROR the scene does not match its hash");
+
+            std::shared_ptr<CachedScene> scene = std::make_shared<CachedScene>();
+            std::string error;
+            if (!parseSceneText(text, scene->scene, scene->lights, error))
+                return sendLine(fd, "ERROR " + error);
+
+            scene->scene.buildAccel();
+            cached = scene;
+            cache.insert(hash, cached);
+        }
+        const std::chrono::duration<double> setup = std::chrono::steady_clock::now() - start;
+
+        // the PPM is streamed while the frame is rendered
+        std::ostringstream header;
+        header << "P6\n" << job.viewport[0] << " " << job.viewport[1] << "\n255\n";
+        const size_t imageSize = header.str().size() + static_cast<size_t>(job.viewport[0]) * job.viewport[1] * 3;
+        if (!sendLine(fd, "IMAGE " + std::to_string(job.viewport[0]) + " " + std::to_string(job.viewport[1]) +
+            " " + std::to_string(imageSize)))
+        {
+            return false;
+        }
+
+        SocketBuffer buffer(fd);
+        std::ostream stream(&buffer);
+        StreamingPPMWriter writer(stream, job.viewport, TILE_SIZE, STREAM_WINDOW);
+        // default shading; cached scenes keep their hierarchy, so tiles are not culled either
+        renderTiles(job.viewport, cached->scene, cached->lights, Camera(job.cameraPos), job.sampling, ShadingSettings(),
+            [&](const Tile& tile, const Vec3d* colors) { writer.writeTile(tile, colors); });
+
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "scene " << std::hex << hash << std::dec << (hit ? " cached" : " built in " + std::to_string(setup.count()) + " s")
+            << ", " << job.viewport[0] << "x" << job.viewport[1] << " frame done after " << elapsed.count()
+            << " s, " << cache.size() << " scenes cached" << std::endl;
+        return writer.complete();
+    }
+}
+
+/**
+ * @brief runRenderServer
+ */
+bool runRenderServer(const std::string& socketPath, size_t cacheSize)
+{
+    sockaddr_un address;
+    if (!socketAddress(socketPath, address))
+        return false;
+
+    // a client going away while its image is streamed must not end the server
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // replace the socket of a previous server, but nothing else
+    struct stat info;
+    if (stat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+        unlink(socketPath.c_str());
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, 16) != 0)
+    {
+        std::cerr << "Could not listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        if (listener >= 0)
+            close(listener);
+        return false;
+    }
+    std::cout << "render server listening on " << socketPath << std::endl;
+
+    SceneCache cache(cacheSize);
+    bool running = true;
+    while (running)
+    {
+        const int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        std::string line;
+        while (receiveLine(fd, line))
+        {
+            std::istringstream command(line);
+            std::string keyword;
+            command >> keyword;
+
+            if (keyword == "RENDER")
+            {
+                if (!serveRender(fd, command, cache))
+                    break;
+            }
+            else if (keyword == "SHUTDOWN")
+            {
+                sendLine(fd, "BYE");
+                running = false;
+                break;
+            }
+            else if (!sendLine(fd, "ERROR unknown command " + keyword))
+            {
+                break;
+            }
+        }
+        close(fd);
+    }
+
+    close(listener);
+    unlink(socketPath.c_str());
+    return !running;
+}
+
+/**
+ * @brief requestRender
+ */
+bool requestRender(const std::string& socketPath, const std::string& sceneText, const RenderJob& job,
+    const std::string& output, bool& cached)
+{
+    const int fd = connectToServer(socketPath);
+    if (fd < 0)
+        return false;
+
+    std::ostringstream command;
+    command.precision(17);
+    command << "RENDER " << std::hex << hashBytes(sceneText.data(), sceneText.size()) << std::dec
+        << " " << job.viewport[0] << " " << job.viewport[1]
+        << " " << job.cameraPos[0] << " " << job.cameraPos[1] << " " << job.cameraPos[2]
+        << " " << job.sampling.baseSamples << " " << job.sampling.maxSamples;
+
+    std::string line;
+    bool success = sendLine(fd, command.str()) && receiveLine(fd, line);
+    cached = (line != "NEED");
+    if (success && !cached)
+    {
+        success = sendLine(fd, "SCENE " + std::to_string(sceneText.size())) &&
+            sendAll(fd, sceneText.data(), sceneText.size()) && receiveLine(fd, line);
+    }
+
+    std::string keyword;
+    int width = 0, height = 0;
+    size_t size = 0;
+    std::istringstream reply(line);
+    if (!success || !(reply >> keyword >> width >> height >> size) || keyword != "IMAGE")
+    {
+        std::cerr << "The render server did not render the frame" << (line.empty() ? "" : ": " + line) << std::endl;
+        close(fd);
+        return false;
+    }
+
+    // store the image as it arrives
+    std::ofstream file(output.c_str(), std::ios::out | std::ios::binary);
+    std::vector<char> chunk(1 << 16);
+    while (success && size > 0)
+    {
+        const size_t count = std::min(size, chunk.size());
+        success = receiveAll(fd, chunk.data(), count) &&
+            file.write(chunk.data(), static_cast<std::streamsize>(count));
+        size -= count;
+    }
+    close(fd);
+
+    if (!success)
+        std::cerr << "Receiving the image into " << output << " failed." << std::endl;
+    return success;
+}
+
+/**
+ * @brief requestShutdown
+ */
+bool requestShutdown(const std::string& socketPath)
+{
+    const int fd = connectToServer(socketPath);
+    if (fd < 0)
+        return false;
+
+    std::string line;
+    const bool success = sendLine(fd, "SHUTDOWN") && receiveLine(fd, line) && line == "BYE";
+    close(fd);
+    return success;
+}
+
+#else
+
+/**
+ * @brief runRenderServer
+ */
+bool runRenderServer(const std::string& socketPath, size_t)
+{
+    std::cerr << "Unix domain sockets are not available, cannot listen on " << socketPath << std::endl;
+    return false;
+}
+
+/**
+ * @brief requestRender
+ */
+bool requestRender(const std::string& socketPath, const std::string&, const RenderJob&, const std::string&, bool&)
+{
+    std::cerr << "Unix domain sockets are not available, cannot connect to " << socketPath << std::endl;
+    return false;
+}
+
+/**
+ * @brief requestShutdown
+ */
+bool requestShutdown(const std::string& socketPath)
+{
+    std::cerr << "Unix domain sockets are not available, cannot connect to " << socketPath << std::endl;
+    return false;
+}
+
+#endif
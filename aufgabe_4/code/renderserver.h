@@ -0,0 +1,125 @@
+#ifndef renderserver_h
+#define renderserver_h
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "pointlight.h"
+#include "renderer.h"
+#include "sceneobject.h"
+#include "vec3.h"
+
+/**
+ * @brief A scene kept by the render server, with its hierarchy already built.
+ */
+struct CachedScene
+{
+    CachedScene() : scene(0, 0) {}
+
+    Scene scene;                        //< primitives and hierarchy
+    std::vector<Pointlight> lights;     //< light sources
+};
+
+/**
+ * @brief The SceneCache class.
+ *        Keeps the most recently used scenes, keyed by the hash of their text description.
+ *        Once the capacity is exceeded the least recently used scene is dropped; a job still
+ *        rendering it keeps it alive through its shared pointer.
+ */
+class SceneCache
+{
+public:
+    /**
+     * @brief Create an empty cache.
+     * @param capacity Maximum number of scenes kept, at least 1.
+     */
+    explicit SceneCache(size_t capacity);
+
+    /**
+     * @brief Look up a scene and mark it as most recently used.
+     * @param hash Hash of the scene text.
+     * @return The scene, nullptr if it is not cached.
+     */
+    std::shared_ptr<const CachedScene> find(uint64_t hash);
+
+    /**
+     * @brief Add a scene as the most recently used one, dropping the least recently used
+     *        scene if the cache is full.
+     * @param hash Hash of the scene text.
+     * @param scene The scene.
+     */
+    void insert(uint64_t hash, std::shared_ptr<const CachedScene> scene);
+
+    /**
+     * @brief Get the number of cached scenes.
+     */
+    size_t size() const { return _entries.size(); }
+
+private:
+    typedef std::list<std::pair<uint64_t, std::shared_ptr<const CachedScene>>> Entries;
+
+    size_t _capacity;                                       //< maximum number of scenes
+    Entries _entries;                                       //< scenes, most recently used first
+    std::unordered_map<uint64_t, Entries::iterator> _index; //< position of each scene in _entries
+};
+
+/**
+ * @brief A frame requested from the render server.
+ */
+struct RenderJob
+{
+    RenderJob() : viewport(600, 600, 0), cameraPos(0.) {}
+
+    Vec3i viewport;             //< image resolution
+    Vec3d cameraPos;            //< camera position in world coordinates
+    AdaptiveSampling sampling;  //< samples per pixel
+};
+
+/**
+ * @brief Run the render server until a client asks it to shut down.
+ *
+ *        The server listens on a Unix domain socket and handles one connection at a time,
+ *        as every job renders on all cores anyway. A connection may send several jobs, each
+ *        a line of text:
+ *
+ *            RENDER <scene hash> <width> <height> <camera x y z> <base samples> <max samples>
+ *
+ *        The scene hash is the hashBytes() of the scene text. If the scene is not cached, the
+ *        server answers "NEED" and the client sends "SCENE <size>" followed by the scene text,
+ *        which is parsed by parseSceneText() and gets its hierarchy built. The server then
+ *        answers "IMAGE <width> <height> <size>", followed by a binary PPM of that size that is
+ *        streamed in scanline order while the frame is rendered, or "ERROR <message>".
+ *        "SHUTDOWN" stops the server.
+ *
+ * @param socketPath Path of the socket. An existing socket at the path is replaced.
+ * @param cacheSize Maximum number of scenes kept between jobs.
+ * @return true after a clean shutdown, false if the socket could not be opened.
+ */
+bool runRenderServer(const std::string& socketPath, size_t cacheSize);
+
+/**
+ * @brief Render a frame on the render server.
+ * @param socketPath Path of the server's socket.
+ * @param sceneText The scene description, only sent if the server does not have it cached.
+ * @param job Resolution, camera and sampling of the frame.
+ * @param output The PPM file receiving the image while it is streamed.
+ * @param cached Set to whether the server had the scene cached.
+ * @return true on success, false otherwise.
+ */
+bool requestRender(const std::string& socketPath, const std::string& sceneText, const RenderJob& job,
+    const std::string& output, bool& cached);
+
+/**
+ * @brief Ask the render server to shut down.
+ * @param socketPath Path of the server's socket.
+ * @return true if the server confirmed the shutdown.
+ */
+bool requestShutdown(const std::string& socketPath);
+
+#endif // !renderserver_h
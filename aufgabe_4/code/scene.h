@@ -1,26 +1,32 @@
 #pragma once
 
+#include "material.h"
 #include "pointlight.h"
 #include "sceneobject.h"
 #include "vec3.h"
 
-#include <memory>
+#include <cmath>
+#include <cstdint>
+#include <random>
 #include <vector>
 
 /**
  * @brief Create a scene with a plane and a bunch of colored spheres.
- * @return The scene as list of scene objects.
+ * @return The scene with all primitives allocated from its arena.
  */
-std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
+Scene create_scene_objects()
 {
-    std::vector<std::shared_ptr<SceneObject>> objects;
+    const size_t numSpheres = 32;
+    const size_t numPlanes = 1;
+    Scene scene(numSpheres, numPlanes);
 
     // Create one plane
     Vec3d planeNormal(0.0, 1.0, 0.0);
     planeNormal.normalize();
 
-    std::shared_ptr<SceneObject> plane = std::make_shared<Plane>(Vec3d(0.0, -1.0, 5.0), planeNormal);
-    objects.push_back(std::shared_ptr<SceneObject>(plane));
+    // grey chess board pattern
+    const uint32_t planeMaterial = scene.addMaterial(Material::checker(Vec3d(0.6), Vec3d(0.2), 0.125));
+    scene.addPlane(Vec3d(0.0, -1.0, 5.0), planeNormal, planeMaterial);
 
     // Create a bunch of colored spheres
     {
@@ -28,7 +34,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.59685;
         const Vec3d color(0.680215, 0.3897, 0.0832257);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -36,7 +42,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.333709;
         const Vec3d color(0.231187, 0.899334, 0.132472);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -44,7 +50,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.721999;
         const Vec3d color(0.327648, 0.336679, 0.533702);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -52,7 +58,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.617482;
         const Vec3d color(0.0900409, 0.545919, 0.940942);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -60,7 +66,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.524775;
         const Vec3d color(0.889082, 0.818827, 0.376314);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -68,7 +74,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.232771;
         const Vec3d color(0.69184, 0.131286, 0.933796);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -76,7 +82,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.983231;
         const Vec3d color(0.224297, 0.147904, 0.61634);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -84,7 +90,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.450499;
         const Vec3d color(0.471878, 0.436242, 0.30572);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -92,7 +98,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.385417;
         const Vec3d color(0.0638121, 0.538282, 0.832521);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -100,7 +106,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.683264;
         const Vec3d color(0.340974, 0.597084, 0.282512);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -108,7 +114,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.391061;
         const Vec3d color(0.8033, 0.364325, 0.509903);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -116,7 +122,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.207942;
         const Vec3d color(0.629547, 0.482853, 0.0628588);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -124,7 +130,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.449754;
         const Vec3d color(0.16608, 0.851683, 0.916801);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -132,7 +138,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.326541;
         const Vec3d color(0.2159, 0.950424, 0.299693);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -140,7 +146,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.844534;
         const Vec3d color(0.235393, 0.68133, 0.814113);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -148,7 +154,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.965255;
         const Vec3d color(0.657187, 0.699725, 0.713496);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -156,7 +162,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.165267;
         const Vec3d color(0.937254, 0.918642, 0.338299);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -164,7 +170,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.293488;
         const Vec3d color(0.698401, 0.0248872, 0.832002);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -172,7 +178,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.790176;
         const Vec3d color(0.14572, 0.903395, 0.800197);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -180,7 +186,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.91496;
         const Vec3d color(0.844889, 0.495297, 0.660831);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -188,7 +194,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.370818;
         const Vec3d color(0.565382, 0.340108, 0.676196);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -196,7 +202,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.274722;
         const Vec3d color(0.605955, 0.560501, 0.874004);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -204,7 +210,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.848914;
         const Vec3d color(0.495297, 0.452428, 0.253168);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -212,7 +218,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.0404336;
         const Vec3d color(0.562847, 0.231306, 0.420837);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -220,7 +226,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.201719;
         const Vec3d color(0.497781, 0.196731, 0.467383);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -228,7 +234,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.695516;
         const Vec3d color(0.0286482, 0.0439981, 0.0260184);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -236,7 +242,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.203061;
         const Vec3d color(0.782078, 0.920722, 0.0483436);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -244,7 +250,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.880468;
         const Vec3d color(0.118627, 0.316963, 0.0509399);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -252,7 +258,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.456535;
         const Vec3d color(0.821713, 0.296983, 0.443441);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -260,7 +266,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.324345;
         const Vec3d color(0.177003, 0.100103, 0.0759562);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -268,7 +274,7 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.272132;
         const Vec3d color(0.535684, 0.992047, 0.599507);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
     {
@@ -276,10 +282,63 @@ std::vector<std::shared_ptr<SceneObject>> create_scene_objects()
         const double radius = 0.304781;
         const Vec3d color(0.8382, 0.174815, 0.621885);
 
-        objects.push_back(std::shared_ptr<SceneObject>(std::make_shared<Sphere>(pos, radius, color)));
+        scene.addSphere(pos, radius, scene.addMaterial(Material(color)));
     }
 
-    return objects;
+    return scene;
+}
+
+/**
+ * @brief Create a point cloud rendered as small spheres above the checker board plane.
+ *        The points are scattered through a torus in front of the camera; the sphere radius
+ *        shrinks with the number of points, so the cloud covers a similar area on screen.
+ * @param count Number of spheres.
+ * @param seed Seed of the random generator placing the points.
+ * @return The scene with all primitives allocated from its arena.
+ */
+Scene create_point_cloud(size_t count, unsigned int seed)
+{
+    Scene scene(count, 1);
+
+    const uint32_t planeMaterial = scene.addMaterial(Material::checker(Vec3d(0.6), Vec3d(0.2), 0.125));
+    scene.addPlane(Vec3d(0.0, -3.0, 5.0), Vec3d(0.0, 1.0, 0.0), planeMaterial);
+
+    // a small palette of materials shared by all spheres
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    const uint32_t paletteSize = 16;
+    uint32_t firstMaterial = 0;
+    for (uint32_t i = 0; i < paletteSize; ++i)
+    {
+        const uint32_t material = scene.addMaterial(Material(Vec3d(uniform(rng), uniform(rng), uniform(rng))));
+        if (i == 0)
+            firstMaterial = material;
+    }
+
+    // torus around the y-axis, tilted towards the camera
+    const Vec3d center(0.0, 0.5, -12.0);
+    const double majorRadius = 4.0;
+    const double minorRadius = 1.2;
+    const double tilt = 0.6;
+    const double pi = 3.14159265358979323846;
+    const double radius = std::sqrt(40.0 / std::max<size_t>(count, 1));
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const double phi = 2.0 * pi * uniform(rng);
+        const double theta = 2.0 * pi * uniform(rng);
+        const double r = minorRadius * std::sqrt(uniform(rng));
+
+        const double ring = majorRadius + r * std::cos(theta);
+        const double x = ring * std::cos(phi);
+        const double y = r * std::sin(theta);
+        const double z = ring * std::sin(phi);
+
+        const Vec3d p(x, y * std::cos(tilt) - z * std::sin(tilt), y * std::sin(tilt) + z * std::cos(tilt));
+        scene.addSphere(center + p, radius, firstMaterial + static_cast<uint32_t>(uniform(rng) * paletteSize) % paletteSize);
+    }
+
+    return scene;
 }
 
 /**
@@ -420,3 +479,31 @@ std::vector<Pointlight> create_scene_lights() {
 
     return lights;
 }
+
+/**
+ * @brief Create randomly placed point lights above the scene.
+ *        The total intensity matches the default lights, so the image keeps its brightness.
+ * @param count Number of lights.
+ * @param seed Seed of the random generator placing the lights.
+ * @return A vector of point lights.
+ */
+std::vector<Pointlight> create_random_lights(size_t count, unsigned int seed)
+{
+    std::vector<Pointlight> lights;
+    lights.reserve(count);
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    const double totalIntensity = 16 * 2.7;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Vec3d position(-15.0 + 30.0 * uniform(rng), 20.0 * uniform(rng), 5.0 - 30.0 * uniform(rng));
+        const Vec3d color(uniform(rng), uniform(rng), uniform(rng));
+        const double intensity = totalIntensity / count * (0.75 + 0.5 * uniform(rng));
+
+        lights.push_back(Pointlight(position, color, intensity));
+    }
+
+    return lights;
+}
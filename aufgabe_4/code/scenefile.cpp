@@ -0,0 +1,276 @@
+#include "scenefile.h"
+
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "material.h"
+
+namespace
+{
+    /**
+     * @brief A primitive as read from the text, before the scene is allocated.
+     */
+    struct PrimitiveEntry
+    {
+        Vec3d position;     //< sphere center or point on the plane
+        Vec3d normal;       //< plane normal
+        double radius;      //< sphere radius
+        uint32_t material;  //< material index
+    };
+
+    /**
+     * @brief Read three numbers into a vector.
+     */
+    bool readVec(std::istream& is, Vec3d& v)
+    {
+        double x, y, z;
+        if (!(is >> x >> y >> z))
+            return false;
+
+        v = Vec3d(x, y, z);
+        return true;
+    }
+
+    /**
+     * @brief Write a vector as three numbers.
+     */
+    void writeVec(std::ostream& os, const Vec3d& v)
+    {
+        os << v[0] << ' ' << v[1] << ' ' << v[2];
+    }
+}
+
+/**
+ * @brief parseSceneText
+ */
+bool parseSceneText(const std::string& text, Scene& scene, std::vector<Pointlight>& lights, std::string& error)
+{
+    std::vector<Material> materials;
+    std::vector<PrimitiveEntry> spheres;
+    std::vector<PrimitiveEntry> planes;
+    std::vector<Pointlight> parsedLights;
+
+    std::istringstream input(text);
+    std::string line;
+    for (int number = 1; std::getline(input, line); ++number)
+    {
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+
+        std::istringstream is(line);
+        std::string keyword;
+        if (!(is >> keyword))
+            continue;
+
+        bool valid = false;
+        if (keyword == "material")
+        {
+            Vec3d color, specular;
+            double shininess = 0.;
+            valid = readVec(is, color) && readVec(is, specular) && (is >> shininess);
+            if (valid)
+            {
+                Material material(color);
+                material._specular = specular;
+                material._shininess = shininess;
+                materials.push_back(material);
+            }
+        }
+        else if (keyword == "checker" || keyword == "stripes" || keyword == "noise")
+        {
+            const SurfacePattern pattern = (keyword == "checker") ? SurfacePattern::Checker :
+                ((keyword == "stripes") ? SurfacePattern::Stripes : SurfacePattern::Noise);
+            Vec3d color, secondaryColor, specular;
+            double frequency = 0., shininess = 0.;
+            valid = readVec(is, color) && readVec(is, secondaryColor) && (is >> frequency) &&
+                readVec(is, specular) && (is >> shininess);
+            if (valid)
+            {
+                Material material = Material::patterned(pattern, color, secondaryColor, frequency);
+                material._specular = specular;
+                material._shininess = shininess;
+                materials.push_back(material);
+            }
+        }
+        else if (keyword == "sphere")
+        {
+            PrimitiveEntry sphere;
+            valid = readVec(is, sphere.position) && (is >> sphere.radius >> sphere.material) &&
+                sphere.radius > 0. && sphere.material < materials.size();
+            if (valid)
+                spheres.push_back(sphere);
+        }
+        else if (keyword == "plane")
+        {
+            PrimitiveEntry plane;
+            valid = readVec(is, plane.position) && readVec(is, plane.normal) && (is >> plane.material) &&
+                plane.normal.length() > 0. && plane.material < materials.size();
+            if (valid)
+                planes.push_back(plane);
+        }
+        else if (keyword == "light")
+        {
+            Vec3d position, color;
+            double intensity = 0.;
+            valid = readVec(is, position) && readVec(is, color) && (is >> intensity);
+            if (valid)
+                parsedLights.push_back(Pointlight(position, color, intensity));
+        }
+
+        // nothing may follow the entry
+        std::string rest;
+        if (!valid || (is >> rest))
+        {
+            error = "line " + std::to_string(number) + ": invalid " + keyword + " entry";
+            return false;
+        }
+    }
+
+    Scene parsed(spheres.size(), planes.size());
+    for (const auto& material : materials)
+        parsed.addMaterial(material);
+    for (const auto& sphere : spheres)
+        parsed.addSphere(sphere.position, sphere.radius, sphere.material);
+    for (auto plane : planes)
+        parsed.addPlane(plane.position, plane.normal.normalize(), plane.material);
+
+    scene = std::move(parsed);
+    lights = std::move(parsedLights);
+    return true;
+}
+
+/**
+ * @brief parseCameraText
+ */
+bool parseCameraText(const std::string& text, double aspect, std::vector<Camera>& cameras, std::string& error)
+{
+    std::vector<Camera> parsed;
+
+    std::istringstream input(text);
+    std::string line;
+    for (int number = 1; std::getline(input, line); ++number)
+    {
+        const size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+
+        std::istringstream is(line);
+        std::string keyword;
+        if (!(is >> keyword))
+            continue;
+
+        // a position, optionally followed by a target and the field of view
+        std::vector<double> values;
+        double value;
+        while (values.size() < 7 && (is >> value))
+            values.push_back(value);
+
+        bool valid = false;
+        if (keyword == "camera" && values.size() == 3)
+        {
+            parsed.push_back(Camera(Vec3d(values[0], values[1], values[2])));
+            valid = true;
+        }
+        else if (keyword == "camera" && values.size() == 7)
+        {
+            const Vec3d position(values[0], values[1], values[2]);
+            const Vec3d target(values[3], values[4], values[5]);
+            const double fov = values[6];
+            valid = fov > 0. && fov < 180. && (target - position).length() > 0.;
+            if (valid)
+                parsed.push_back(Camera::lookAt(position, target, fov, aspect));
+        }
+
+        // nothing may follow the entry
+        is.clear();
+        std::string rest;
+        if (!valid || (is >> rest))
+        {
+            error = "line " + std::to_string(number) + ": invalid " + keyword + " entry";
+            return false;
+        }
+    }
+
+    if (parsed.empty())
+    {
+        error = "no camera";
+        return false;
+    }
+
+    cameras = std::move(parsed);
+    return true;
+}
+
+/**
+ * @brief writeSceneText
+ */
+void writeSceneText(std::ostream& os, const Scene& scene, const std::vector<Pointlight>& lights)
+{
+    const std::streamsize precision = os.precision(std::numeric_limits<double>::max_digits10);
+
+    for (size_t i = 0; i < scene.materialCount(); ++i)
+    {
+        const Material& material = scene.materials()[i];
+        if (material._pattern != SurfacePattern::Solid)
+        {
+            os << ((material._pattern == SurfacePattern::Checker) ? "checker " :
+                ((material._pattern == SurfacePattern::Stripes) ? "stripes " : "noise "));
+            writeVec(os, material._color);
+            os << ' ';
+            writeVec(os, material._secondaryColor);
+            os << ' ' << material._frequency << ' ';
+        }
+        else
+        {
+            os << "material ";
+            writeVec(os, material._color);
+            os << ' ';
+        }
+        writeVec(os, material._specular);
+        os << ' ' << material._shininess << '\n';
+    }
+
+    for (size_t i = 0; i < scene.sphereCount(); ++i)
+    {
+        os << "sphere ";
+        writeVec(os, scene.spheres()[i].center);
+        os << ' ' << scene.spheres()[i].radius << ' ' << scene.sphereMaterials()[i] << '\n';
+    }
+
+    for (size_t i = 0; i < scene.planeCount(); ++i)
+    {
+        os << "plane ";
+        writeVec(os, scene.planes()[i].point);
+        os << ' ';
+        writeVec(os, scene.planes()[i].normal);
+        os << ' ' << scene.planeMaterials()[i] << '\n';
+    }
+
+    for (const auto& light : lights)
+    {
+        os << "light ";
+        writeVec(os, light.getPosition());
+        os << ' ';
+        writeVec(os, light.getColor());
+        os << ' ' << light.getIntensity() << '\n';
+    }
+
+    os.precision(precision);
+}
+
+/**
+ * @brief readTextFile
+ */
+bool readTextFile(const std::string& path, std::string& text)
+{
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    std::ostringstream content;
+    content << file.rdbuf();
+    text = content.str();
+    return !file.bad();
+}
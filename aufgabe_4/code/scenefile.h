@@ -0,0 +1,69 @@
+#ifndef scenefile_h
+#define scenefile_h
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "pointlight.h"
+#include "sceneobject.h"
+
+/**
+ * @brief Build a scene from its text description.
+ *
+ *        Every line holds one entry, '#' starts a comment:
+ *
+ *            material <r g b> <specular r g b> <shininess>
+ *            checker <r g b> <r g b> <frequency> <specular r g b> <shininess>
+ *            stripes <r g b> <r g b> <frequency> <specular r g b> <shininess>
+ *            noise <r g b> <r g b> <frequency> <specular r g b> <shininess>
+ *            sphere <x y z> <radius> <material>
+ *            plane <x y z> <normal x y z> <material>
+ *            light <x y z> <r g b> <intensity>
+ *
+ *        Materials are numbered in the order they appear, starting at 0. The patterned
+ *        materials blend their two colors as described in texture.h.
+ *
+ * @param text The scene description.
+ * @param scene The scene, without hierarchy.
+ * @param lights The lights of the scene.
+ * @param error Description of the first malformed line, if any.
+ * @return true on success, false if the text is malformed.
+ */
+bool parseSceneText(const std::string& text, Scene& scene, std::vector<Pointlight>& lights, std::string& error);
+
+/**
+ * @brief Describe a scene in the format read by parseSceneText().
+ *        Numbers are written with full precision, so reading the text restores the scene exactly.
+ * @param os The stream to write to.
+ * @param scene The scene.
+ * @param lights The lights of the scene.
+ */
+void writeSceneText(std::ostream& os, const Scene& scene, const std::vector<Pointlight>& lights);
+
+/**
+ * @brief Read a list of cameras from its text description.
+ *
+ *        Every line holds one camera, '#' starts a comment:
+ *
+ *            camera <x y z>                            default view plane, looking along -z
+ *            camera <x y z> <target x y z> <fov>       looking at the target, vertical fov in degrees
+ *
+ * @param text The camera list.
+ * @param aspect Width divided by height of the images.
+ * @param cameras The cameras in the order they appear.
+ * @param error Description of the first malformed line, if any.
+ * @return true on success, false if the text is malformed or holds no camera.
+ */
+bool parseCameraText(const std::string& text, double aspect, std::vector<Camera>& cameras, std::string& error);
+
+/**
+ * @brief Read a whole file into a string.
+ * @param path The file to read.
+ * @param text The content of the file.
+ * @return true on success, false if the file could not be read.
+ */
+bool readTextFile(const std::string& path, std::string& text);
+
+#endif // !scenefile_h
@@ -1,84 +1,39 @@
 #include "sceneobject.h"
 
 #include <cmath>
-#include <tuple>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
 #include <utility>
 
+#include "arena.h"
+#include "bvh.h"
+#include "material.h"
 #include "util.h"
 #include "vec3.h"
-
-static const double pi = std::acos(-1);
-
-/**
- * @brief SceneObject::SceneObject
- */
-SceneObject::SceneObject() :
-    _color(1.0, 1.0, 1.0), _phongCoeff({ _color, _color, Vec3d(1.), 42. })
-{
-}
-
-/**
- * @brief SceneObject::SceneObject
-     * @param color Color of the object, if it is not overwritten by the derived class.
- */
-SceneObject::SceneObject(const Vec3d& color) :
-    _color(color), _phongCoeff({ _color, _color, Vec3d(1.), 42. })
-{
-}
+#include "widebvh.h"
 
 /**
- * @brief Plane::intersect
+ * @brief intersectPlane
  */
-bool Plane::intersect(const Ray& ray, double& t) const
+bool intersectPlane(const PlaneRecord& plane, const Ray& ray, double& t)
 {
-    double denom = this->_normal.dot(ray.dir);
+    double denom = plane.normal.dot(ray.dir);
     if (denom < -1.e-6)   // avoid zero div
     {
-        //Vec3d origin2point = this->_point - ray.origin;
-        Vec3d origin2point = ray.origin - this->_point;
-        t = origin2point.dot(this->_normal) / -denom;
+        //Vec3d origin2point = plane.point - ray.origin;
+        Vec3d origin2point = ray.origin - plane.point;
+        t = origin2point.dot(plane.normal) / -denom;
         return (t >= 0);
     }
     return false;
 }
 
-Vec3d Plane::getSurfaceNormal(const Vec3d& p_hit) const
-{
-    return this->_normal;
-}
-
-/**
- * @brief Plane::getSurfaceColor
- */
-Vec3d Plane::getSurfaceColor(const Vec3d& p_hit) const
-{
-    // generate grey chess board pattern
-    const double freq = 0.125;
-    double s = cos(p_hit[0] * 2. * pi * freq) * cos(p_hit[2] * 2. * pi * freq);
-    return Vec3d(0.2) + (s > 0) * Vec3d(0.4);
-}
-
-PhongCoefficients Plane::getPhongCoefficients(const Vec3d& p_hit) const
-{
-    // generate grey chess board pattern
-    const double freq = 0.125;
-    double s = cos(p_hit[0] * 2. * pi * freq) * cos(p_hit[2] * 2. * pi * freq);
-    Vec3d color = Vec3d(0.2) + (s > 0) * Vec3d(0.4);
-
-    PhongCoefficients phongCoeff;
-    std::get<0>(phongCoeff) = color;
-    std::get<1>(phongCoeff) = color;
-    std::get<2>(phongCoeff) = Vec3d(1.);
-    std::get<3>(phongCoeff) = 42.;
-
-    return phongCoeff;
-}
-
 
 /**
- * @brief Sphere::intersect
+ * @brief intersectSphere
  */
-bool Sphere::intersect(const Ray& ray, double& t) const
+bool intersectSphere(const SphereRecord& sphere, const Ray& ray, double& t)
 {
 
     // Implement a ray-sphere intersection test.
@@ -88,22 +43,22 @@ bool Sphere::intersect(const Ray& ray, double& t) const
 
 #if 0
     // geometric solution
-    Vec3d L = this->_center - ray.origin;
+    Vec3d L = sphere.center - ray.origin;
     double tca = L.dot(ray.dir);
     if (tca < 0)
         return false;
     double d2 = L.dot(L) - tca * tca;
-    if (d2 > this->_radius * this->_radius)
+    if (d2 > sphere.radius * sphere.radius)
         return false;
-    double thc = sqrt(this->_radius * this->_radius - d2);
+    double thc = sqrt(sphere.radius * sphere.radius - d2);
     t0 = tca - thc;
     t1 = tca + thc;
 #else
     // analytic solution
-    Vec3d L = ray.origin - this->_center;
+    Vec3d L = ray.origin - sphere.center;
     double a = ray.dir.dot(ray.dir);
     double b = 2.f * ray.dir.dot(L);
-    double c = L.dot(L) - this->_radius * this->_radius;
+    double c = L.dot(L) - sphere.radius * sphere.radius;
     // solve quadratic function
     double discr = b * b - 4.f * a * c;
     if (discr < 0)
@@ -136,20 +91,356 @@ bool Sphere::intersect(const Ray& ray, double& t) const
     return true;
 }
 
-Vec3d Sphere::getSurfaceNormal(const Vec3d& p_hit) const
+/**
+ * @brief Scene::Scene
+ * @param maxSpheres Maximum number of spheres in the scene.
+ * @param maxPlanes Maximum number of planes in the scene.
+ */
+Scene::Scene(size_t maxSpheres, size_t maxPlanes) :
+    _arena(Arena::bytesFor<SphereRecord>(maxSpheres) + Arena::bytesFor<uint32_t>(maxSpheres) +
+        Arena::bytesFor<PlaneRecord>(maxPlanes) + Arena::bytesFor<uint32_t>(maxPlanes)),
+    _sphereCount(0), _sphereCapacity(maxSpheres), _planeCount(0), _planeCapacity(maxPlanes),
+    _nodes(nullptr), _nodeCount(0), _wideNodes(nullptr), _wideNodeCount(0), _useWide(true)
+{
+    _sphereStorage = _arena.allocate<SphereRecord>(maxSpheres);
+    _sphereMaterialStorage = _arena.allocate<uint32_t>(maxSpheres);
+    _spheres = _sphereStorage;
+    _sphereMaterials = _sphereMaterialStorage;
+    _planes = _arena.allocate<PlaneRecord>(maxPlanes);
+    _planeMaterials = _arena.allocate<uint32_t>(maxPlanes);
+}
+
+/**
+ * @brief Scene::addMaterial
+ */
+uint32_t Scene::addMaterial(const Material& material)
+{
+    _materials.push_back(material);
+    return static_cast<uint32_t>(_materials.size() - 1);
+}
+
+/**
+ * @brief Scene::addSphere
+ */
+void Scene::addSphere(const Vec3d& center, double radius, uint32_t material)
 {
-    return (p_hit - this->_center).normalize();
+    if (_sphereCount == _sphereCapacity || _spheres != _sphereStorage)
+        throw std::length_error("Scene is out of space for spheres.");
+
+    _sphereStorage[_sphereCount].center = center;
+    _sphereStorage[_sphereCount].radius = radius;
+    _sphereMaterialStorage[_sphereCount] = material;
+    // a hierarchy built before no longer covers all spheres
+    _nodeStorage.clear();
+    _nodes = nullptr;
+    _nodeCount = 0;
+    _wideStorage.clear();
+    _wideNodes = nullptr;
+    _wideNodeCount = 0;
+    ++_sphereCount;
 }
 
 /**
- * @brief Sphere::getSurfaceColor
+ * @brief Scene::addPlane
  */
-Vec3d Sphere::getSurfaceColor(const Vec3d& p_hit) const
+void Scene::addPlane(const Vec3d& point, const Vec3d& normal, uint32_t material)
 {
-    return this->_color;
+    if (_planeCount == _planeCapacity)
+        throw std::length_error("Scene is out of space for planes.");
+
+    _planes[_planeCount].point = point;
+    _planes[_planeCount].normal = normal;
+    _planeMaterials[_planeCount] = material;
+    ++_planeCount;
 }
 
-PhongCoefficients Sphere::getPhongCoefficients(const Vec3d& p_hit) const
+/**
+ * @brief Scene::buildAccel
+ */
+void Scene::buildAccel()
 {
-    return this->_phongCoeff;
+    if (_spheres != _sphereStorage)
+        return;   // mapped geometry comes with its hierarchy
+
+    _nodeStorage = buildBVH(_sphereStorage, _sphereMaterialStorage, _sphereCount);
+    _nodes = _nodeStorage.empty() ? nullptr : _nodeStorage.data();
+    _nodeCount = _nodeStorage.size();
+
+    _wideStorage = collapseBVH(_nodes, _nodeCount);
+    _wideNodes = _wideStorage.empty() ? nullptr : _wideStorage.data();
+    _wideNodeCount = _wideStorage.size();
+}
+
+/**
+ * @brief Scene::updateSphere
+ */
+void Scene::updateSphere(uint32_t index, const Vec3d& center, double radius)
+{
+    if (index >= _sphereCount)
+        throw std::out_of_range("There is no sphere with this index.");
+    if (!(radius > 0.))
+        throw std::invalid_argument("The radius of a sphere has to be positive.");
+    if (_spheres != _sphereStorage)
+        throw std::logic_error("Mapped spheres cannot be updated.");
+
+    _sphereStorage[index].center = center;
+    _sphereStorage[index].radius = radius;
+}
+
+/**
+ * @brief Scene::refitAccel
+ */
+void Scene::refitAccel()
+{
+    if (_nodes != _nodeStorage.data() || _nodeStorage.empty())
+        return;   // no hierarchy, or a mapped one, which does not change
+
+    refitBVH(_nodeStorage.data(), _nodeStorage.size(), _sphereStorage);
+
+    // the quantized bounds of the wide nodes are relative to their parents, so they are redone
+    _wideStorage = collapseBVH(_nodes, _nodeCount);
+    _wideNodes = _wideStorage.empty() ? nullptr : _wideStorage.data();
+    _wideNodeCount = _wideStorage.size();
+}
+
+/**
+ * @brief Scene::useMappedGeometry
+ */
+void Scene::useMappedGeometry(std::shared_ptr<MappedFile> mapping, const SphereRecord* spheres,
+    const uint32_t* materials, size_t sphereCount, const BVHNode* nodes, size_t nodeCount,
+    const WideBVHNode* wideNodes, size_t wideNodeCount)
+{
+    _mapping = mapping;
+    _spheres = spheres;
+    _sphereMaterials = materials;
+    _sphereCount = sphereCount;
+    _nodeStorage.clear();
+    _nodes = (nodeCount > 0) ? nodes : nullptr;
+    _nodeCount = nodeCount;
+    _wideStorage.clear();
+    _wideNodes = (wideNodeCount > 0) ? wideNodes : nullptr;
+    _wideNodeCount = wideNodeCount;
+}
+
+/**
+ * @brief Scene::intersect
+ */
+bool Scene::intersect(const Ray& ray, Hit& hit) const
+{
+    double t_near = std::numeric_limits<double>::max();
+    hit = Hit();
+
+    // Check all primitives if they got hit by the traced ray and keep the closest one.
+    if (_wideNodes && _useWide)
+    {
+        if (intersectWideBVH(_wideNodes, _spheres, ray, t_near, hit.index))
+            hit.type = PrimitiveType::Sphere;
+    }
+    else if (_nodes)
+    {
+        if (intersectBVH(_nodes, _spheres, ray, t_near, hit.index))
+            hit.type = PrimitiveType::Sphere;
+    }
+    else
+    {
+        for (size_t i = 0; i < _sphereCount; ++i)
+        {
+            double t = std::numeric_limits<double>::max();
+
+            if (intersectSphere(_spheres[i], ray, t) && t < t_near)
+            {
+                hit.type = PrimitiveType::Sphere;
+                hit.index = static_cast<uint32_t>(i);
+                t_near = t;
+            }
+        }
+    }
+
+    intersectPlanes(ray, t_near, hit);
+
+    hit.t = t_near;
+    return (hit.type != PrimitiveType::None);
+}
+
+/**
+ * @brief Scene::intersect
+ */
+bool Scene::intersect(const Ray& ray, const uint32_t* spheres, size_t count, Hit& hit) const
+{
+    double t_near = std::numeric_limits<double>::max();
+    hit = Hit();
+
+    for (size_t k = 0; k < count; ++k)
+    {
+        double t = std::numeric_limits<double>::max();
+
+        if (intersectSphere(_spheres[spheres[k]], ray, t) && t < t_near)
+        {
+            hit.type = PrimitiveType::Sphere;
+            hit.index = spheres[k];
+            t_near = t;
+        }
+    }
+
+    intersectPlanes(ray, t_near, hit);
+
+    hit.t = t_near;
+    return (hit.type != PrimitiveType::None);
+}
+
+/**
+ * @brief Scene::intersectPlanes
+ */
+void Scene::intersectPlanes(const Ray& ray, double& t_near, Hit& hit) const
+{
+    for (size_t i = 0; i < _planeCount; ++i)
+    {
+        double t = std::numeric_limits<double>::max();
+
+        if (intersectPlane(_planes[i], ray, t) && t < t_near)
+        {
+            hit.type = PrimitiveType::Plane;
+            hit.index = static_cast<uint32_t>(i);
+            t_near = t;
+        }
+    }
+}
+
+/**
+ * @brief Scene::occluded
+ */
+bool Scene::occluded(const Ray& ray, double t_max, Hit& occluder) const
+{
+    occluder = Hit();
+    double t = std::numeric_limits<double>::max();
+
+    // planes are cheap to test and occlude a lot
+    for (size_t i = 0; i < _planeCount; ++i)
+    {
+        if (intersectPlane(_planes[i], ray, t) && t < t_max)
+        {
+            occluder.type = PrimitiveType::Plane;
+            occluder.index = static_cast<uint32_t>(i);
+            occluder.t = t;
+            return true;
+        }
+    }
+
+    bool hit = false;
+    if (_wideNodes && _useWide)
+    {
+        hit = occludedWideBVH(_wideNodes, _spheres, ray, t_max, occluder.index);
+    }
+    else if (_nodes)
+    {
+        hit = occludedBVH(_nodes, _spheres, ray, t_max, occluder.index);
+    }
+    else
+    {
+        for (size_t i = 0; i < _sphereCount && !hit; ++i)
+        {
+            if (intersectSphere(_spheres[i], ray, t) && t < t_max)
+            {
+                occluder.index = static_cast<uint32_t>(i);
+                hit = true;
+            }
+        }
+    }
+
+    if (hit)
+        occluder.type = PrimitiveType::Sphere;
+    return hit;
+}
+
+/**
+ * @brief Scene::intersect
+ */
+void Scene::intersect(const Ray* rays, size_t count, Hit* hits) const
+{
+    const long long n = static_cast<long long>(count);
+
+    #pragma omp parallel for schedule(static, 64)
+    for (long long i = 0; i < n; ++i)
+        intersect(rays[i], hits[i]);
+}
+
+/**
+ * @brief Scene::occluded
+ */
+void Scene::occluded(const Ray* rays, const double* t_max, size_t count, uint8_t* occluded) const
+{
+    const long long n = static_cast<long long>(count);
+
+    #pragma omp parallel for schedule(static, 64)
+    for (long long i = 0; i < n; ++i)
+    {
+        Hit occluder;
+        occluded[i] = this->occluded(rays[i], t_max[i], occluder) ? 1 : 0;
+    }
+}
+
+/**
+ * @brief Scene::intersectPrimitive
+ */
+bool Scene::intersectPrimitive(const Hit& primitive, const Ray& ray, double& t) const
+{
+    if (primitive.type == PrimitiveType::Sphere)
+        return intersectSphere(_spheres[primitive.index], ray, t);
+    if (primitive.type == PrimitiveType::Plane)
+        return intersectPlane(_planes[primitive.index], ray, t);
+    return false;
+}
+
+/**
+ * @brief Scene::geometryHash
+ */
+uint64_t Scene::geometryHash(uint64_t hash) const
+{
+    hash = hashBytes(_spheres, _sphereCount * sizeof(SphereRecord), hash);
+    hash = hashBytes(_sphereMaterials, _sphereCount * sizeof(uint32_t), hash);
+    hash = hashBytes(_planes, _planeCount * sizeof(PlaneRecord), hash);
+    hash = hashBytes(_planeMaterials, _planeCount * sizeof(uint32_t), hash);
+
+    // field by field, the padding of the class is undefined
+    for (const auto& material : _materials)
+    {
+        const double values[11] = { material._color[0], material._color[1], material._color[2],
+            material._secondaryColor[0], material._secondaryColor[1], material._secondaryColor[2],
+            material._specular[0], material._specular[1], material._specular[2],
+            material._shininess, material._frequency };
+        const uint32_t pattern = static_cast<uint32_t>(material._pattern);
+        hash = hashBytes(values, sizeof(values), hash);
+        hash = hashBytes(&pattern, sizeof(pattern), hash);
+    }
+    return hash;
+}
+
+/**
+ * @brief Scene::getSurfaceNormal
+ */
+Vec3d Scene::getSurfaceNormal(const Hit& hit, const Vec3d& p_hit) const
+{
+    if (hit.type == PrimitiveType::Plane)
+        return _planes[hit.index].normal;
+
+    return (p_hit - _spheres[hit.index].center).normalize();
+}
+
+/**
+ * @brief Scene::getMaterial
+ */
+const Material& Scene::getMaterial(const Hit& hit) const
+{
+    return _materials[getMaterialIndex(hit)];
+}
+
+/**
+ * @brief Scene::getMaterialIndex
+ */
+uint32_t Scene::getMaterialIndex(const Hit& hit) const
+{
+    if (hit.type == PrimitiveType::Plane)
+        return _planeMaterials[hit.index];
+
+    return _sphereMaterials[hit.index];
 }
@@ -1,108 +1,335 @@
 #ifndef sceneobject_h
 #define sceneobject_h
 
-#include <tuple>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
+#include "arena.h"
+#include "mappedfile.h"
+#include "material.h"
 #include "util.h"
 #include "vec3.h"
 
-// Store phong coefficient k_a, k_d, k_s and n in a tuple
-typedef std::tuple<Vec3d, Vec3d, Vec3d, double> PhongCoefficients;
+/**
+ * @brief The SphereRecord class.
+ *        A sphere is represented implicitly by a center and a radius. The record holds geometry
+ *        only, so two spheres share one cache line.
+ */
+struct alignas(32) SphereRecord
+{
+    Vec3d center;   //< Center of the sphere.
+    double radius;  //< Radius of the sphere.
+};
+
+/**
+ * @brief The PlaneRecord class.
+ *        A plane is represented by a point on the plane and a normal.
+ */
+struct PlaneRecord
+{
+    Vec3d point;    //< Point on the plane.
+    Vec3d normal;   //< Normal of the plane.
+};
+
+/**
+ * @brief The BVHNode class. A node of the bounding volume hierarchy over the spheres.
+ *        Bounds are stored as floats, rounded outwards. The two children of an inner node
+ *        are always stored next to each other, so one index addresses both.
+ */
+struct BVHNode
+{
+    float bmin[3];      //< lower corner of the bounding box
+    float bmax[3];      //< upper corner of the bounding box
+    uint32_t child;     //< inner node: index of the first child, leaf: index of the first sphere
+    uint32_t count;     //< number of spheres in a leaf, 0 for inner nodes
+};
 
 /**
- * @brief The SceneObject class.
+ * @brief The WideBVHNode class. A node of the 4-wide hierarchy, filling one cache line.
+ *        The bounds of the children are quantized to 8 bits per axis: child i spans
+ *        origin + lo[a][i] * 2^exponent[a] to origin + hi[a][i] * 2^exponent[a] on axis a.
  */
-class SceneObject
+struct alignas(64) WideBVHNode
+{
+    float origin[3];        //< lower corner of the node's bounds
+    int8_t exponent[3];     //< per axis scale of the quantized child bounds
+    uint8_t childCount;     //< number of valid children, at most 4
+    uint8_t lo[3][4];       //< quantized lower child bounds per axis
+    uint8_t hi[3][4];       //< quantized upper child bounds per axis
+    uint32_t child[4];      //< inner child: index of its node, leaf child: index of its first sphere
+    uint8_t count[4];       //< number of spheres of a leaf child, 0 for inner children
+    uint32_t reserved;      //< padding, always 0
+};
+
+/**
+ * @brief Compute the intersection of a sphere with a ray.
+ * @param sphere The sphere to check for intersection.
+ * @param ray The ray to check for intersection.
+ * @param t Distance on the ray of the intersection.
+ * @return true on intersection, false otherwise.
+ */
+bool intersectSphere(const SphereRecord& sphere, const Ray& ray, double& t);
+
+/**
+ * @brief Compute the intersection of a plane with a ray.
+ * @param plane The plane to check for intersection.
+ * @param ray The ray to check for intersection.
+ * @param t Distance on the ray of the intersection.
+ * @return true on intersection, false otherwise.
+ */
+bool intersectPlane(const PlaneRecord& plane, const Ray& ray, double& t);
+
+/**
+ * @brief Kind of primitive referenced by a hit.
+ */
+enum class PrimitiveType : uint32_t
+{
+    None,
+    Sphere,
+    Plane
+};
+
+/**
+ * @brief The Hit class. Result of a closest hit query against the scene.
+ */
+struct Hit
+{
+    Hit() : t(0.), type(PrimitiveType::None), index(0) {}
+
+    double t;               //< Distance on the ray of the intersection.
+    PrimitiveType type;     //< Kind of the primitive that was hit.
+    uint32_t index;         //< Index of the primitive within the records of its kind.
+};
+
+/**
+ * @brief The Scene class.
+ *        All primitive records and their material indices are placed into a single arena.
+ *        Materials live in a separate table shared by the primitives.
+ *        Spheres are intersected through a bounding volume hierarchy once it has been built,
+ *        by default through its 4-wide version with quantized bounds.
+ *        Sphere records and hierarchy may also live in a memory-mapped file.
+ */
+class Scene
 {
 public:
     /**
-     * @brief Construct a white scene object.
+     * @brief Create an empty scene reserving space for a fixed number of primitives.
+     * @param maxSpheres Maximum number of spheres in the scene.
+     * @param maxPlanes Maximum number of planes in the scene.
+     */
+    Scene(size_t maxSpheres, size_t maxPlanes);
+
+    Scene(Scene&&) = default;
+    Scene& operator=(Scene&&) = default;
+
+    /**
+     * @brief Add a material to the material table.
+     * @param material The material to add.
+     * @return The index of the material, used to reference it from primitives.
+     */
+    uint32_t addMaterial(const Material& material);
+
+    /**
+     * @brief Add a sphere to the scene.
+     * @param center Center of the sphere.
+     * @param radius Radius of the sphere.
+     * @param material Index of the sphere's material.
+     */
+    void addSphere(const Vec3d& center, double radius, uint32_t material);
+
+    /**
+     * @brief Add a plane to the scene.
+     * @param point Point on the plane.
+     * @param normal Normal of the plane.
+     * @param material Index of the plane's material.
      */
-    SceneObject();
+    void addPlane(const Vec3d& point, const Vec3d& normal, uint32_t material);
 
     /**
-     * @brief Construct a scene object with user-defined color.
-     * @param color Color of the object, if it is not overwritten by the derived class.
+     * @brief Build the bounding volume hierarchy over all spheres and collapse it into the
+     *        4-wide hierarchy used for traversal.
+     *        Reorders the sphere records, so sphere indices change.
      */
-    SceneObject(const Vec3d& color);
+    void buildAccel();
 
     /**
-     * @brief Destructor
+     * @brief Move or resize a sphere. Call refitAccel() once all spheres are updated.
+     * @param index Index of the sphere, in the order established by buildAccel().
+     * @param center New center of the sphere.
+     * @param radius New radius of the sphere.
+     * @throws std::out_of_range if there is no such sphere.
+     * @throws std::invalid_argument if the radius is not positive.
+     * @throws std::logic_error if the spheres are mapped from a file and thus read-only.
      */
-    virtual ~SceneObject() {}
+    void updateSphere(uint32_t index, const Vec3d& center, double radius);
 
     /**
-     * @brief Pure virtual method to compute the intersection of the scene object with a ray.
+     * @brief Update the bounds of the hierarchy to the spheres changed by updateSphere().
+     *        Much cheaper than buildAccel() and keeps sphere indices, but the hierarchy keeps
+     *        its topology and degrades as spheres move far from where it was built.
+     */
+    void refitAccel();
+
+    /**
+     * @brief Select the hierarchy used for traversal.
+     * @param enabled Trace through the 4-wide hierarchy if true, through the binary one otherwise.
+     */
+    void useWideBVH(bool enabled) { _useWide = enabled; }
+
+    /**
+     * @brief Replace the spheres and their hierarchy by data stored in a mapped file.
+     * @param mapping The mapped file, kept alive as long as the scene uses it.
+     * @param spheres The sphere records within the mapping.
+     * @param materials The material index per sphere within the mapping.
+     * @param sphereCount The number of spheres.
+     * @param nodes The binary hierarchy within the mapping.
+     * @param nodeCount The number of binary hierarchy nodes.
+     * @param wideNodes The 4-wide hierarchy within the mapping.
+     * @param wideNodeCount The number of 4-wide hierarchy nodes.
+     */
+    void useMappedGeometry(std::shared_ptr<MappedFile> mapping, const SphereRecord* spheres,
+        const uint32_t* materials, size_t sphereCount, const BVHNode* nodes, size_t nodeCount,
+        const WideBVHNode* wideNodes, size_t wideNodeCount);
+
+    /**
+     * @brief Find the closest intersection of a ray with any primitive of the scene.
+     * @param ray The ray to trace.
+     * @param hit The closest hit.
+     * @return true on hit, false otherwise.
+     */
+    bool intersect(const Ray& ray, Hit& hit) const;
+
+    /**
+     * @brief Find the closest hits of a batch of rays, distributing the rays over all threads.
+     * @param rays The rays to trace.
+     * @param count The number of rays.
+     * @param hits The closest hit per ray, of type PrimitiveType::None for rays hitting nothing.
+     */
+    void intersect(const Ray* rays, size_t count, Hit* hits) const;
+
+    /**
+     * @brief Find the closest intersection of a ray among a subset of the spheres and all
+     *        planes, testing the spheres one by one instead of traversing the hierarchy.
+     * @param ray The ray to trace.
+     * @param spheres Indices of the spheres to test, in ascending order.
+     * @param count The number of spheres to test.
+     * @param hit The closest hit.
+     * @return true on hit, false otherwise.
+     */
+    bool intersect(const Ray& ray, const uint32_t* spheres, size_t count, Hit& hit) const;
+
+    /**
+     * @brief Check a batch of rays for occlusion, distributing the rays over all threads.
+     * @param rays The rays to trace.
+     * @param t_max Per ray, only hits closer than this count.
+     * @param count The number of rays.
+     * @param occluded Per ray, 1 if the ray is blocked, 0 otherwise.
+     */
+    void occluded(const Ray* rays, const double* t_max, size_t count, uint8_t* occluded) const;
+
+    /**
+     * @brief Check whether any primitive blocks a ray before a given distance.
+     *        Cheaper than intersect(), as the search ends at the first hit.
+     * @param ray The ray to trace.
+     * @param t_max Only hits closer than t_max count, e.g. the distance to a light.
+     * @param occluder The primitive found blocking the ray; its distance is not set for spheres.
+     * @return true if the ray is blocked, false otherwise.
+     */
+    bool occluded(const Ray& ray, double t_max, Hit& occluder) const;
+
+    /**
+     * @brief Intersect a ray with a single primitive.
+     * @param primitive The primitive, as referenced by a hit record.
      * @param ray The ray to check for intersection.
      * @param t Distance on the ray of the intersection.
      * @return true on intersection, false otherwise.
      */
-    virtual bool intersect(const Ray& ray, double& t) const = 0;
-
-    virtual Vec3d getSurfaceNormal(const Vec3d& p_hit) const = 0;
+    bool intersectPrimitive(const Hit& primitive, const Ray& ray, double& t) const;
 
     /**
-     * @brief Pure virtual method to get the surface color of the SceneObject.
+     * @brief Get the surface normal of the primitive that was hit.
+     * @param hit The hit record.
      * @param p_hit The point on the surface that was hit.
-     * @return The surface color of the SceneObject.
+     * @return The normalized surface normal.
      */
-    virtual Vec3d getSurfaceColor(const Vec3d& p_hit) const = 0;
+    Vec3d getSurfaceNormal(const Hit& hit, const Vec3d& p_hit) const;
 
     /**
-    * @brief Pure virtual method to get the surface material properties, i.e. phong coefficients, of the SceneObject.
-    * @param p_hit The point on the surface that was hit.
-    * @return The phong coefficients of the SceneObject.
-    */
-    virtual PhongCoefficients getPhongCoefficients(const Vec3d& p_hit) const = 0;
-
-protected:
-    Vec3d _color;   //< color of the scene object
-    PhongCoefficients _phongCoeff;
-};
+     * @brief Get the material of the primitive that was hit.
+     * @param hit The hit record.
+     * @return The material of the hit primitive.
+     */
+    const Material& getMaterial(const Hit& hit) const;
 
+    /**
+     * @brief Get the index of the material of the primitive that was hit.
+     * @param hit The hit record.
+     * @return The index into the material table.
+     */
+    uint32_t getMaterialIndex(const Hit& hit) const;
 
-/**
- * @brief The Plane class.
- *        A plane is represented by a point on the plane and a normal.
- */
-class Plane : public SceneObject
-{
-public:
-    Plane(const Vec3d& point, const Vec3d& normal) : _point(point), _normal(normal) {}
+    size_t sphereCount() const { return _sphereCount; }
+    size_t planeCount() const { return _planeCount; }
+    size_t materialCount() const { return _materials.size(); }
 
-    bool intersect(const Ray& ray, double& t) const override;
+    const SphereRecord* spheres() const { return _spheres; }
+    const uint32_t* sphereMaterials() const { return _sphereMaterials; }
+    const PlaneRecord* planes() const { return _planes; }
+    const uint32_t* planeMaterials() const { return _planeMaterials; }
+    const Material* materials() const { return _materials.data(); }
 
-    Vec3d getSurfaceNormal(const Vec3d& p_hit) const override;
+    const BVHNode* nodes() const { return _nodes; }
+    size_t nodeCount() const { return _nodeCount; }
+    const WideBVHNode* wideNodes() const { return _wideNodes; }
+    size_t wideNodeCount() const { return _wideNodeCount; }
 
-    Vec3d getSurfaceColor(const Vec3d& p_hit) const override;
+    /**
+     * @brief Hash the geometry and material assignment of all primitives and the material table,
+     *        i.e. everything of the scene that determines the rendered image.
+     * @param hash The hash to continue from.
+     * @return The updated hash.
+     */
+    uint64_t geometryHash(uint64_t hash = HASH_SEED) const;
 
-    PhongCoefficients getPhongCoefficients(const Vec3d& p_hit) const override;
+    /**
+     * @brief Get the number of bytes of the arena occupied by primitive data.
+     */
+    size_t primitiveBytes() const { return _arena.used(); }
 
-    Vec3d _point;   //< Point on the plane.
-    Vec3d _normal;  //< Normal of the plane.
-};
+private:
+    /**
+     * @brief Intersect a ray with all planes, keeping the hit if a plane is closer.
+     */
+    void intersectPlanes(const Ray& ray, double& t_near, Hit& hit) const;
 
+    Arena _arena;                       //< storage of the sphere and plane records
 
-/**
- * @brief The Sphere class.
- *        A sphere is represented implicitly by a center and a radius.
- */
-class Sphere : public SceneObject
-{
-public:
-    Sphere(const Vec3d& center, const double& radius) : _radius(radius), _center(center) {}
-    Sphere(const Vec3d& center, const double& radius, const Vec3d& color) : SceneObject(color), _radius(radius), _center(center) {}
+    SphereRecord* _sphereStorage;       //< sphere geometry in the arena
+    uint32_t* _sphereMaterialStorage;   //< material index per sphere in the arena
+    const SphereRecord* _spheres;       //< spheres in use, the arena or a mapped file
+    const uint32_t* _sphereMaterials;   //< material indices in use
+    size_t _sphereCount;
+    size_t _sphereCapacity;
 
-    bool intersect(const Ray& ray, double& t) const override;
+    PlaneRecord* _planes;               //< plane geometry
+    uint32_t* _planeMaterials;          //< material index per plane
+    size_t _planeCount;
+    size_t _planeCapacity;
 
-    Vec3d getSurfaceNormal(const Vec3d& p_hit) const override;
+    std::vector<Material> _materials;   //< material table
 
-    Vec3d getSurfaceColor(const Vec3d& p_hit) const override;
+    std::vector<BVHNode> _nodeStorage;  //< hierarchy built in memory
+    const BVHNode* _nodes;              //< hierarchy in use, nullptr if there is none
+    size_t _nodeCount;
 
-    PhongCoefficients getPhongCoefficients(const Vec3d& p_hit) const override;
+    std::vector<WideBVHNode> _wideStorage;  //< 4-wide hierarchy built in memory
+    const WideBVHNode* _wideNodes;          //< 4-wide hierarchy in use, nullptr if there is none
+    size_t _wideNodeCount;
+    bool _useWide;                          //< trace through the 4-wide hierarchy if available
 
-    double _radius; //< Radius of the sphere.
-    Vec3d _center;  //< Center of the sphere.
+    std::shared_ptr<MappedFile> _mapping;   //< keeps mapped geometry alive
 };
 
 #endif // !sceneobject_h
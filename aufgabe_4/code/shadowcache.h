@@ -0,0 +1,104 @@
+#ifndef shadowcache_h
+#define shadowcache_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "sceneobject.h"
+#include "util.h"
+
+/**
+ * @brief Counters of the shadow rays answered by a ShadowCache.
+ */
+struct ShadowCacheStats
+{
+    ShadowCacheStats() : rays(0), occluded(0), cacheHits(0), skipped(0) {}
+
+    uint64_t rays;          //< shadow rays cast
+    uint64_t occluded;      //< shadow rays found blocked
+    uint64_t cacheHits;     //< blocked rays answered by the cached occluder alone
+    uint64_t skipped;       //< shadow rays not cast, as the light was too weak to matter
+
+    ShadowCacheStats& operator+=(const ShadowCacheStats& rhs)
+    {
+        rays += rhs.rays;
+        occluded += rhs.occluded;
+        cacheHits += rhs.cacheHits;
+        skipped += rhs.skipped;
+        return *this;
+    }
+};
+
+/**
+ * @brief The ShadowCache class.
+ *        Remembers the primitive that blocked the last shadow ray towards each light.
+ *        Neighbouring pixels usually find the same occluder, so it is tested first and the
+ *        traversal of the scene is skipped if it still blocks the ray. Each thread owns
+ *        its own cache, so no synchronization is needed.
+ */
+class ShadowCache
+{
+public:
+    /**
+     * @brief Create an empty cache.
+     * @param lightCount Number of lights, one occluder is remembered per light.
+     * @param enabled If false, every query traverses the scene.
+     */
+    ShadowCache(size_t lightCount, bool enabled) :
+        _occluders(lightCount), _enabled(enabled)
+    {
+    }
+
+    /**
+     * @brief Check whether a shadow ray towards a light is blocked.
+     * @param scene The scene containing all objects.
+     * @param light Index of the light the ray points to.
+     * @param ray The shadow ray.
+     * @param t_max Distance to the light.
+     * @return true if the light is occluded, false otherwise.
+     */
+    bool occluded(const Scene& scene, size_t light, const Ray& ray, double t_max)
+    {
+        ++_stats.rays;
+
+        Hit& last = _occluders[light];
+        if (_enabled && last.type != PrimitiveType::None)
+        {
+            double t = 0.;
+            if (scene.intersectPrimitive(last, ray, t) && t < t_max)
+            {
+                ++_stats.occluded;
+                ++_stats.cacheHits;
+                return true;
+            }
+        }
+
+        Hit occluder;
+        if (!scene.occluded(ray, t_max, occluder))
+            return false;
+
+        // keep the previous occluder on a miss, the next pixel may be blocked by it again
+        last = occluder;
+        ++_stats.occluded;
+        return true;
+    }
+
+    /**
+     * @brief Count shadow rays that were not cast at all.
+     * @param count Number of skipped shadow rays.
+     */
+    void skip(size_t count) { _stats.skipped += count; }
+
+    /**
+     * @brief Get the counters of all queries so far.
+     */
+    const ShadowCacheStats& stats() const { return _stats; }
+
+private:
+    std::vector<Hit> _occluders;    //< last occluder per light
+    bool _enabled;                  //< test the cached occluder before traversing the scene
+    ShadowCacheStats _stats;        //< counters of all queries
+};
+
+#endif // !shadowcache_h
@@ -0,0 +1,84 @@
+#include "shadowmap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/**
+ * @brief ShadowCubeMap::ShadowCubeMap
+ */
+ShadowCubeMap::ShadowCubeMap(const Scene& scene, const Vec3d& position, int resolution) :
+    _position(position), _resolution(std::max(1, resolution)),
+    _depth(6 * static_cast<size_t>(_resolution) * _resolution, std::numeric_limits<float>::max())
+{
+    const int rows = 6 * _resolution;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int row = 0; row < rows; ++row)
+    {
+        const int face = row / _resolution;
+        const int y = row % _resolution;
+        const int a = face / 2;
+
+        for (int x = 0; x < _resolution; ++x)
+        {
+            Vec3d dir;
+            dir[a] = (face & 1) ? -1. : 1.;
+            dir[(a + 1) % 3] = 2. * (x + 0.5) / _resolution - 1.;
+            dir[(a + 2) % 3] = 2. * (y + 0.5) / _resolution - 1.;
+
+            Ray ray;
+            ray.origin = _position;
+            ray.dir = dir.normalize();
+
+            Hit hit;
+            if (scene.intersect(ray, hit))
+            {
+                const size_t texel = (static_cast<size_t>(face) * _resolution + y) * _resolution + x;
+                _depth[texel] = static_cast<float>(std::min(hit.t, static_cast<double>(std::numeric_limits<float>::max())));
+            }
+        }
+    }
+}
+
+/**
+ * @brief ShadowCubeMap::occluded
+ */
+bool ShadowCubeMap::occluded(const Vec3d& point, double cosine, double bias) const
+{
+    const Vec3d d = point - _position;
+    const double ax = std::abs(d[0]);
+    const double ay = std::abs(d[1]);
+    const double az = std::abs(d[2]);
+    const int a = (ax >= ay) ? ((ax >= az) ? 0 : 2) : ((ay >= az) ? 1 : 2);
+    const double major = std::abs(d[a]);
+    if (major <= 0.)
+        return false;
+
+    const int face = 2 * a + ((d[a] < 0.) ? 1 : 0);
+    const double u = d[(a + 1) % 3] / major;
+    const double v = d[(a + 2) % 3] / major;
+    const int x = std::min(_resolution - 1, std::max(0, static_cast<int>((u + 1.) * 0.5 * _resolution)));
+    const int y = std::min(_resolution - 1, std::max(0, static_cast<int>((v + 1.) * 0.5 * _resolution)));
+
+    // a texel spans at most 2/resolution radians, the depth of a tilted surface changes by tan(angle) across it
+    const double distance = d.length();
+    const double slope = std::min(10., std::sqrt(std::max(0., 1. - cosine * cosine)) / std::max(cosine, 1.e-3));
+    const double offset = bias * (1. + slope) * distance * 2. / _resolution;
+
+    const size_t texel = (static_cast<size_t>(face) * _resolution + y) * _resolution + x;
+    return _depth[texel] < distance - offset;
+}
+
+/**
+ * @brief buildShadowMaps
+ */
+std::vector<ShadowCubeMap> buildShadowMaps(const Scene& scene, const std::vector<Pointlight>& lights,
+    int resolution)
+{
+    std::vector<ShadowCubeMap> maps;
+    maps.reserve(lights.size());
+    for (const auto& light : lights)
+        maps.push_back(ShadowCubeMap(scene, light.getPosition(), resolution));
+    return maps;
+}
@@ -0,0 +1,65 @@
+#ifndef shadowmap_h
+#define shadowmap_h
+
+#include <cstddef>
+#include <vector>
+
+#include "pointlight.h"
+#include "sceneobject.h"
+#include "util.h"
+#include "vec3.h"
+
+/**
+ * @brief The ShadowCubeMap class.
+ *        Depth cube map of a point light, approximating its shadow rays by a texture lookup.
+ *        Each of the six faces covers the directions whose largest component lies on one
+ *        axis; texel (x, y) of the face of axis a looks along a, with the two other axes
+ *        (a+1)%3 and (a+2)%3 spanning [-1,1]. Every texel stores the distance from the light
+ *        to the closest primitive along the ray through its center.
+ */
+class ShadowCubeMap
+{
+public:
+    /**
+     * @brief Build the cube map by casting one ray from the light through every texel.
+     * @param scene The scene containing all objects.
+     * @param position Position of the light.
+     * @param resolution Number of texels along each edge of a face.
+     */
+    ShadowCubeMap(const Scene& scene, const Vec3d& position, int resolution);
+
+    /**
+     * @brief Check whether a point is hidden from the light.
+     *        Neighbouring surfaces are sampled at a texel's center only, so the stored depth may
+     *        lie in front of the point on the very surface it belongs to. The bias, given in
+     *        texel footprints at the point's distance and scaled up for surfaces seen at a
+     *        grazing angle from the light, keeps surfaces from shadowing themselves.
+     * @param point The point to test.
+     * @param cosine Cosine between the surface normal at the point and the direction to the light.
+     * @param bias Depth offset in texels.
+     * @return true if the stored depth is closer to the light than the point, false otherwise.
+     */
+    bool occluded(const Vec3d& point, double cosine, double bias) const;
+
+    /**
+     * @brief Get the number of bytes of the depth texels.
+     */
+    size_t bytes() const { return _depth.size() * sizeof(float); }
+
+private:
+    Vec3d _position;            //< position of the light
+    int _resolution;            //< texels along each edge of a face
+    std::vector<float> _depth;  //< distance to the closest primitive per texel, face by face, row by row
+};
+
+/**
+ * @brief Build the cube maps of all lights.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param resolution Number of texels along each edge of a face.
+ * @return One cube map per light, in the order of the lights.
+ */
+std::vector<ShadowCubeMap> buildShadowMaps(const Scene& scene, const std::vector<Pointlight>& lights,
+    int resolution);
+
+#endif // !shadowmap_h
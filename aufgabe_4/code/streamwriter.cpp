@@ -0,0 +1,97 @@
+#include "streamwriter.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "util.h"
+
+/**
+ * @brief StreamingPPMWriter::StreamingPPMWriter
+ */
+StreamingPPMWriter::StreamingPPMWriter(const std::string& name, const Vec3i& viewport, int tileSize,
+    int window) :
+    _file(name.c_str(), std::ios::out | std::ios::binary),
+    _out(_file),
+    _width(viewport[0]), _height(viewport[1]), _tileSize(tileSize),
+    _tilesX((viewport[0] + tileSize - 1) / tileSize),
+    _tileRows((viewport[1] + tileSize - 1) / tileSize),
+    _window(std::max(1, window)),
+    _buffer(static_cast<size_t>(std::max(1, window)) * viewport[0] * tileSize * 3),
+    _finished(std::max(1, window), 0),
+    _nextRow(0)
+{
+    if (!_file.is_open())
+        std::cerr << "Could not open " << name << " for writing." << std::endl;
+
+    _file << "P6\n" << _width << " " << _height << "\n255\n";
+}
+
+/**
+ * @brief StreamingPPMWriter::StreamingPPMWriter
+ */
+StreamingPPMWriter::StreamingPPMWriter(std::ostream& stream, const Vec3i& viewport, int tileSize, int window) :
+    _out(stream),
+    _width(viewport[0]), _height(viewport[1]), _tileSize(tileSize),
+    _tilesX((viewport[0] + tileSize - 1) / tileSize),
+    _tileRows((viewport[1] + tileSize - 1) / tileSize),
+    _window(std::max(1, window)),
+    _buffer(static_cast<size_t>(std::max(1, window)) * viewport[0] * tileSize * 3),
+    _finished(std::max(1, window), 0),
+    _nextRow(0)
+{
+    _out << "P6\n" << _width << " " << _height << "\n255\n";
+}
+
+/**
+ * @brief StreamingPPMWriter::writeTile
+ */
+void StreamingPPMWriter::writeTile(const Tile& tile, const Vec3d* colors)
+{
+    const int row = tile.y0 / _tileSize;
+    const size_t rowBytes = static_cast<size_t>(_width) * _tileSize * 3;
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // wait until the tile row fits into the window
+    _flushed.wait(lock, [&] { return row < _nextRow + _window; });
+
+    // Quantize into the tile row buffer. This can happen without the lock, as tiles do not
+    // overlap and the buffer is not reused before all tiles of its row are finished.
+    char* rowBuffer = &_buffer[(row % _window) * rowBytes];
+    lock.unlock();
+    for (int j = tile.y0; j < tile.y1; ++j)
+    {
+        char* out = rowBuffer + (static_cast<size_t>(j - tile.y0) * _width + tile.x0) * 3;
+        for (int i = tile.x0; i < tile.x1; ++i, ++colors, out += 3)
+            quantize(*colors, out[0], out[1], out[2]);
+    }
+    lock.lock();
+    ++_finished[row % _window];
+
+    // flush all complete tile rows in order
+    bool advanced = false;
+    while (_nextRow < _tileRows && _finished[_nextRow % _window] == _tilesX)
+    {
+        const int rows = std::min(_tileSize, _height - _nextRow * _tileSize);
+        _out.write(&_buffer[(_nextRow % _window) * rowBytes],
+            static_cast<std::streamsize>(static_cast<size_t>(rows) * _width * 3));
+        _finished[_nextRow % _window] = 0;
+        ++_nextRow;
+        advanced = true;
+    }
+
+    if (advanced)
+    {
+        _out.flush();
+        lock.unlock();
+        _flushed.notify_all();
+    }
+}
+
+/**
+ * @brief StreamingPPMWriter::complete
+ */
+bool StreamingPPMWriter::complete() const
+{
+    return _nextRow == _tileRows && _out.good();
+}
@@ -0,0 +1,84 @@
+#ifndef streamwriter_h
+#define streamwriter_h
+
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "tiles.h"
+#include "vec3.h"
+
+/**
+ * @brief The StreamingPPMWriter class.
+ *        Writes a PPM image tile by tile without ever holding the whole image.
+ *        Finished tiles are quantized into a ring of tile row buffers. As soon as the oldest
+ *        tile row is complete it is flushed to the output, so the image is written in scanline
+ *        order. A thread delivering a tile more than 'window' tile rows ahead of the oldest
+ *        incomplete row blocks until that row has been flushed, which bounds the memory to
+ *        window * width * tileSize * 3 bytes independent of the image height.
+ */
+class StreamingPPMWriter
+{
+public:
+    /**
+     * @brief Open the image file and write the PPM header.
+     * @param name The file name of the ppm file.
+     * @param viewport Size of the image.
+     * @param tileSize Edge length of a tile in pixels.
+     * @param window Number of tile rows buffered at most.
+     */
+    StreamingPPMWriter(const std::string& name, const Vec3i& viewport, int tileSize, int window);
+
+    /**
+     * @brief Write the image to a stream instead of a file, starting with the PPM header.
+     * @param stream The stream, e.g. a connection to a client. It has to outlive the writer.
+     * @param viewport Size of the image.
+     * @param tileSize Edge length of a tile in pixels.
+     * @param window Number of tile rows buffered at most.
+     */
+    StreamingPPMWriter(std::ostream& stream, const Vec3i& viewport, int tileSize, int window);
+
+    StreamingPPMWriter(const StreamingPPMWriter&) = delete;
+    StreamingPPMWriter& operator=(const StreamingPPMWriter&) = delete;
+
+    /**
+     * @brief Hand over a finished tile. Safe to call from several threads.
+     *        Tiles must be delivered in an order such that the tile rows in flight never
+     *        exceed the window, which the row-major order of the TileScheduler guarantees.
+     * @param tile The tile.
+     * @param colors The colors of the tile's pixels, row-major within the tile.
+     */
+    void writeTile(const Tile& tile, const Vec3d* colors);
+
+    /**
+     * @brief Check whether all tile rows have been written successfully.
+     */
+    bool complete() const;
+
+    /**
+     * @brief Get the number of bytes held in tile row buffers.
+     */
+    size_t bufferBytes() const { return _buffer.size(); }
+
+private:
+    std::ofstream _file;            //< the image file, if writing to a file
+    std::ostream& _out;             //< the stream written to, _file or the caller's stream
+    int _width;                     //< image width
+    int _height;                    //< image height
+    int _tileSize;                  //< edge length of a tile
+    int _tilesX;                    //< number of tiles per tile row
+    int _tileRows;                  //< number of tile rows
+    int _window;                    //< number of tile row buffers
+
+    std::mutex _mutex;              //< guards all members below
+    std::condition_variable _flushed;   //< signals that _nextRow advanced
+    std::vector<char> _buffer;      //< 'window' tile rows of quantized pixels
+    std::vector<int> _finished;     //< number of finished tiles per buffered tile row
+    int _nextRow;                   //< oldest tile row not yet written
+};
+
+#endif // !streamwriter_h
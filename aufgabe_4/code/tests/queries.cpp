@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "accelfile.h"
+#include "bvh.h"
+#include "scene.h"
+#include "sceneobject.h"
+#include "util.h"
+#include "vec3.h"
+
+const static size_t SPHERE_COUNT = 2000;    // spheres of the point cloud under test
+const static size_t RAY_COUNT = 20000;      // rays traced per check
+const static unsigned int SEED = 7;
+
+/**
+ * @brief Generate rays from random points of the cloud's surroundings towards random spheres,
+ *        jittered so that some rays miss and some graze the spheres.
+ * @param scene The scene.
+ * @param rng The random generator.
+ * @return The rays.
+ */
+static std::vector<Ray> generateRays(const Scene& scene, std::mt19937& rng)
+{
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    std::uniform_int_distribution<size_t> sphere(0, scene.sphereCount() - 1);
+
+    std::vector<Ray> rays(RAY_COUNT);
+    for (auto& ray : rays)
+    {
+        ray.origin = Vec3d(-8. + 16. * uniform(rng), -4. + 10. * uniform(rng), -20. + 20. * uniform(rng));
+        const SphereRecord& target = scene.spheres()[sphere(rng)];
+        const Vec3d jitter(uniform(rng) - 0.5, uniform(rng) - 0.5, uniform(rng) - 0.5);
+        ray.dir = (target.center + jitter * (4. * target.radius) - ray.origin).normalize();
+    }
+    return rays;
+}
+
+/**
+ * @brief Check two hits for equality, the distance is only compared for actual hits.
+ */
+static bool sameHit(const Hit& a, const Hit& b)
+{
+    return a.type == b.type && (a.type == PrimitiveType::None || (a.index == b.index && a.t == b.t));
+}
+
+/**
+ * @brief Compare the closest hits of rays with the ones of a reference scene.
+ * @param name Name of the check, printed with the result.
+ * @param scene The scene under test.
+ * @param reference The scene giving the expected hits.
+ * @param rays The rays.
+ * @return true if all hits match.
+ */
+static bool compareClosestHits(const std::string& name, const Scene& scene, const Scene& reference,
+    const std::vector<Ray>& rays)
+{
+    size_t mismatches = 0;
+    size_t hits = 0;
+    for (const auto& ray : rays)
+    {
+        Hit hit, expected;
+        scene.intersect(ray, hit);
+        reference.intersect(ray, expected);
+        hits += (expected.type != PrimitiveType::None);
+        mismatches += !sameHit(hit, expected);
+    }
+
+    std::cout << name << ": " << mismatches << " of " << rays.size() << " closest hits differ ("
+        << hits << " rays hit)" << (mismatches ? " -- MISMATCH" : "") << std::endl;
+    return mismatches == 0;
+}
+
+/**
+ * @brief Batched closest hit and occlusion queries return what the single ray queries return,
+ *        through either hierarchy.
+ */
+static bool checkBatchQueries()
+{
+    Scene scene = create_point_cloud(SPHERE_COUNT, SEED);
+    scene.buildAccel();
+
+    std::mt19937 rng(SEED);
+    const std::vector<Ray> rays = generateRays(scene, rng);
+    std::uniform_real_distribution<double> distance(0., 30.);
+    std::vector<double> t_max(rays.size());
+    for (auto& t : t_max)
+        t = distance(rng);
+
+    bool passed = true;
+    for (int wide = 0; wide < 2; ++wide)
+    {
+        scene.useWideBVH(wide != 0);
+        const std::string bvh = wide ? "wide" : "binary";
+
+        std::vector<Hit> hits(rays.size());
+        scene.intersect(rays.data(), rays.size(), hits.data());
+        size_t hitMismatches = 0;
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            Hit expected;
+            scene.intersect(rays[i], expected);
+            hitMismatches += !sameHit(hits[i], expected);
+        }
+
+        std::vector<uint8_t> occluded(rays.size());
+        scene.occluded(rays.data(), t_max.data(), rays.size(), occluded.data());
+        size_t occlusionMismatches = 0;
+        size_t blocked = 0;
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            Hit occluder;
+            const bool expected = scene.occluded(rays[i], t_max[i], occluder);
+            blocked += expected;
+            occlusionMismatches += (occluded[i] != 0) != expected;
+        }
+
+        std::cout << "batch " << bvh << ": " << hitMismatches << " closest hits and " << occlusionMismatches
+            << " occlusion results of " << rays.size() << " rays differ (" << blocked << " blocked)"
+            << ((hitMismatches || occlusionMismatches) ? " -- MISMATCH" : "") << std::endl;
+        passed = passed && hitMismatches == 0 && occlusionMismatches == 0;
+    }
+    return passed;
+}
+
+/**
+ * @brief After moving and resizing spheres and refitting the hierarchy, closest hits match a
+ *        scene of the same primitives searched without a hierarchy.
+ */
+static bool checkRefit()
+{
+    Scene scene = create_point_cloud(SPHERE_COUNT, SEED);
+    scene.buildAccel();
+
+    std::mt19937 rng(SEED);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    for (uint32_t i = 0; i < scene.sphereCount(); ++i)
+    {
+        const SphereRecord& sphere = scene.spheres()[i];
+        const Vec3d offset(uniform(rng) - 0.5, uniform(rng) - 0.5, uniform(rng) - 0.5);
+        scene.updateSphere(i, sphere.center + offset * 2., sphere.radius * (0.5 + uniform(rng)));
+    }
+    scene.refitAccel();
+
+    // same primitives in the same order, intersected one by one
+    Scene reference(scene.sphereCount(), scene.planeCount());
+    const uint32_t material = reference.addMaterial(Material());
+    for (size_t i = 0; i < scene.sphereCount(); ++i)
+        reference.addSphere(scene.spheres()[i].center, scene.spheres()[i].radius, material);
+    for (size_t i = 0; i < scene.planeCount(); ++i)
+        reference.addPlane(scene.planes()[i].point, scene.planes()[i].normal, material);
+
+    const std::vector<Ray> rays = generateRays(scene, rng);
+    scene.useWideBVH(true);
+    const bool wide = compareClosestHits("refit wide", scene, reference, rays);
+    scene.useWideBVH(false);
+    const bool binary = compareClosestHits("refit binary", scene, reference, rays);
+    return wide && binary;
+}
+
+/**
+ * @brief Scene::updateSphere() rejects spheres that are not there or have no positive radius.
+ */
+static bool checkUpdateSphere()
+{
+    Scene scene = create_point_cloud(16, SEED);
+    scene.buildAccel();
+
+    const double radii[3] = { 0., -1., std::numeric_limits<double>::quiet_NaN() };
+    bool passed = true;
+    for (double radius : radii)
+    {
+        try
+        {
+            scene.updateSphere(0, Vec3d(0.), radius);
+            std::cout << "update_sphere: radius " << radius << " accepted -- MISMATCH" << std::endl;
+            passed = false;
+        }
+        catch (const std::invalid_argument&)
+        {
+        }
+    }
+
+    try
+    {
+        scene.updateSphere(16, Vec3d(0.), 1.);
+        std::cout << "update_sphere: index out of range accepted -- MISMATCH" << std::endl;
+        passed = false;
+    }
+    catch (const std::out_of_range&)
+    {
+    }
+
+    if (passed)
+        std::cout << "update_sphere: invalid updates rejected" << std::endl;
+    return passed;
+}
+
+/**
+ * @brief Depth of the deepest leaf below a node of the binary hierarchy.
+ */
+static int hierarchyDepth(const BVHNode* nodes, uint32_t index)
+{
+    if (nodes[index].count > 0)
+        return 0;
+    return 1 + std::max(hierarchyDepth(nodes, nodes[index].child), hierarchyDepth(nodes, nodes[index].child + 1));
+}
+
+/**
+ * @brief Exponentially spaced spheres, whose binned splits peel off one sphere at a time,
+ *        stay within BVH_MAX_DEPTH and are still found through either hierarchy.
+ */
+static bool checkDeepHierarchy()
+{
+    // spanning 1e-34 to 1e34, within the range of the float bounds; binned splits alone
+    // reach a depth of 73
+    const int count = 3200;
+    Scene scene(count, 0);
+    const uint32_t material = scene.addMaterial(Material());
+    for (int i = 0; i < count; ++i)
+    {
+        const double scale = std::pow(1.05, i - count / 2);
+        scene.addSphere(Vec3d(scale, 0., 0.), 0.001 * scale, material);
+    }
+
+    // the reference is searched without a hierarchy, in the order the build leaves behind
+    Scene reference(count, 0);
+    reference.addMaterial(Material());
+    scene.buildAccel();
+    for (size_t i = 0; i < scene.sphereCount(); ++i)
+        reference.addSphere(scene.spheres()[i].center, scene.spheres()[i].radius, material);
+
+    // one ray from above towards every sphere, jittered around its center
+    std::mt19937 rng(SEED);
+    std::uniform_real_distribution<double> uniform(-0.15, 0.15);
+    std::vector<Ray> rays;
+    for (size_t i = 0; i < scene.sphereCount(); ++i)
+    {
+        const SphereRecord& sphere = scene.spheres()[i];
+        Ray ray;
+        ray.origin = sphere.center + Vec3d(0., 10. * sphere.radius, 0.3 * sphere.radius);
+        ray.dir = (sphere.center + Vec3d(uniform(rng), 0., uniform(rng)) * sphere.radius - ray.origin).normalize();
+        rays.push_back(ray);
+    }
+
+    const int depth = hierarchyDepth(scene.nodes(), 0);
+    std::cout << "deep_hierarchy: depth " << depth << " (at most " << BVH_MAX_DEPTH << ")"
+        << (depth > BVH_MAX_DEPTH ? " -- MISMATCH" : "") << std::endl;
+
+    scene.useWideBVH(true);
+    const bool wide = compareClosestHits("deep_hierarchy wide", scene, reference, rays);
+    scene.useWideBVH(false);
+    const bool binary = compareClosestHits("deep_hierarchy binary", scene, reference, rays);
+    return depth <= BVH_MAX_DEPTH && wide && binary;
+}
+
+/**
+ * @brief The acceleration cache is hit for an unchanged scene and missed once a material changes,
+ *        and a scene taken from the cache keeps its materials.
+ */
+static bool checkAccelCache()
+{
+    const std::string directory = ".";
+    Scene original = create_point_cloud(SPHERE_COUNT, SEED);
+    Scene recolored = create_point_cloud(SPHERE_COUNT, SEED);
+    recolored.addMaterial(Material(Vec3d(0.9, 0.1, 0.1)));
+    // building the hierarchy reorders the spheres, so the paths are taken before
+    const std::string originalPath = accelCachePath(directory, original.geometryHash());
+    const std::string recoloredPath = accelCachePath(directory, recolored.geometryHash());
+    std::remove(originalPath.c_str());
+    std::remove(recoloredPath.c_str());
+
+    Scene scene = create_point_cloud(SPHERE_COUNT, SEED);
+    const bool first = loadOrBuildCachedAccel(directory, scene);
+    scene = create_point_cloud(SPHERE_COUNT, SEED);
+    const bool second = loadOrBuildCachedAccel(directory, scene);
+    const bool recoloredHit = loadOrBuildCachedAccel(directory, recolored);
+
+    std::remove(originalPath.c_str());
+    std::remove(recoloredPath.c_str());
+
+    const bool passed = !first && second && !recoloredHit && scene.materialCount() == original.materialCount() &&
+        recolored.materialCount() == original.materialCount() + 1;
+    std::cout << "accel_cache: first " << (first ? "hit" : "miss") << ", unchanged " << (second ? "hit" : "miss")
+        << ", material changed " << (recoloredHit ? "hit" : "miss") << (passed ? "" : " -- MISMATCH") << std::endl;
+    return passed;
+}
+
+/**
+ * @brief A check of the scene queries.
+ */
+struct QueryCase
+{
+    const char* name;   //< name of the test
+    bool (*run)();      //< the check, true if it passed
+};
+
+/**
+ * @brief All cases.
+ */
+static const QueryCase CASES[] =
+{
+    { "batch", checkBatchQueries },
+    { "refit", checkRefit },
+    { "update_sphere", checkUpdateSphere },
+    { "accel_cache", checkAccelCache },
+    { "deep_hierarchy", checkDeepHierarchy },
+};
+
+/**
+ * @brief Consistency test of the scene queries, run by ctest.
+ *        Runs the case given on the command line, or all cases.
+ */
+int main(int argc, char* argv[])
+{
+    const std::string name = (argc > 1) ? argv[1] : "";
+
+    bool found = false;
+    bool passed = true;
+    for (const auto& c : CASES)
+    {
+        if (!name.empty() && name != c.name)
+            continue;
+        found = true;
+        passed = c.run() && passed;
+    }
+
+    if (!found)
+    {
+        std::cerr << "Usage: " << argv[0] << " [case]\nCases:";
+        for (const auto& c : CASES)
+            std::cerr << " " << c.name;
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    return passed ? 0 : 1;
+}
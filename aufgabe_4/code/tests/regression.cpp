@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lodepng/lodepng.h"
+
+#include "camera.h"
+#include "checkpoint.h"
+#include "renderer.h"
+#include "scene.h"
+#include "sceneobject.h"
+#include "tracer.h"
+#include "util.h"
+#include "vec3.h"
+
+const static int CHANNEL_TOLERANCE = 2;         // quantization steps a channel may differ by
+const static double DIFFERING_TOLERANCE = 0.005; // share of pixels allowed to exceed it
+const static int SKIPPED = 77;                  // exit code of a case without baseline, see CMakeLists.txt
+
+/**
+ * @brief A canonical configuration of the default scene, rendered and checked by the suite.
+ */
+struct RegressionCase
+{
+    const char* name;       //< name of the test
+    const char* reference;  //< reference image, relative to the reference directory
+    int width;              //< image resolution
+    int height;
+    int repeat;             //< number of timed renders, the fastest one counts
+    void (*configure)(Scene& scene, ShadingSettings& shading);  //< departure from the defaults
+};
+
+/**
+ * @brief All cases. Every configuration renders the same image up to quantization noise.
+ */
+static const RegressionCase CASES[] =
+{
+    { "default", "referenz.png", 600, 600, 3, [](Scene&, ShadingSettings&) {} },
+    { "hd", "referenz-hd.png", 1600, 1600, 1, [](Scene&, ShadingSettings&) {} },
+    { "binary_bvh", "referenz.png", 600, 600, 3, [](Scene& scene, ShadingSettings&) { scene.useWideBVH(false); } },
+    { "sort_hits", "referenz.png", 600, 600, 3, [](Scene&, ShadingSettings& shading) { shading.sortHits = true; } },
+    { "no_shadow_cache", "referenz.png", 600, 600, 3, [](Scene&, ShadingSettings& shading) { shading.shadowCache = false; } },
+    { "cull_lights", "referenz.png", 600, 600, 3, [](Scene&, ShadingSettings& shading) { shading.lightCulling = true; } },
+    { "tile_culling", "referenz.png", 600, 600, 3, [](Scene&, ShadingSettings& shading) { shading.tileCulling = true; } },
+};
+
+/**
+ * @brief Command line options of the regression test.
+ */
+struct Options
+{
+    Options() : outputDir("."), perfTolerance(0.25), updateBaseline(false), recordMissing(false) {}
+
+    std::string name;           //< case to run
+    std::string references;     //< directory of the reference images
+    std::string baseline;       //< file of the render time baselines, no timing check if empty
+    std::string outputDir;      //< directory receiving the rendered image
+    double perfTolerance;       //< slowdown relative to the baseline that fails the test
+    bool updateBaseline;        //< replace the baseline by the measured time
+    bool recordMissing;         //< record the measured time if the baseline has none yet
+};
+
+/**
+ * @brief Print the command line usage.
+ * @param program Name of the executable.
+ */
+void printUsage(const std::string& program)
+{
+    std::cerr << "Usage: " << program << " <case> --references <dir> [options]\n"
+        << "  --output-dir <dir>       directory the rendered image is written to (default .)\n"
+        << "  --baseline <file>        check the render time against the baseline in this file,\n"
+        << "                           without it only the image is checked\n"
+        << "  --perf-tolerance <fraction>\n"
+        << "                           slowdown against the baseline that fails the test (default 0.25)\n"
+        << "  --update-baseline        store the measured render time as the new baseline\n"
+        << "  --record-missing         store the measured render time if the baseline has none yet,\n"
+        << "                           instead of skipping the test\n"
+        << "Cases:";
+    for (const auto& c : CASES)
+        std::cerr << " " << c.name;
+    std::cerr << std::endl;
+}
+
+/**
+ * @brief Parse the command line.
+ * @param argc Number of arguments.
+ * @param argv The arguments.
+ * @param options The parsed options.
+ * @return true if the command line is valid, false otherwise.
+ */
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+
+        if (arg == "--references" && i + 1 < argc)
+        {
+            options.references = argv[++i];
+        }
+        else if (arg == "--baseline" && i + 1 < argc)
+        {
+            options.baseline = argv[++i];
+        }
+        else if (arg == "--output-dir" && i + 1 < argc)
+        {
+            options.outputDir = argv[++i];
+        }
+        else if (arg == "--perf-tolerance" && i + 1 < argc)
+        {
+            options.perfTolerance = std::atof(argv[++i]);
+        }
+        else if (arg == "--update-baseline")
+        {
+            options.updateBaseline = true;
+        }
+        else if (arg == "--record-missing")
+        {
+            options.recordMissing = true;
+        }
+        else if (options.name.empty() && arg.compare(0, 2, "--") != 0)
+        {
+            options.name = arg;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    // recording a time needs a file to record it in
+    if (options.baseline.empty() && (options.updateBaseline || options.recordMissing))
+        return false;
+
+    return !options.name.empty() && !options.references.empty() && options.perfTolerance >= 0.;
+}
+
+/**
+ * @brief Load the render time baselines, lines of a case name and its time in seconds.
+ *        A missing file holds no baselines yet.
+ * @param path The baseline file.
+ * @param times The baseline per case.
+ */
+void loadBaseline(const std::string& path, std::map<std::string, double>& times)
+{
+    std::ifstream file(path.c_str());
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream in(line);
+        std::string name;
+        double seconds = 0.;
+        if (in >> name >> seconds)
+            times[name] = seconds;
+    }
+}
+
+/**
+ * @brief Save the render time baselines.
+ * @param path The baseline file.
+ * @param times The baseline per case.
+ * @return true on success, false otherwise.
+ */
+bool saveBaseline(const std::string& path, const std::map<std::string, double>& times)
+{
+    std::ofstream file(path.c_str());
+    file << "# fastest render time in seconds per regression case of a Release build on one machine, see tests/regression.cpp\n";
+    for (const auto& entry : times)
+        file << entry.first << " " << entry.second << "\n";
+    return static_cast<bool>(file);
+}
+
+/**
+ * @brief Regression test of the ray tracer.
+ *        Renders one canonical configuration of the default scene and checks the image against
+ *        its reference. Given a baseline, the render time is checked as well. Render times only
+ *        compare on the machine and build type they were recorded with, so the baseline is
+ *        usually local to the build directory. A case without a baseline is reported as skipped,
+ *        unless --update-baseline or --record-missing records one.
+ */
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    const RegressionCase* test = nullptr;
+    for (const auto& c : CASES)
+    {
+        if (options.name == c.name)
+            test = &c;
+    }
+    if (!test)
+    {
+        std::cerr << "There is no case " << options.name << "." << std::endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Scene scene = create_scene_objects();
+    scene.buildAccel();
+    const auto lights = create_scene_lights();
+    ShadingSettings shading;
+    test->configure(scene, shading);
+
+    // Render, keeping the fastest of the repeated runs; an untimed case renders once
+    const bool timed = !options.baseline.empty();
+    const Vec3i viewport(test->width, test->height, 0);
+    const std::string output = options.outputDir + "/regression_" + test->name + ".ppm";
+    double seconds = 0.;
+    for (int i = 0; i < (timed ? test->repeat : 1); ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        render(viewport, scene, lights, Camera(), CropSettings(), AdaptiveSampling(), CheckpointSettings(),
+            output, false, shading);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        seconds = (i == 0) ? elapsed.count() : std::min(seconds, elapsed.count());
+    }
+
+    // Compare the image with the reference
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> image;
+    if (!loadPPM(output, width, height, image))
+    {
+        std::cerr << "Could not read the rendered image " << output << std::endl;
+        return 1;
+    }
+
+    const std::string referencePath = options.references + "/" + test->reference;
+    std::vector<unsigned char> reference;
+    unsigned int referenceWidth = 0;
+    unsigned int referenceHeight = 0;
+    const unsigned int error = lodepng::decode(reference, referenceWidth, referenceHeight, referencePath, LCT_RGB, 8);
+    if (error)
+    {
+        std::cerr << "Could not read the reference image " << referencePath << ": "
+            << lodepng_error_text(error) << std::endl;
+        return 1;
+    }
+    if (referenceWidth != static_cast<unsigned int>(width) || referenceHeight != static_cast<unsigned int>(height))
+    {
+        std::cerr << "The image is " << width << "x" << height << ", the reference "
+            << referenceWidth << "x" << referenceHeight << "." << std::endl;
+        return 1;
+    }
+
+    const ImageDifference difference = compareImages(reference, image, CHANNEL_TOLERANCE);
+    const double differing = static_cast<double>(difference.differing) / difference.pixels;
+    const bool imageMatches = differing <= DIFFERING_TOLERANCE;
+    std::cout << "image: " << 100. * differing << "% of the pixels differ by more than "
+        << CHANNEL_TOLERANCE << " (allowed " << 100. * DIFFERING_TOLERANCE << "%), largest difference "
+        << difference.maxError << ", mean " << difference.meanError
+        << (imageMatches ? "" : " -- MISMATCH") << std::endl;
+
+    if (!timed)
+    {
+        std::cout << "render time: " << seconds << " s, not checked without --baseline" << std::endl;
+        return imageMatches ? 0 : 1;
+    }
+
+    // Compare the render time with the baseline
+    std::map<std::string, double> baseline;
+    loadBaseline(options.baseline, baseline);
+    const auto entry = baseline.find(test->name);
+    bool fastEnough = true;
+    const bool record = options.updateBaseline || (options.recordMissing && entry == baseline.end());
+    if (!record && entry == baseline.end())
+    {
+        std::cout << "render time: " << seconds << " s, no baseline in " << options.baseline
+            << " -- SKIPPED, record one with --update-baseline" << std::endl;
+        return imageMatches ? SKIPPED : 1;
+    }
+
+    if (record)
+    {
+        baseline[test->name] = seconds;
+        if (!saveBaseline(options.baseline, baseline))
+        {
+            std::cerr << "Could not write the baseline " << options.baseline << std::endl;
+            return 1;
+        }
+        std::cout << "render time: " << seconds << " s, recorded as the baseline in "
+            << options.baseline << std::endl;
+    }
+    else
+    {
+        const double ratio = seconds / entry->second;
+        fastEnough = ratio <= 1. + options.perfTolerance;
+        std::cout << "render time: " << seconds << " s, baseline " << entry->second << " s ("
+            << (ratio >= 1. ? "+" : "") << 100. * (ratio - 1.) << "%, allowed +"
+            << 100. * options.perfTolerance << "%)" << (fastEnough ? "" : " -- REGRESSION") << std::endl;
+        if (ratio < 1. - options.perfTolerance)
+            std::cout << "faster than the baseline, consider --update-baseline" << std::endl;
+    }
+
+    return (imageMatches && fastEnough) ? 0 : 1;
+}
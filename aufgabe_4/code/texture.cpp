@@ -0,0 +1,92 @@
+#include "texture.h"
+
+#include <cstdint>
+
+#include "vec3.h"
+
+namespace
+{
+    /**
+     * @brief Permutation and lattice values of the value noise, identical on every platform.
+     */
+    struct NoiseTables
+    {
+        NoiseTables()
+        {
+            // xorshift with a fixed seed, std::shuffle and the distributions differ between standard libraries
+            uint32_t state = 2463534242u;
+            auto next = [&state]()
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                return state;
+            };
+
+            for (int i = 0; i < 256; ++i)
+            {
+                permutation[i] = static_cast<uint8_t>(i);
+                values[i] = (next() >> 8) * (1. / 16777216.);
+            }
+            for (int i = 255; i > 0; --i)
+            {
+                const int j = static_cast<int>(next() % static_cast<uint32_t>(i + 1));
+                const uint8_t swap = permutation[i];
+                permutation[i] = permutation[j];
+                permutation[j] = swap;
+            }
+            for (int i = 0; i < 256; ++i)
+                permutation[i + 256] = permutation[i];
+        }
+
+        /**
+         * @brief Value of a lattice corner.
+         */
+        double corner(int x, int y, int z) const
+        {
+            return values[permutation[permutation[permutation[x] + y] + z]];
+        }
+
+        uint8_t permutation[512];   //< permutation of 0..255, stored twice to skip the wrap-around
+        double values[256];         //< random values in [0,1)
+    };
+
+    const NoiseTables tables;
+
+    /**
+     * @brief Smoothstep weight, 3t^2 - 2t^3.
+     */
+    inline double fade(double t)
+    {
+        return t * t * (3. - 2. * t);
+    }
+
+    inline double lerp(double a, double b, double t)
+    {
+        return a + t * (b - a);
+    }
+}
+
+/**
+ * @brief valueNoise
+ */
+double valueNoise(const Vec3d& p)
+{
+    const int64_t ix = floorToInt(p[0]);
+    const int64_t iy = floorToInt(p[1]);
+    const int64_t iz = floorToInt(p[2]);
+    const double fx = fade(p[0] - static_cast<double>(ix));
+    const double fy = fade(p[1] - static_cast<double>(iy));
+    const double fz = fade(p[2] - static_cast<double>(iz));
+
+    // the lattice repeats every 256 units
+    const int x = static_cast<int>(ix & 255);
+    const int y = static_cast<int>(iy & 255);
+    const int z = static_cast<int>(iz & 255);
+
+    const double y0z0 = lerp(tables.corner(x, y, z), tables.corner(x + 1, y, z), fx);
+    const double y1z0 = lerp(tables.corner(x, y + 1, z), tables.corner(x + 1, y + 1, z), fx);
+    const double y0z1 = lerp(tables.corner(x, y, z + 1), tables.corner(x + 1, y, z + 1), fx);
+    const double y1z1 = lerp(tables.corner(x, y + 1, z + 1), tables.corner(x + 1, y + 1, z + 1), fx);
+    return lerp(lerp(y0z0, y1z0, fy), lerp(y0z1, y1z1, fy), fz);
+}
@@ -0,0 +1,68 @@
+#ifndef texture_h
+#define texture_h
+
+#include <cstdint>
+
+#include "vec3.h"
+
+/**
+ * @brief Round down to the next integer with a truncating conversion instead of a call
+ *        to floor(). Values beyond +-2^62 are clamped, there every double is an even integer.
+ * @param x The value to round.
+ * @return The largest integer not greater than x.
+ */
+static inline int64_t floorToInt(double x)
+{
+    const double limit = 4611686018427387904.;  // 2^62
+    x = (x < -limit) ? -limit : ((x > limit) ? limit : x);
+    const int64_t i = static_cast<int64_t>(x);
+    return i - (static_cast<double>(i) > x);
+}
+
+/**
+ * @brief Check whether a coordinate lies in the 'white' half of a periodic pattern.
+ *        Equals cos(2 pi frequency x) > 0, decided by the parity of the half period the
+ *        coordinate falls into instead of by the cosine.
+ * @param x The coordinate.
+ * @param frequency Number of periods per unit length.
+ * @return true in the first color, false in the second.
+ */
+static inline bool evenBand(double x, double frequency)
+{
+    return (floorToInt(2. * frequency * x + 0.5) & 1) == 0;
+}
+
+/**
+ * @brief Chess board in the xz-plane, fields of 1 / (2 frequency) edge length.
+ * @param p The point on the surface.
+ * @param frequency Number of field pairs per unit length.
+ * @return true in the 'white' fields, false in the 'black' ones.
+ */
+static inline bool checkerPattern(const Vec3d& p, double frequency)
+{
+    return evenBand(p[0], frequency) == evenBand(p[2], frequency);
+}
+
+/**
+ * @brief Stripes orthogonal to the x-axis, in phase with the columns of checkerPattern().
+ * @param p The point on the surface.
+ * @param frequency Number of stripe pairs per unit length.
+ * @return true in the 'white' stripes, false in the 'black' ones.
+ */
+static inline bool stripePattern(const Vec3d& p, double frequency)
+{
+    return evenBand(p[0], frequency);
+}
+
+/**
+ * @brief Smooth 3D value noise.
+ *        The corners of the unit lattice get pseudo random values from a lookup table,
+ *        indexed through a permutation table by the integer coordinates; between them the
+ *        values are blended by smoothstep weights. Both tables are built once at startup,
+ *        so a lookup is eight table reads and no transcendental functions.
+ * @param p The point, scaled by the feature frequency.
+ * @return The noise value in [0,1], repeating every 256 units.
+ */
+double valueNoise(const Vec3d& p);
+
+#endif // !texture_h
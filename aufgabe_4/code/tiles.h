@@ -0,0 +1,140 @@
+#ifndef tiles_h
+#define tiles_h
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+#include "vec3.h"
+
+/**
+ * @brief A rectangular block of pixels [x0,x1) x [y0,y1).
+ */
+struct Tile
+{
+    Tile() : index(0), x0(0), y0(0), x1(0), y1(0) {}
+
+    size_t index;   //< position of the tile in the scheduler's row-major order
+    int x0, y0;     //< first pixel column and row
+    int x1, y1;     //< one past the last pixel column and row
+};
+
+/**
+ * @brief The part of the viewport to render, the pixels [x0,x1) x [y0,y1).
+ *        An empty window stands for the whole viewport.
+ */
+struct CropWindow
+{
+    CropWindow() : x0(0), y0(0), x1(0), y1(0) {}
+    CropWindow(int x0, int y0, int x1, int y1) : x0(x0), y0(y0), x1(x1), y1(y1) {}
+
+    int x0, y0;     //< first pixel column and row
+    int x1, y1;     //< one past the last pixel column and row
+
+    bool empty() const { return x1 <= x0 || y1 <= y0; }
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+
+    /**
+     * @brief Get the window, or the whole viewport if the window is empty.
+     */
+    CropWindow within(const Vec3i& viewport) const
+    {
+        return empty() ? CropWindow(0, 0, viewport[0], viewport[1]) : *this;
+    }
+};
+
+/**
+ * @brief The TileScheduler class.
+ *        Splits the viewport, or a window of it, into square tiles and hands them out in row-major order.
+ *        Worker threads pull tiles until none are left, which balances the load
+ *        between cheap (background) and expensive (reflective) image regions.
+ */
+class TileScheduler
+{
+public:
+    /**
+     * @brief Create a scheduler covering the whole viewport.
+     * @param viewport Size of the framebuffer.
+     * @param tileSize Edge length of a tile in pixels.
+     */
+    TileScheduler(const Vec3i& viewport, int tileSize) :
+        TileScheduler(viewport, tileSize, CropWindow())
+    {
+    }
+
+    /**
+     * @brief Create a scheduler covering a window of the viewport.
+     *        Tiles start at the window's corner and keep their viewport coordinates.
+     * @param viewport Size of the framebuffer.
+     * @param tileSize Edge length of a tile in pixels.
+     * @param window The pixels to cover, the whole viewport if empty.
+     */
+    TileScheduler(const Vec3i& viewport, int tileSize, const CropWindow& window) :
+        _window(window.within(viewport)), _tileSize(tileSize),
+        _tilesX((_window.width() + tileSize - 1) / tileSize),
+        _tilesY((_window.height() + tileSize - 1) / tileSize),
+        _next(0)
+    {
+    }
+
+    /**
+     * @brief Get the total number of tiles.
+     */
+    size_t tileCount() const { return static_cast<size_t>(_tilesX) * _tilesY; }
+
+    /**
+     * @brief Get the number of tiles per row.
+     */
+    int tilesX() const { return _tilesX; }
+
+    /**
+     * @brief Get the number of tile rows.
+     */
+    int tilesY() const { return _tilesY; }
+
+    /**
+     * @brief Get the edge length of a tile in pixels.
+     */
+    int tileSize() const { return _tileSize; }
+
+    /**
+     * @brief Get the pixel bounds of a tile.
+     * @param index Row-major index of the tile.
+     * @return The tile, clipped against the window.
+     */
+    Tile tile(size_t index) const
+    {
+        Tile tile;
+        tile.index = index;
+        tile.x0 = _window.x0 + static_cast<int>(index % _tilesX) * _tileSize;
+        tile.y0 = _window.y0 + static_cast<int>(index / _tilesX) * _tileSize;
+        tile.x1 = std::min(tile.x0 + _tileSize, _window.x1);
+        tile.y1 = std::min(tile.y0 + _tileSize, _window.y1);
+        return tile;
+    }
+
+    /**
+     * @brief Fetch the next unprocessed tile. Safe to call from several threads.
+     * @param tile The next tile.
+     * @return false if all tiles have been handed out.
+     */
+    bool next(Tile& tile)
+    {
+        const size_t index = _next.fetch_add(1);
+        if (index >= tileCount())
+            return false;
+
+        tile = this->tile(index);
+        return true;
+    }
+
+private:
+    CropWindow _window;         //< pixels covered by the tiles
+    int _tileSize;              //< edge length of a tile
+    int _tilesX;                //< number of tiles per row
+    int _tilesY;                //< number of tile rows
+    std::atomic<size_t> _next;  //< index of the next tile to hand out
+};
+
+#endif // !tiles_h
@@ -0,0 +1,126 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "renderserver.h"
+#include "scenefile.h"
+
+static const char* DEFAULT_SOCKET = "/tmp/raytracer.sock";
+
+/**
+ * @brief Command line options of the render client.
+ */
+struct Options
+{
+    Options() : socket(DEFAULT_SOCKET), output("./result.ppm"), shutdown(false) {}
+
+    std::string socket;     //< path of the server's socket
+    std::string scene;      //< scene description, see parseSceneText()
+    std::string output;     //< PPM file receiving the image
+    RenderJob job;          //< resolution, camera and sampling
+    bool shutdown;          //< stop the server instead of rendering
+};
+
+/**
+ * @brief Print the command line usage.
+ * @param program Name of the executable.
+ */
+void printUsage(const std::string& program)
+{
+    std::cerr << "Usage: " << program << " --scene <file> [options]\n"
+        << "       " << program << " --shutdown [--socket <path>]\n"
+        << "  --socket <path>          socket of the render server (default " << DEFAULT_SOCKET << ")\n"
+        << "  --scene <file>           scene description, e.g. written by Raytracer --write-scene\n"
+        << "  --size <width> <height>  image resolution (default 600 600)\n"
+        << "  --camera <x> <y> <z>     camera position (default 0 0 0)\n"
+        << "  --aa <base> <max>        adaptive anti-aliasing with base and maximum samples per pixel\n"
+        << "  --output <file>          PPM image written (default ./result.ppm)\n"
+        << "  --shutdown               stop the render server\n";
+}
+
+/**
+ * @brief Parse the command line.
+ * @return false if the command line is invalid.
+ */
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+
+        if (arg == "--socket" && i + 1 < argc)
+        {
+            options.socket = argv[++i];
+        }
+        else if (arg == "--scene" && i + 1 < argc)
+        {
+            options.scene = argv[++i];
+        }
+        else if (arg == "--size" && i + 2 < argc)
+        {
+            options.job.viewport[0] = std::atoi(argv[++i]);
+            options.job.viewport[1] = std::atoi(argv[++i]);
+        }
+        else if (arg == "--camera" && i + 3 < argc)
+        {
+            const double x = std::atof(argv[++i]);
+            const double y = std::atof(argv[++i]);
+            const double z = std::atof(argv[++i]);
+            options.job.cameraPos = Vec3d(x, y, z);
+        }
+        else if (arg == "--aa" && i + 2 < argc)
+        {
+            options.job.sampling.baseSamples = std::atoi(argv[++i]);
+            options.job.sampling.maxSamples = std::atoi(argv[++i]);
+        }
+        else if (arg == "--output" && i + 1 < argc)
+        {
+            options.output = argv[++i];
+        }
+        else if (arg == "--shutdown")
+        {
+            options.shutdown = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return options.shutdown || (!options.scene.empty() && options.job.viewport[0] > 0 && options.job.viewport[1] > 0);
+}
+
+/**
+ * @brief Command line client of the render server.
+ *        Sends a scene and camera to a running RenderServer and stores the image it streams back.
+ */
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (options.shutdown)
+        return requestShutdown(options.socket) ? 0 : 1;
+
+    std::string text;
+    if (!readTextFile(options.scene, text))
+    {
+        std::cerr << "Could not read the scene " << options.scene << std::endl;
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    bool cached = false;
+    if (!requestRender(options.socket, text, options.job, options.output, cached))
+        return 1;
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "frame received after " << elapsed.count() << " s, the scene was "
+        << (cached ? "cached" : "sent") << std::endl;
+    return 0;
+}
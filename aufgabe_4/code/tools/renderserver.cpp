@@ -0,0 +1,73 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "renderserver.h"
+
+static const char* DEFAULT_SOCKET = "/tmp/raytracer.sock";
+
+/**
+ * @brief Command line options of the render server.
+ */
+struct Options
+{
+    Options() : socket(DEFAULT_SOCKET), cacheSize(4) {}
+
+    std::string socket;     //< path of the Unix domain socket
+    size_t cacheSize;       //< number of scenes kept between jobs
+};
+
+/**
+ * @brief Print the command line usage.
+ * @param program Name of the executable.
+ */
+void printUsage(const std::string& program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+        << "  --socket <path>          socket to listen on (default " << DEFAULT_SOCKET << ")\n"
+        << "  --cache-size <scenes>    number of scenes kept with their hierarchy (default 4)\n";
+}
+
+/**
+ * @brief Parse the command line.
+ * @return false if the command line is invalid.
+ */
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+
+        if (arg == "--socket" && i + 1 < argc)
+        {
+            options.socket = argv[++i];
+        }
+        else if (arg == "--cache-size" && i + 1 < argc)
+        {
+            options.cacheSize = static_cast<size_t>(std::atol(argv[++i]));
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return options.cacheSize > 0;
+}
+
+/**
+ * @brief Render server.
+ *        Keeps running between frames, so scenes are parsed and their hierarchies built only
+ *        once instead of on every launch of the ray tracer. Stop it with RenderClient --shutdown.
+ */
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    return runRenderServer(options.socket, options.cacheSize) ? 0 : 1;
+}
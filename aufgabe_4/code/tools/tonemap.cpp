@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Tone mapping operator applied after the exposure.
+ */
+enum class ToneOperator
+{
+    Clamp,      //< clamp to [0,1], identical to the ray tracer's PPM output
+    Reinhard    //< x / (1 + x)
+};
+
+/**
+ * @brief Command line options of the tone mapper.
+ */
+struct Options
+{
+    Options() : exposure(0.f), gamma(1.f), op(ToneOperator::Clamp), width(0), height(0) {}
+
+    std::string input;  //< .pfm or .raw float image
+    std::string output; //< .ppm image
+    float exposure;     //< exposure correction in stops
+    float gamma;        //< display gamma, 1 keeps the values linear
+    ToneOperator op;    //< tone mapping operator
+    int width;          //< image width, only needed for raw input
+    int height;         //< image height, only needed for raw input
+};
+
+/**
+ * @brief Float RGB image with rows stored top to bottom.
+ */
+struct FloatImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<float> data;    //< interleaved RGB
+};
+
+/**
+ * @brief Print the command line usage.
+ * @param program Name of the executable.
+ */
+void printUsage(const std::string& program)
+{
+    std::cerr << "Usage: " << program << " <input.pfm|input.raw> <output.ppm> [options]\n"
+        << "  --exposure <stops>       scale the values by 2^stops (default 0)\n"
+        << "  --operator clamp|reinhard\n"
+        << "                           tone mapping operator (default clamp)\n"
+        << "  --gamma <gamma>          display gamma (default 1, linear)\n"
+        << "  --size <width> <height>  image size, required for raw input\n";
+}
+
+/**
+ * @brief Parse the command line.
+ * @return true on success, false if an argument was invalid.
+ */
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    if (argc < 3)
+        return false;
+
+    options.input = argv[1];
+    options.output = argv[2];
+
+    for (int i = 3; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+
+        if (arg == "--exposure" && i + 1 < argc)
+        {
+            options.exposure = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if (arg == "--gamma" && i + 1 < argc)
+        {
+            options.gamma = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if (arg == "--operator" && i + 1 < argc)
+        {
+            const std::string op = argv[++i];
+            if (op == "clamp")
+                options.op = ToneOperator::Clamp;
+            else if (op == "reinhard")
+                options.op = ToneOperator::Reinhard;
+            else
+                return false;
+        }
+        else if (arg == "--size" && i + 2 < argc)
+        {
+            options.width = std::atoi(argv[++i]);
+            options.height = std::atoi(argv[++i]);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return options.gamma > 0.f;
+}
+
+/**
+ * @brief Load a color PFM image.
+ * @param name The file name.
+ * @param image The loaded image, flipped to top to bottom row order.
+ * @return true on success.
+ */
+bool loadPFM(const std::string& name, FloatImage& image)
+{
+    std::ifstream file(name.c_str(), std::ios::in | std::ios::binary);
+    std::string magic;
+    double scale = 0.;
+    file >> magic >> image.width >> image.height >> scale;
+    file.get();
+
+    if (!file || magic != "PF" || image.width <= 0 || image.height <= 0)
+        return false;
+
+    const size_t rowSize = static_cast<size_t>(image.width) * 3;
+    image.data.resize(rowSize * image.height);
+    for (int j = image.height - 1; j >= 0; --j)
+    {
+        file.read(reinterpret_cast<char*>(&image.data[j * rowSize]),
+            static_cast<std::streamsize>(rowSize * sizeof(float)));
+    }
+
+    // positive scale marks big endian data
+    if (scale > 0.)
+    {
+        for (auto& value : image.data)
+        {
+            unsigned char bytes[4];
+            std::memcpy(bytes, &value, 4);
+            std::swap(bytes[0], bytes[3]);
+            std::swap(bytes[1], bytes[2]);
+            std::memcpy(&value, bytes, 4);
+        }
+    }
+    return static_cast<bool>(file);
+}
+
+/**
+ * @brief Load raw interleaved RGB floats.
+ * @param name The file name.
+ * @param width Image width.
+ * @param height Image height.
+ * @param image The loaded image.
+ * @return true on success.
+ */
+bool loadRaw(const std::string& name, int width, int height, FloatImage& image)
+{
+    if (width <= 0 || height <= 0)
+        return false;
+
+    std::ifstream file(name.c_str(), std::ios::in | std::ios::binary);
+    image.width = width;
+    image.height = height;
+    image.data.resize(static_cast<size_t>(width) * height * 3);
+    file.read(reinterpret_cast<char*>(image.data.data()),
+        static_cast<std::streamsize>(image.data.size() * sizeof(float)));
+    return static_cast<bool>(file);
+}
+
+/**
+ * @brief Tone map 'count' values into 8 bit.
+ *        Without gamma correction the result is quantized like the ray tracer's saveAsPPM(),
+ *        i.e. truncating 255 * clamp(value, 0, 1). With gamma correction the clamped linear
+ *        value is quantized to 16 bit and mapped through a lookup table.
+ * @param in The input values.
+ * @param out The 8 bit output values.
+ * @param count Number of values.
+ * @param scale Exposure scale factor.
+ * @param op Tone mapping operator.
+ * @param gammaTable 65536 entry table, nullptr for linear output.
+ */
+void tonemapValues(const float* in, unsigned char* out, size_t count, float scale, ToneOperator op,
+    const unsigned char* gammaTable)
+{
+    const float range = gammaTable ? 65535.f : 255.f;
+    size_t k = 0;
+
+#if defined(__SSE2__)
+    const __m128 vScale = _mm_set1_ps(scale);
+    const __m128 vOne = _mm_set1_ps(1.f);
+    const __m128 vZero = _mm_setzero_ps();
+    const __m128 vRange = _mm_set1_ps(range);
+
+    for (; k + 4 <= count; k += 4)
+    {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(in + k), vScale);
+        if (op == ToneOperator::Reinhard)
+            v = _mm_div_ps(v, _mm_add_ps(vOne, _mm_max_ps(v, vZero)));
+        v = _mm_min_ps(_mm_max_ps(v, vZero), vOne);
+        const __m128i q = _mm_cvttps_epi32(_mm_mul_ps(v, vRange));
+
+        if (gammaTable)
+        {
+            int32_t lanes[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), q);
+            out[k + 0] = gammaTable[lanes[0]];
+            out[k + 1] = gammaTable[lanes[1]];
+            out[k + 2] = gammaTable[lanes[2]];
+            out[k + 3] = gammaTable[lanes[3]];
+        }
+        else
+        {
+            const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(q, q), _mm_setzero_si128());
+            const int32_t packed = _mm_cvtsi128_si32(bytes);
+            std::memcpy(out + k, &packed, 4);
+        }
+    }
+#endif
+
+    // scalar remainder (and fallback without SSE2)
+    for (; k < count; ++k)
+    {
+        float v = in[k] * scale;
+        if (op == ToneOperator::Reinhard)
+            v = v / (1.f + std::max(v, 0.f));
+        // like _mm_max_ps(v, 0), NaN becomes 0 instead of reaching the integer conversion
+        if (!(v >= 0.f))
+            v = 0.f;
+        v = std::min(v, 1.f);
+        const int q = static_cast<int>(v * range);
+        out[k] = gammaTable ? gammaTable[q] : static_cast<unsigned char>(q);
+    }
+}
+
+/**
+ * @brief Tone map a float image into an 8 bit PPM. Rows are processed in parallel.
+ * @param image The float image.
+ * @param options Exposure, operator and gamma.
+ * @return The interleaved 8 bit RGB pixels.
+ */
+std::vector<unsigned char> tonemap(const FloatImage& image, const Options& options)
+{
+    std::vector<unsigned char> gammaTable;
+    if (options.gamma != 1.f)
+    {
+        gammaTable.resize(65536);
+        for (size_t q = 0; q < gammaTable.size(); ++q)
+        {
+            const double v = std::pow(q / 65535., 1. / options.gamma);
+            gammaTable[q] = static_cast<unsigned char>(255. * v);
+        }
+    }
+
+    const float scale = std::pow(2.f, options.exposure);
+    const size_t rowSize = static_cast<size_t>(image.width) * 3;
+    std::vector<unsigned char> pixels(rowSize * image.height);
+
+    #pragma omp parallel for
+    for (int j = 0; j < image.height; ++j)
+    {
+        tonemapValues(&image.data[j * rowSize], &pixels[j * rowSize], rowSize, scale, options.op,
+            gammaTable.empty() ? nullptr : gammaTable.data());
+    }
+    return pixels;
+}
+
+/**
+ * @brief Tone mapping tool.
+ *        Turns the float output of the ray tracer (--output result.pfm or result.raw)
+ *        into a PPM image, so exposure and tone mapping can be changed without re-rendering.
+ */
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    FloatImage image;
+    const bool isRaw = options.input.size() > 4 && options.input.substr(options.input.size() - 4) == ".raw";
+    if (!(isRaw ? loadRaw(options.input, options.width, options.height, image) : loadPFM(options.input, image)))
+    {
+        std::cerr << "Could not read float image " << options.input << std::endl;
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::vector<unsigned char> pixels = tonemap(image, options);
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::ofstream os(options.output.c_str(), std::ios::out | std::ios::binary);
+    os << "P6\n" << image.width << " " << image.height << "\n255\n";
+    os.write(reinterpret_cast<const char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+    if (!os)
+    {
+        std::cerr << "Could not write " << options.output << std::endl;
+        return 1;
+    }
+
+    std::cout << "tone mapped " << image.width << "x" << image.height << " pixels in "
+        << elapsed.count() << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,566 @@
+#include "tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+//////////
+// TODO 2:
+// Compute Phong lighting
+//
+Vec3d computePhongLighting(
+    Vec3d const& view_direction,
+    Vec3d const& surface_normal,
+    Vec3d const& light_direction,
+    PhongCoefficients const& phong_coeff,
+    Vec3d const& light_color,
+    double light_intensity)
+{
+    Vec3d n = surface_normal; n.normalize();
+    Vec3d v = view_direction; v.normalize();
+    Vec3d l = light_direction; l.normalize();
+
+    Vec3d I_ambient = std::get<0>(phong_coeff) * light_intensity;
+    double diff = std::max(0.0, n.dot(l));
+    Vec3d I_diffuse = std::get<1>(phong_coeff) * diff * light_intensity;
+    Vec3d r = (-l).reflect(n);
+    double spec_angle = std::max(0.0, r.dot(v));
+    double spec = pow(spec_angle, std::get<3>(phong_coeff));
+    Vec3d I_specular = light_color * std::get<2>(phong_coeff) * spec * light_intensity;
+
+    return I_ambient + I_diffuse + I_specular;
+}
+
+/**
+ * @brief lightOccluded
+ */
+bool lightOccluded(const Scene& scene, size_t light, const Ray& shadowRay, const Vec3d& normal, double distance,
+    TraceContext& context)
+{
+    if (!context.settings.shadows)
+        return false;
+    if (context.settings.shadowMaps)
+        return (*context.settings.shadowMaps)[light].occluded(shadowRay.origin, shadowRay.dir.dot(normal), context.settings.shadowMapBias);
+
+    return context.shadows.occluded(scene, light, shadowRay, distance);
+}
+
+/**
+ * @brief Occlusion test of the generic tracer, following the settings at runtime.
+ */
+struct SettingsOcclusion
+{
+    static bool occluded(const Scene& scene, size_t light, const Ray& shadowRay, const Vec3d& normal,
+        double distance, TraceContext& context)
+    {
+        return lightOccluded(scene, light, shadowRay, normal, distance, context);
+    }
+};
+
+/**
+ * @brief Occlusion test of the fixed kernels, which never use shadow maps: a shadow ray if
+ *        'Shadows' is set, no test at all otherwise.
+ */
+template <bool Shadows>
+struct FixedOcclusion
+{
+    static bool occluded(const Scene& scene, size_t light, const Ray& shadowRay, const Vec3d&,
+        double distance, TraceContext& context)
+    {
+        return Shadows && context.shadows.occluded(scene, light, shadowRay, distance);
+    }
+};
+
+/**
+ * @brief Half of the quantization step of the 8 bit output.
+ */
+static const double HALF_QUANTIZATION_STEP = 0.5 / 255.;
+
+/**
+ * @brief Number of power of two buckets the light culling orders the weak lights by.
+ */
+static const int LIGHT_CULLING_BUCKETS = 32;
+
+/**
+ * @brief shadeCulled() with the occlusion test given by 'Occlusion' and the maximum depth,
+ *        which splits the error budget, given by the caller.
+ */
+template <typename Occlusion>
+static Vec3d shadeCulled(const Vec3d& p_hit, const Vec3d& surface_normal, const Vec3d& view_direction,
+    const PhongCoefficients& phong, const Scene& scene, const std::vector<Pointlight>& lights,
+    double weight, int maxDepth, TraceContext& context)
+{
+    Vec3d color;
+    std::vector<LightContribution>& contributions = context.contributions;
+    contributions.clear();
+
+    for (size_t l = 0; l < lights.size(); ++l)
+    {
+        LightContribution c;
+        c.light = l;
+        c.dir = lights[l].getPosition() - p_hit;
+        c.distance = c.dir.length();
+        c.dir.normalize();
+
+        const double intensity = lights[l].getIntensity() / (c.distance * c.distance);
+        const Vec3d ambient = std::get<0>(phong) * intensity;
+        color += ambient;
+
+        c.direct = computePhongLighting(view_direction, surface_normal, c.dir, phong, lights[l].getColor(), intensity) - ambient;
+        c.bound = std::max(c.direct[0], std::max(c.direct[1], c.direct[2]));
+        c.culled = false;
+        if (c.bound > 0.)
+            contributions.push_back(c);
+    }
+
+    // lights not reaching the surface at all need no shadow ray either
+    context.shadows.skip(lights.size() - contributions.size());
+
+    // Cull the weakest lights as long as their sum stays below the tolerance.
+    // Every bounce of the path may add its own error, so the budget is split between them.
+    // Instead of sorting, the lights are ordered by bound in power of two buckets: whole
+    // buckets are culled from the weakest up, the first bucket that does not fit any more
+    // is culled in light order as far as the budget allows.
+    const double tolerance = HALF_QUANTIZATION_STEP / (std::max(maxDepth, 0) + 1) / std::max(weight, 1.e-12);
+    double bucketBounds[LIGHT_CULLING_BUCKETS] = { 0. };
+    for (auto& c : contributions)
+    {
+        int exponent = 1;
+        std::frexp(c.bound / tolerance, &exponent);
+        c.bucket = std::max(exponent, 1 - LIGHT_CULLING_BUCKETS);
+        if (c.bucket <= 0)
+            bucketBounds[-c.bucket] += c.bound;
+    }
+
+    double culledBound = 0.;
+    int partialBucket = 1 - LIGHT_CULLING_BUCKETS;
+    for (int b = LIGHT_CULLING_BUCKETS - 1; b >= 0; --b, ++partialBucket)
+    {
+        if (culledBound + bucketBounds[b] > tolerance)
+            break;
+        culledBound += bucketBounds[b];
+    }
+
+    Vec3d culled;
+    for (auto& c : contributions)
+    {
+        if (c.bucket < partialBucket ||
+            (c.bucket == partialBucket && c.bucket <= 0 && culledBound + c.bound <= tolerance))
+        {
+            if (c.bucket == partialBucket)
+                culledBound += c.bound;
+            culled += c.direct;
+            c.culled = true;
+        }
+    }
+    color += culled * 0.5;
+
+    for (const auto& c : contributions)
+    {
+        if (c.culled)
+        {
+            context.shadows.skip(1);
+            continue;
+        }
+
+        Ray shadowRay;
+        shadowRay.origin = p_hit + surface_normal * 1e-4;
+        shadowRay.dir = c.dir;
+        if (!Occlusion::occluded(scene, c.light, shadowRay, surface_normal, c.distance, context))
+            color += c.direct;
+    }
+
+    return color;
+}
+
+/**
+ * @brief shadeCulled
+ */
+Vec3d shadeCulled(const Vec3d& p_hit, const Vec3d& surface_normal, const Vec3d& view_direction,
+    const PhongCoefficients& phong, const Scene& scene, const std::vector<Pointlight>& lights,
+    double weight, TraceContext& context)
+{
+    return shadeCulled<SettingsOcclusion>(p_hit, surface_normal, view_direction, phong, scene, lights,
+        weight, context.settings.maxDepth, context);
+}
+
+/**
+ * @brief shadeSampled
+ */
+Vec3d shadeSampled(const Vec3d& p_hit, const Vec3d& surface_normal, const Vec3d& view_direction,
+    const PhongCoefficients& phong, const Scene& scene, const std::vector<Pointlight>& lights,
+    TraceContext& context)
+{
+    const size_t lightCount = lights.size();
+    const size_t candidateCount = static_cast<size_t>(std::max(1, context.settings.lightCandidates));
+    const bool allLights = lightCount <= candidateCount;
+    const size_t streamLength = allLights ? lightCount : candidateCount;
+
+    // a light drawn with probability 1/lightCount in candidateCount draws stands for lightCount/candidateCount lights
+    const double candidateScale = allLights ? 1. : static_cast<double>(lightCount) / candidateCount;
+
+    std::vector<LightReservoir>& reservoirs = context.reservoirs;
+    reservoirs.assign(static_cast<size_t>(context.settings.lightSamples), LightReservoir());
+    double weightSum = 0.;
+
+    for (size_t k = 0; k < streamLength; ++k)
+    {
+        const size_t l = allLights ? k :
+            std::min(lightCount - 1, static_cast<size_t>(context.random.next() * lightCount));
+
+        LightContribution c;
+        c.light = l;
+        c.dir = lights[l].getPosition() - p_hit;
+        c.distance = c.dir.length();
+        c.dir.normalize();
+        c.culled = false;
+
+        const double intensity = lights[l].getIntensity() / (c.distance * c.distance);
+        const Vec3d ambient = std::get<0>(phong) * intensity;
+        const Vec3d unshadowed = computePhongLighting(view_direction, surface_normal, c.dir, phong, lights[l].getColor(), intensity);
+        c.direct = unshadowed - ambient;
+        c.bound = std::max(c.direct[0], std::max(c.direct[1], c.direct[2]));
+
+        // a light contributing nothing even when visible is never picked
+        const double target = std::max(unshadowed[0], std::max(unshadowed[1], unshadowed[2]));
+        if (target <= 0.)
+            continue;
+
+        // every reservoir independently replaces its light with probability weight / weightSum
+        const double weight = target * candidateScale;
+        weightSum += weight;
+        for (auto& reservoir : reservoirs)
+        {
+            if (context.random.next() * weightSum < weight)
+            {
+                reservoir.selected = c;
+                reservoir.ambient = ambient;
+                reservoir.target = target;
+            }
+        }
+    }
+
+    if (weightSum <= 0.)
+        return Vec3d();
+
+    Vec3d color;
+    for (const auto& reservoir : reservoirs)
+    {
+        const LightContribution& c = reservoir.selected;
+        Vec3d sample = reservoir.ambient;
+        if (c.bound > 0.)
+        {
+            Ray shadowRay;
+            shadowRay.origin = p_hit + surface_normal * 1e-4;
+            shadowRay.dir = c.dir;
+            if (!lightOccluded(scene, c.light, shadowRay, surface_normal, c.distance, context))
+                sample += c.direct;
+        }
+        color += sample * (weightSum / reservoir.target);
+    }
+    return color / static_cast<double>(reservoirs.size());
+}
+
+/**
+ * @brief Compute the local lighting of a hit point from every light, each tested for
+ *        occlusion by 'Occlusion'.
+ */
+template <typename Occlusion>
+static Vec3d shadeAllLights(const Vec3d& p_hit, const Vec3d& surface_normal, const Vec3d& view_direction,
+    const PhongCoefficients& phong, const Scene& scene, const std::vector<Pointlight>& lights,
+    TraceContext& context)
+{
+    Vec3d color;
+    for (size_t l = 0; l < lights.size(); ++l)
+    {
+        const Pointlight& light = lights[l];
+        Vec3d lightDir = light.getPosition() - p_hit;
+        double distToLight = lightDir.length();
+        lightDir = lightDir; lightDir.normalize();
+
+        Ray shadowRay;
+        shadowRay.origin = p_hit + surface_normal * 1e-4;
+        shadowRay.dir = lightDir;
+
+        bool inShadow = Occlusion::occluded(scene, l, shadowRay, surface_normal, distToLight, context);
+
+        double intensity = light.getIntensity() / (distToLight * distToLight);
+
+        if (!inShadow)
+        {
+            color += computePhongLighting(
+                view_direction,
+                surface_normal,
+                lightDir,
+                phong,
+                light.getColor(),
+                intensity
+            );
+        }
+        else
+        {
+            color += std::get<0>(phong) * intensity; // ambient
+        }
+    }
+
+    return color;
+}
+
+/**
+ * @brief shadeLocal
+ */
+Vec3d shadeLocal(const Vec3d& p_hit, const Vec3d& surface_normal, const Vec3d& view_direction,
+    const PhongCoefficients& phong, const Scene& scene, const std::vector<Pointlight>& lights,
+    double weight, TraceContext& context)
+{
+    Vec3d color;
+    if (context.settings.lightSamples > 0)
+    {
+        color += shadeSampled(p_hit, surface_normal, view_direction, phong, scene, lights,
+            context);
+    }
+    else if (context.settings.lightCulling && context.settings.shadows)
+    {
+        color += shadeCulled(p_hit, surface_normal, view_direction, phong, scene, lights,
+            weight, context);
+    }
+    else if (context.settings.shadows)
+    {
+        color += shadeAllLights<SettingsOcclusion>(p_hit, surface_normal, view_direction, phong, scene, lights, context);
+    }
+    else
+    {
+        color += shadeAllLights<FixedOcclusion<false> >(p_hit, surface_normal, view_direction, phong, scene, lights, context);
+    }
+
+    return color;
+}
+
+/**
+ * @brief Cast a ray into the scene. If the ray hits at least one object,
+ *        the color of the object closest to the camera is returned.
+ * @param ray The ray that's being cast.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param context State of the calling thread.
+ * @param weight Weight of the ray's color in the pixel, the product of the reflection
+ *        coefficients along the path. Used to bound the error of the light culling.
+ * @return The color of a hit object that is closest to the camera.
+ *         Return dark blue if no object was hit.
+ */
+Vec3d castRay(const Ray& ray, const Scene& scene, const std::vector<Pointlight>& lights, TraceContext& context,
+    double weight)
+{
+    // early exit if maximum recursive depth is reached - return background color
+    if (ray.depth > context.settings.maxDepth)
+        return BACKGROUND_COLOR;
+
+    // the closest primitive hit by the ray
+    Hit hit;
+
+    // Trace the ray. If an object gets hit, shade it with the surface properties of its material
+    if (!scene.intersect(ray, hit))
+        return BACKGROUND_COLOR;
+
+    return shadeHit(ray, hit, scene, lights, context, weight);
+}
+
+/**
+ * @brief Shade the closest hit of a ray: the local lighting plus the reflection.
+ * @param ray The ray that hit the primitive.
+ * @param hit The closest hit of the ray.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param context State of the calling thread.
+ * @param weight Weight of the ray's color in the pixel.
+ * @return The color of the hit point.
+ */
+Vec3d shadeHit(const Ray& ray, const Hit& hit, const Scene& scene, const std::vector<Pointlight>& lights,
+    TraceContext& context, double weight)
+{
+    Vec3d hitColor;
+
+    // Intersection point with the hit object, with the surface properties of its material
+    const Vec3d p_hit = ray.origin + ray.dir * hit.t;
+    const Vec3d surface_normal = scene.getSurfaceNormal(hit, p_hit);
+    const PhongCoefficients phong = scene.getMaterial(hit).getPhongCoefficients(p_hit);
+
+    //////////
+    // TODO 3:
+    // Compute local lighting. The result is added to "hitColor".
+    //
+    // For each light source (given by funtion parameter lights)
+    //
+    //   a) Cast a shadow ray from the hitpoint to the light-source (use the trace function)
+    //
+    //   b) If not in shadow, compute local lighting using the function "computePhongLighting"
+    //      Else apply ambient term only
+    //
+    //      For a more realistic image, use inverse square attentuation for the light intensity.
+    //
+    
+    hitColor += shadeLocal(p_hit, surface_normal, (ray.origin - p_hit).normalize(), phong, scene, lights,
+        weight, context);
+
+    // END TODO 3
+    /////////////
+
+    //////////
+    // TODO 4:
+    // Compute reflection.
+    //
+    // Build a reflection for the hitpoint of the hit object. 
+    // Use this ray to make a recursive call to "castRay" and add the result of the call to "hitColor".
+    //
+    
+    if (std::get<2>(phong).length() > 0.0) // k_s > 0
+    {
+        Vec3d v = (ray.origin - p_hit).normalize();
+        Vec3d r = (-v).reflect(surface_normal).normalize();
+
+        Ray reflectionRay;
+        reflectionRay.origin = p_hit + surface_normal * 1e-4;
+        reflectionRay.dir = r;
+        reflectionRay.depth = ray.depth + 1;
+
+        const Vec3d& k_s = std::get<2>(phong);
+        hitColor += k_s * castRay(reflectionRay, scene, lights, context,
+            weight * std::max(k_s[0], std::max(k_s[1], k_s[2])));
+    }
+
+
+    // END TODO 4
+    /////////////
+
+    return hitColor;
+}
+
+namespace
+{
+    /**
+     * @brief castRay() and shadeHit() compiled for a fixed configuration.
+     *        'Remaining' counts the reflections still allowed, so a ray of depth d is traced by
+     *        FixedTracer<maxDepth - d>. The recursion ends at the specialization for -1, which
+     *        returns the background like castRay() does beyond the maximum depth.
+     *        Neither the shading nor the occlusion test read the settings, every decision is
+     *        made by the template arguments.
+     */
+    template <int Remaining, int MaxDepth, bool Shadows, bool Culling>
+    struct FixedTracer
+    {
+        static Vec3d trace(const Ray& ray, const Scene& scene, const std::vector<Pointlight>& lights,
+            TraceContext& context, double weight)
+        {
+            Hit hit;
+            if (!scene.intersect(ray, hit))
+                return BACKGROUND_COLOR;
+
+            return shade(ray, hit, scene, lights, context, weight);
+        }
+
+        static Vec3d shade(const Ray& ray, const Hit& hit, const Scene& scene, const std::vector<Pointlight>& lights,
+            TraceContext& context, double weight)
+        {
+            Vec3d hitColor;
+
+            const Vec3d p_hit = ray.origin + ray.dir * hit.t;
+            const Vec3d surface_normal = scene.getSurfaceNormal(hit, p_hit);
+            const PhongCoefficients phong = scene.getMaterial(hit).getPhongCoefficients(p_hit);
+            const Vec3d view_direction = (ray.origin - p_hit).normalize();
+
+            if (Culling)
+            {
+                hitColor += shadeCulled<FixedOcclusion<Shadows> >(p_hit, surface_normal, view_direction, phong,
+                    scene, lights, weight, MaxDepth, context);
+            }
+            else
+            {
+                hitColor += shadeAllLights<FixedOcclusion<Shadows> >(p_hit, surface_normal, view_direction, phong,
+                    scene, lights, context);
+            }
+
+            if (std::get<2>(phong).length() > 0.0) // k_s > 0
+            {
+                Vec3d r = (-view_direction).reflect(surface_normal).normalize();
+
+                Ray reflectionRay;
+                reflectionRay.origin = p_hit + surface_normal * 1e-4;
+                reflectionRay.dir = r;
+                reflectionRay.depth = ray.depth + 1;
+
+                const Vec3d& k_s = std::get<2>(phong);
+                hitColor += k_s * FixedTracer<Remaining - 1, MaxDepth, Shadows, Culling>::trace(reflectionRay, scene, lights,
+                    context, weight * std::max(k_s[0], std::max(k_s[1], k_s[2])));
+            }
+
+            return hitColor;
+        }
+    };
+
+    template <int MaxDepth, bool Shadows, bool Culling>
+    struct FixedTracer<-1, MaxDepth, Shadows, Culling>
+    {
+        static Vec3d trace(const Ray&, const Scene&, const std::vector<Pointlight>&, TraceContext&, double)
+        {
+            return BACKGROUND_COLOR;
+        }
+    };
+
+    /**
+     * @brief The kernels of a fixed configuration.
+     */
+    template <int MaxDepth, bool Shadows, bool Culling>
+    TraceKernels fixedKernels()
+    {
+        TraceKernels kernels;
+        kernels.castRay = &FixedTracer<MaxDepth, MaxDepth, Shadows, Culling>::trace;
+        kernels.shadeHit = &FixedTracer<MaxDepth, MaxDepth, Shadows, Culling>::shade;
+        kernels.specialized = true;
+        return kernels;
+    }
+
+    /**
+     * @brief Select the shading variant of the kernels of a reflection depth.
+     */
+    template <int MaxDepth>
+    TraceKernels fixedKernels(const ShadingSettings& settings)
+    {
+        if (!settings.shadows)
+            return fixedKernels<MaxDepth, false, false>();
+        if (settings.lightCulling)
+            return fixedKernels<MaxDepth, true, true>();
+        return fixedKernels<MaxDepth, true, false>();
+    }
+}
+
+/**
+ * @brief selectTraceKernels
+ */
+TraceKernels selectTraceKernels(const ShadingSettings& settings)
+{
+    TraceKernels generic;
+    generic.castRay = &castRay;
+    generic.shadeHit = &shadeHit;
+    generic.specialized = false;
+
+    // light sampling and shadow maps keep their runtime paths
+    if (!settings.specializedKernels || settings.lightSamples > 0 || settings.shadowMaps ||
+        settings.shadowMapResolution > 0)
+    {
+        return generic;
+    }
+
+    switch (settings.maxDepth)
+    {
+    case 0:
+        return fixedKernels<0>(settings);
+    case 1:
+        return fixedKernels<1>(settings);
+    case 2:
+        return fixedKernels<2>(settings);
+    case MAX_DEPTH:
+        return fixedKernels<MAX_DEPTH>(settings);
+    default:
+        return generic;
+    }
+}
@@ -0,0 +1,251 @@
+#ifndef tracer_h
+#define tracer_h
+
+#include <cstddef>
+#include <vector>
+
+#include "material.h"
+#include "pointlight.h"
+#include "sceneobject.h"
+#include "shadowcache.h"
+#include "shadowmap.h"
+#include "util.h"
+#include "vec3.h"
+
+const static int MAX_DEPTH = 5;                 // maximum number of reflections along a path
+
+/**
+ * @brief Color of the rays leaving the scene, dark blue.
+ */
+static const Vec3d BACKGROUND_COLOR(0., 0., 0.2);
+
+/**
+ * @brief Compute the Phong lighting of a surface point by a single light.
+ * @param view_direction Direction from the surface point towards the viewer.
+ * @param surface_normal The surface normal.
+ * @param light_direction Direction from the surface point towards the light.
+ * @param phong_coeff The phong coefficients of the surface.
+ * @param light_color The color of the light.
+ * @param light_intensity The intensity of the light arriving at the surface point.
+ * @return The sum of the ambient, diffuse and specular terms.
+ */
+Vec3d computePhongLighting(
+    Vec3d const& view_direction,
+    Vec3d const& surface_normal,
+    Vec3d const& light_direction,
+    PhongCoefficients const& phong_coeff,
+    Vec3d const& light_color,
+    double light_intensity);
+
+/**
+ * @brief Settings of the shading computed by castRay().
+ */
+struct ShadingSettings
+{
+    ShadingSettings() : shadowCache(true), lightCulling(false), lightSamples(0), lightCandidates(32),
+        shadowMapResolution(0), shadowMapBias(1.), shadowMaps(nullptr), sortHits(false), maxDepth(MAX_DEPTH),
+        shadows(true), specializedKernels(true), tileCulling(false) {}
+
+    bool shadowCache;       //< test the last occluder of each light before traversing the scene
+    bool lightCulling;      //< skip the shadow rays of lights too weak to change the 8 bit result
+    int lightSamples;       //< lights sampled per hit point, 0 shades all lights
+    int lightCandidates;    //< lights the samples are resampled from
+    int shadowMapResolution;    //< edge length of the shadow cube map faces, 0 casts shadow rays
+    double shadowMapBias;       //< depth bias of the shadow map lookups in texels
+    const std::vector<ShadowCubeMap>* shadowMaps;   //< cube map per light, built before rendering
+    bool sortHits;          //< render(): shade the primary hits of a tile binned by material
+    int maxDepth;           //< maximum number of reflections along a path, 0 shades primary hits only
+    bool shadows;           //< cast shadows, otherwise every light reaches every surface
+    bool specializedKernels;    //< trace primary rays with a kernel compiled for these settings, if there is one
+    bool tileCulling;       //< render(), renderCameras(): intersect primary rays only with the spheres inside their tile's frustum
+};
+
+struct TraceContext;
+
+/**
+ * @brief Variant of castRay(), for rays starting at depth 0.
+ */
+typedef Vec3d (*TraceKernel)(const Ray& ray, const Scene& scene, const std::vector<Pointlight>& lights,
+    TraceContext& context, double weight);
+
+/**
+ * @brief Variant of shadeHit(), for hits of rays at depth 0.
+ */
+typedef Vec3d (*ShadeKernel)(const Ray& ray, const Hit& hit, const Scene& scene, const std::vector<Pointlight>& lights,
+    TraceContext& context, double weight);
+
+/**
+ * @brief The functions tracing primary rays, castRay() and shadeHit() or a specialization of them.
+ */
+struct TraceKernels
+{
+    TraceKernel castRay;    //< trace a primary ray
+    ShadeKernel shadeHit;   //< shade the closest hit of a primary ray
+    bool specialized;       //< the kernels are compiled for the settings
+};
+
+/**
+ * @brief Select the kernels tracing primary rays for a configuration.
+ *        Kernels are compiled for reflection depths of 0, 1, 2 and MAX_DEPTH, with and without
+ *        shadows and light culling, shadow rays traced through the scene. Their reflection
+ *        recursion is unrolled and the branches on the settings are resolved by the compiler.
+ *        Other configurations, light sampling and shadow maps use castRay() and shadeHit(),
+ *        which check the settings at every hit. Both compute the same colors.
+ * @param settings Settings of the shading.
+ * @return The kernels.
+ */
+TraceKernels selectTraceKernels(const ShadingSettings& settings);
+
+/**
+ * @brief Contribution of a single light to a hit point, before the shadow test.
+ */
+struct LightContribution
+{
+    size_t light;       //< index of the light
+    Vec3d dir;          //< normalized direction towards the light
+    double distance;    //< distance to the light
+    Vec3d direct;       //< diffuse and specular term, only received if the light is visible
+    double bound;       //< largest channel of 'direct'
+    int bucket;         //< binary exponent of the bound relative to the culling tolerance
+    bool culled;        //< the shadow ray is skipped
+};
+
+/**
+ * @brief Reservoir of the light sampling, holding one light chosen out of a stream of candidates.
+ */
+struct LightReservoir
+{
+    LightContribution selected; //< the chosen light
+    Vec3d ambient;              //< ambient term of the chosen light
+    double target;              //< target density of the chosen light, its unshadowed contribution
+};
+
+/**
+ * @brief Per-thread state of the ray tracer, created once per render thread.
+ */
+struct TraceContext
+{
+    /**
+     * @brief Create the state of one render thread.
+     * @param lightCount Number of light sources.
+     * @param settings Settings of the shading.
+     */
+    TraceContext(size_t lightCount, const ShadingSettings& settings) :
+        settings(settings), kernels(selectTraceKernels(settings)), shadows(lightCount, settings.shadowCache)
+    {
+    }
+
+    const ShadingSettings& settings;    //< settings of the shading
+    TraceKernels kernels;               //< tracing of primary rays for the settings
+    ShadowCache shadows;                //< last occluder per light
+    std::vector<LightContribution> contributions;   //< scratch buffer of the light culling
+    std::vector<LightReservoir> reservoirs;         //< scratch buffer of the light sampling
+    SampleRandom random;                            //< random numbers of the current sample
+};
+
+/**
+ * @brief Check whether a light is hidden from a hit point, by a shadow ray or by the light's
+ *        shadow map if shadow maps are in use.
+ * @param scene The scene containing all objects.
+ * @param light Index of the light.
+ * @param shadowRay The ray from the hit point towards the light.
+ * @param distance Distance to the light.
+ * @param context State of the calling thread.
+ * @return true if the light is occluded, false otherwise, always false if shadows are disabled.
+ */
+bool lightOccluded(const Scene& scene, size_t light, const Ray& shadowRay, const Vec3d& normal, double distance,
+    TraceContext& context);
+
+/**
+ * @brief Compute the local lighting of a hit point, skipping the shadow rays of weak lights.
+ *        The ambient term does not depend on visibility and is always added exactly.
+ *        The visible part of every light is computed without a shadow ray and bounds what
+ *        the light can contribute. Ordered by this bound, the weakest lights are skipped as
+ *        long as together they could change the pixel by less than half a quantization step,
+ *        split evenly between the bounces of the path. Skipped lights are added at half their
+ *        strength, so the error of the whole path stays below a quarter step.
+ *        The remaining lights are shaded with shadow rays in their original order.
+ * @param p_hit The point on the surface that was hit.
+ * @param surface_normal The normal at the hit point.
+ * @param view_direction Direction from the hit point towards the ray origin.
+ * @param phong The phong coefficients at the hit point.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param weight Weight of the hit point's color in the pixel.
+ * @param context State of the calling thread.
+ * @return The lighting of the hit point.
+ */
+Vec3d shadeCulled(const Vec3d& p_hit, const Vec3d& surface_normal, const Vec3d& view_direction,
+    const PhongCoefficients& phong, const Scene& scene, const std::vector<Pointlight>& lights,
+    double weight, TraceContext& context);
+
+/**
+ * @brief Estimate the local lighting of a hit point from a few sampled lights.
+ *        Candidate lights are drawn uniformly, or all lights are taken once if there are no
+ *        more than candidates. Each candidate is weighted by its unshadowed contribution and
+ *        every sample picks one candidate through weighted reservoir sampling. Only the picked
+ *        lights get shadow rays. Weighting the picked light by the mean candidate weight over
+ *        its own weight (resampled importance sampling) keeps the estimate unbiased, while
+ *        the cost is bounded by the number of candidates and samples, not by the light count.
+ * @param p_hit The point on the surface that was hit.
+ * @param surface_normal The normal at the hit point.
+ * @param view_direction Direction from the hit point towards the ray origin.
+ * @param phong The phong coefficients at the hit point.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param context State of the calling thread.
+ * @return The estimated lighting of the hit point.
+ */
+Vec3d shadeSampled(const Vec3d& p_hit, const Vec3d& surface_normal, const Vec3d& view_direction,
+    const PhongCoefficients& phong, const Scene& scene, const std::vector<Pointlight>& lights,
+    TraceContext& context);
+
+/**
+ * @brief Compute the local lighting of a hit point from all light sources, using the light
+ *        sampling, the light culling or shadow rays to every light, as selected by the settings.
+ *        Without shadows, the light culling has nothing to skip and all lights are shaded.
+ * @param p_hit The point on the surface that was hit.
+ * @param surface_normal The normal at the hit point.
+ * @param view_direction Direction from the hit point towards the ray origin.
+ * @param phong The phong coefficients at the hit point.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param weight Weight of the hit point's color in the pixel.
+ * @param context State of the calling thread.
+ * @return The lighting of the hit point.
+ */
+Vec3d shadeLocal(const Vec3d& p_hit, const Vec3d& surface_normal, const Vec3d& view_direction,
+    const PhongCoefficients& phong, const Scene& scene, const std::vector<Pointlight>& lights,
+    double weight, TraceContext& context);
+
+/**
+ * @brief Cast a ray into the scene. If the ray hits at least one object,
+ *        the color of the object closest to the camera is returned.
+ *        Rays deeper than the settings' maximum depth return the background color.
+ * @param ray The ray that's being cast.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param context State of the calling thread.
+ * @param weight Weight of the ray's color in the pixel, the product of the reflection
+ *        coefficients along the path. Used to bound the error of the light culling.
+ * @return The color of a hit object that is closest to the camera.
+ *         Return dark blue if no object was hit.
+ */
+Vec3d castRay(const Ray& ray, const Scene& scene, const std::vector<Pointlight>& lights, TraceContext& context,
+    double weight);
+
+/**
+ * @brief Shade the closest hit of a ray, as castRay() does once it found the hit: the local
+ *        lighting plus the reflection, which is traced recursively.
+ * @param ray The ray that hit the primitive.
+ * @param hit The closest hit of the ray.
+ * @param scene The scene containing all objects.
+ * @param lights All light sources.
+ * @param context State of the calling thread.
+ * @param weight Weight of the ray's color in the pixel.
+ * @return The color of the hit point.
+ */
+Vec3d shadeHit(const Ray& ray, const Hit& hit, const Scene& scene, const std::vector<Pointlight>& lights,
+    TraceContext& context, double weight);
+
+#endif // !tracer_h
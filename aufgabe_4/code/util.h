@@ -1,7 +1,11 @@
 #ifndef util_h
 #define util_h
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <random>
@@ -51,68 +55,86 @@ static double getRand()
     return distribNorm(mtGen);
 }
 
-
-/////////////////////////////////// PPM Image handling ///////////////////////////////////
 /**
- * @brief Compare two PPM images pixelwise.
- *        This is a convenient method for testing your results.
- *        Note that only rudamentory error checking/assertions are implemented!
- *
- * @param referenceFileName The reference file to compare against.
- * @param testName The name of the test (here: ray generation resp. sphere intersection)
- * @param framebuffer The framebuffer containing the rendered pixel data.
+ * @brief Counter based random numbers for the decisions of a single sample of the renderer.
+ *        The sequence only depends on the pixel and sample index, so an image comes out the
+ *        same no matter which thread renders which pixel or in what order.
  */
-static void comparePPM(const std::string referenceFileName, const std::string testName,
-    const std::vector<Vec3d>& framebuffer)
+class SampleRandom
 {
-    std::ifstream file(referenceFileName.c_str(), std::ios::in | std::ios::binary);
-    if (file.is_open())
+public:
+    /**
+     * @brief Start the sequence of a sample.
+     * @param pixel Index of the pixel.
+     * @param sample Index of the sample within the pixel.
+     */
+    SampleRandom(uint64_t pixel = 0, uint64_t sample = 0) :
+        _state(mix(pixel * 0x9E3779B97F4A7C15ull + mix(sample)))
     {
-        size_t width = 0;
-        size_t height = 0;
-        std::string magicNumber = "";
-        std::string maxValue = "";
-
-        // read header
-        file >> magicNumber >> width >> height >> maxValue;
-        assert(width * height == framebuffer.size());
-        assert(magicNumber == "P6");
-        assert(maxValue == "255");
-
-        std::vector<char> pixel_data;
-        pixel_data.resize(width * height * 3);
-
-        file.ignore(256, '\n');
-        file.read(reinterpret_cast<char*>(pixel_data.data()),
-            static_cast<std::streamsize>(pixel_data.size()));
-
-        size_t cnt = 0;
-        for (size_t i = 0; i < framebuffer.size(); ++i)
-        {
-            Vec3d color = Vec3d::clamp(0., 255., framebuffer.at(i));
-            if ((pixel_data.at(i * 3 + 0) != static_cast<char>(255 * color[0])) +
-                (pixel_data.at(i * 3 + 1) != static_cast<char>(255 * color[1])) +
-                (pixel_data.at(i * 3 + 2) != static_cast<char>(255 * color[2])))
-                ++cnt;
-        }
-        if (cnt > 0.001 * framebuffer.size()) // 0.1% tolerance
-        {
-            std::cout << cnt * 100 / framebuffer.size()
-                << "% of the pixel values did not match the reference image in the "
-                << testName << "." << std::endl;
-        }
-        else
-        {
-            std::cout << "Looks like a perfect match for the " << testName << "!" << std::endl;
-        }
-        file.close();
     }
-    else
+
+    /**
+     * @brief Get the next number of the sequence.
+     * @return A random number in range [0,1).
+     */
+    double next()
+    {
+        _state += 0x9E3779B97F4A7C15ull;
+        return static_cast<double>(mix(_state) >> 11) * (1. / 9007199254740992.);
+    }
+
+private:
+    /**
+     * @brief The SplitMix64 finalizer, scrambling all bits of a counter.
+     */
+    static uint64_t mix(uint64_t z)
     {
-        std::cerr << "Somethiong went wrong during comparison to the reference image "
-            << referenceFileName << std::endl;
-        std::cerr << "Did you check the path to the reference images?" << std::endl;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
     }
+
+    uint64_t _state;    //< counter of the sequence
+};
+
+
+////////////////////////////////////////// Hashing //////////////////////////////////////////
+static const uint64_t HASH_SEED = 14695981039346656037ull;    // FNV-1a 64 bit offset basis
+
+/**
+ * @brief Hash a block of memory with 64 bit FNV-1a.
+ * @param data The bytes to hash.
+ * @param size The number of bytes.
+ * @param hash The hash to continue from, allows to hash several blocks in a row.
+ * @return The updated hash.
+ */
+static inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = HASH_SEED)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+
+/////////////////////////////////// PPM Image handling ///////////////////////////////////
+/**
+ * @brief Quantize a color to 8 bit per channel after clamping it to [0,1].
+ * @param color The color.
+ * @param r The red byte.
+ * @param g The green byte.
+ * @param b The blue byte.
+ */
+static inline void quantize(const Vec3d& color, char& r, char& g, char& b)
+{
+    // convert through unsigned char, 255 does not fit into a (signed) char
+    const Vec3d c = Vec3d::clamp(0., 1., color);
+    r = static_cast<char>(static_cast<unsigned char>(255 * c[0]));
+    g = static_cast<char>(static_cast<unsigned char>(255 * c[1]));
+    b = static_cast<char>(static_cast<unsigned char>(255 * c[2]));
 }
 
 /**
@@ -134,13 +156,235 @@ static void saveAsPPM(const std::string name, const Vec3i viewport,
     os << "P6\n" << viewport[0] << " " << viewport[1] << "\n255\n";
     for (size_t i = 0; i < framebuffer.size(); ++i)
     {
-        Vec3d color = Vec3d::clamp(0., 1., framebuffer.at(i));
-        char r = static_cast<char>(255 * color[0]);
-        char g = static_cast<char>(255 * color[1]);
-        char b = static_cast<char>(255 * color[2]);
+        char r, g, b;
+        quantize(framebuffer.at(i), r, g, b);
         os << r << g << b;
     }
     os.close();
 }
 
+/**
+ * @brief Load a binary PPM image with 8 bit channels.
+ * @param name The file name of the ppm file.
+ * @param width The width of the image.
+ * @param height The height of the image.
+ * @param pixels The interleaved RGB bytes, rows top to bottom.
+ * @return true on success, false if the file is missing or not an 8 bit binary PPM.
+ */
+static inline bool loadPPM(const std::string name, int& width, int& height, std::vector<unsigned char>& pixels)
+{
+    std::ifstream file(name.c_str(), std::ios::in | std::ios::binary);
+    std::string magic;
+    int maxValue = 0;
+    file >> magic >> width >> height >> maxValue;
+    if (!file || magic != "P6" || maxValue != 255 || width <= 0 || height <= 0)
+        return false;
+    file.get();
+
+    pixels.resize(size_t(width) * height * 3);
+    file.read(reinterpret_cast<char*>(pixels.data()), static_cast<std::streamsize>(pixels.size()));
+    return static_cast<bool>(file);
+}
+
+/**
+ * @brief Difference between a rendered 8 bit RGB image and its reference.
+ */
+struct ImageDifference
+{
+    ImageDifference() : pixels(0), differing(0), maxError(0), meanError(0.) {}
+
+    size_t pixels;      //< number of pixels compared
+    size_t differing;   //< pixels with a channel off by more than the tolerance
+    int maxError;       //< largest difference of a channel
+    double meanError;   //< mean absolute difference over all channels
+};
+
+/**
+ * @brief Compare two 8 bit RGB images of the same size pixelwise.
+ *        This is a convenient method for testing your results. Rendering the same scene
+ *        with a different acceleration structure or shading order may change a channel by
+ *        a quantization step here and there, so small differences can be tolerated.
+ * @param reference The interleaved RGB bytes of the reference image.
+ * @param image The interleaved RGB bytes of the rendered image.
+ * @param tolerance Difference of a channel still counted as a match.
+ * @return The difference of the images.
+ */
+static inline ImageDifference compareImages(const std::vector<unsigned char>& reference,
+    const std::vector<unsigned char>& image, int tolerance)
+{
+    assert(reference.size() == image.size());
+
+    ImageDifference difference;
+    difference.pixels = image.size() / 3;
+    uint64_t sum = 0;
+    for (size_t i = 0; i < difference.pixels; ++i)
+    {
+        int largest = 0;
+        for (size_t c = 0; c < 3; ++c)
+        {
+            const int error = std::abs(int(image[i * 3 + c]) - int(reference[i * 3 + c]));
+            largest = std::max(largest, error);
+            sum += static_cast<uint64_t>(error);
+        }
+        difference.differing += (largest > tolerance);
+        difference.maxError = std::max(difference.maxError, largest);
+    }
+    difference.meanError = image.empty() ? 0. : static_cast<double>(sum) / image.size();
+    return difference;
+}
+
+/**
+ * @brief Save an array of color values as a little endian PFM image.
+ *        The values are stored as 32 bit floats without clamping, so exposure and tone mapping
+ *        can be changed afterwards. Following the PFM convention, rows are stored bottom to top.
+ * @param name The file name of the pfm file.
+ * @param viewport The size of the viewport.
+ * @param framebuffer Framebuffer containing the color values.
+ */
+static void saveAsPFM(const std::string name, const Vec3i viewport,
+    const std::vector<Vec3d>& framebuffer)
+{
+    if (framebuffer.size() != size_t(viewport[0]) * viewport[1])
+    {
+        std::cerr << "Invalid framebuffer size, could not write out image." << std::endl;
+        return;
+    }
+
+    std::ofstream os(name, std::ios::out | std::ios::binary);
+    os << "PF\n" << viewport[0] << " " << viewport[1] << "\n-1.0\n";
+
+    std::vector<float> row(static_cast<size_t>(viewport[0]) * 3);
+    for (int j = viewport[1] - 1; j >= 0; --j)
+    {
+        for (int i = 0; i < viewport[0]; ++i)
+        {
+            const Vec3d& color = framebuffer.at(i + j * static_cast<size_t>(viewport[0]));
+            row[i * 3 + 0] = static_cast<float>(color[0]);
+            row[i * 3 + 1] = static_cast<float>(color[1]);
+            row[i * 3 + 2] = static_cast<float>(color[2]);
+        }
+        os.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(float)));
+    }
+    os.close();
+}
+
+/**
+ * @brief Save an array of color values as raw 32 bit floats without any header.
+ *        Pixels are stored as interleaved RGB, rows top to bottom.
+ * @param name The file name of the raw file.
+ * @param viewport The size of the viewport.
+ * @param framebuffer Framebuffer containing the color values.
+ */
+static void saveAsRawFloat(const std::string name, const Vec3i viewport,
+    const std::vector<Vec3d>& framebuffer)
+{
+    if (framebuffer.size() != size_t(viewport[0]) * viewport[1])
+    {
+        std::cerr << "Invalid framebuffer size, could not write out image." << std::endl;
+        return;
+    }
+
+    std::vector<float> data(framebuffer.size() * 3);
+    for (size_t i = 0; i < framebuffer.size(); ++i)
+    {
+        data[i * 3 + 0] = static_cast<float>(framebuffer[i][0]);
+        data[i * 3 + 1] = static_cast<float>(framebuffer[i][1]);
+        data[i * 3 + 2] = static_cast<float>(framebuffer[i][2]);
+    }
+
+    std::ofstream os(name, std::ios::out | std::ios::binary);
+    os.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size() * sizeof(float)));
+    os.close();
+}
+
+/**
+ * @brief Save an array of color values, choosing the format by the file extension:
+ *        .pfm for float PFM, .raw for raw floats and PPM otherwise.
+ * @param name The file name of the image.
+ * @param viewport The size of the viewport.
+ * @param framebuffer Framebuffer containing the color values.
+ */
+static inline void saveImage(const std::string name, const Vec3i viewport,
+    const std::vector<Vec3d>& framebuffer)
+{
+    const size_t dot = name.find_last_of('.');
+    const std::string extension = (dot == std::string::npos) ? "" : name.substr(dot);
+
+    if (extension == ".pfm")
+        saveAsPFM(name, viewport, framebuffer);
+    else if (extension == ".raw")
+        saveAsRawFloat(name, viewport, framebuffer);
+    else
+        saveAsPPM(name, viewport, framebuffer);
+}
+
+/**
+ * @brief Overwrite a rectangle of an existing PPM or PFM image in place, e.g. to repair a patch
+ *        of a large frame. Only the rows of the rectangle are written, the rest of the file
+ *        is neither read nor written.
+ * @param name The file name of the image, as written by saveImage().
+ * @param viewport The size of the image.
+ * @param x0 First pixel column of the rectangle.
+ * @param y0 First pixel row of the rectangle.
+ * @param size The size of the rectangle.
+ * @param patch Framebuffer containing the color values of the rectangle.
+ * @return false if the image is missing, of another size or not in PPM or PFM format.
+ */
+static inline bool patchImage(const std::string name, const Vec3i viewport, int x0, int y0, const Vec3i size,
+    const std::vector<Vec3d>& patch)
+{
+    if (patch.size() != size_t(size[0]) * size[1] || x0 < 0 || y0 < 0 ||
+        x0 + size[0] > viewport[0] || y0 + size[1] > viewport[1])
+    {
+        return false;
+    }
+
+    std::fstream file(name, std::ios::in | std::ios::out | std::ios::binary);
+    std::string magic;
+    int width = 0, height = 0;
+    double scale = 0.;
+    if (!(file >> magic >> width >> height >> scale) || width != viewport[0] || height != viewport[1])
+        return false;
+    file.get();     // the single whitespace ending the header
+    const std::streamoff start = file.tellg();
+
+    if (magic == "P6" && scale == 255.)
+    {
+        std::vector<char> row(static_cast<size_t>(size[0]) * 3);
+        for (int j = 0; j < size[1]; ++j)
+        {
+            for (int i = 0; i < size[0]; ++i)
+                quantize(patch[i + j * static_cast<size_t>(size[0])], row[i * 3 + 0], row[i * 3 + 1], row[i * 3 + 2]);
+
+            file.seekp(start + (static_cast<std::streamoff>(y0 + j) * width + x0) * 3);
+            file.write(row.data(), static_cast<std::streamsize>(row.size()));
+        }
+    }
+    else if (magic == "PF" && scale < 0.)
+    {
+        // little endian floats, rows stored bottom to top
+        std::vector<float> row(static_cast<size_t>(size[0]) * 3);
+        for (int j = 0; j < size[1]; ++j)
+        {
+            for (int i = 0; i < size[0]; ++i)
+            {
+                const Vec3d& color = patch[i + j * static_cast<size_t>(size[0])];
+                row[i * 3 + 0] = static_cast<float>(color[0]);
+                row[i * 3 + 1] = static_cast<float>(color[1]);
+                row[i * 3 + 2] = static_cast<float>(color[2]);
+            }
+
+            const std::streamoff fileRow = height - 1 - (y0 + j);
+            file.seekp(start + (fileRow * width + x0) * 3 * static_cast<std::streamoff>(sizeof(float)));
+            file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size() * sizeof(float)));
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    return file.good();
+}
+
 #endif // !util_h
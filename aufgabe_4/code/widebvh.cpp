@@ -0,0 +1,347 @@
+#include "widebvh.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "bvh.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static_assert(sizeof(WideBVHNode) == 64, "A wide node has to fill exactly one cache line.");
+
+/**
+ * @brief Size of the traversal stack. Every wide level spans at least one binary level and
+ *        leaves at most three siblings on the stack, plus the children of the deepest node.
+ */
+static const int WIDE_BVH_STACK_SIZE = (WIDE_BVH_WIDTH - 1) * BVH_MAX_DEPTH + 1;
+
+namespace
+{
+    /**
+     * @brief Surface area of a binary node's bounds.
+     */
+    float area(const BVHNode& node)
+    {
+        const float dx = node.bmax[0] - node.bmin[0];
+        const float dy = node.bmax[1] - node.bmin[1];
+        const float dz = node.bmax[2] - node.bmin[2];
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+    /**
+     * @brief Compute 2^exponent for an exponent of a normalized float, without calling ldexp.
+     */
+    inline float powerOfTwo(int exponent)
+    {
+        const uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    /**
+     * @brief Decode a quantized bound, the way the traversal does.
+     */
+    inline float decode(float origin, float scale, int q)
+    {
+        return origin + static_cast<float>(q) * scale;
+    }
+
+    /**
+     * @brief Recursively collapse the binary subtree below a node.
+     * @return Index of the emitted wide node.
+     */
+    uint32_t collapse(const BVHNode* nodes, uint32_t root, std::vector<WideBVHNode>& wide)
+    {
+        const uint32_t index = static_cast<uint32_t>(wide.size());
+        wide.push_back(WideBVHNode());
+
+        // gather up to four children by opening the largest inner child
+        uint32_t children[WIDE_BVH_WIDTH];
+        int childCount = 0;
+        if (nodes[root].count > 0)
+        {
+            children[childCount++] = root;
+        }
+        else
+        {
+            children[childCount++] = nodes[root].child;
+            children[childCount++] = nodes[root].child + 1;
+        }
+
+        while (childCount < WIDE_BVH_WIDTH)
+        {
+            int largest = -1;
+            for (int i = 0; i < childCount; ++i)
+            {
+                if (nodes[children[i]].count == 0 && (largest < 0 || area(nodes[children[i]]) > area(nodes[children[largest]])))
+                    largest = i;
+            }
+            if (largest < 0)
+                break;
+
+            const uint32_t opened = children[largest];
+            children[largest] = nodes[opened].child;
+            children[childCount++] = nodes[opened].child + 1;
+        }
+
+        WideBVHNode node;
+        std::memset(&node, 0, sizeof(node));
+        node.childCount = static_cast<uint8_t>(childCount);
+
+        for (int a = 0; a < 3; ++a)
+        {
+            float lower = std::numeric_limits<float>::max();
+            float upper = -std::numeric_limits<float>::max();
+            for (int i = 0; i < childCount; ++i)
+            {
+                lower = std::min(lower, nodes[children[i]].bmin[a]);
+                upper = std::max(upper, nodes[children[i]].bmax[a]);
+            }
+
+            // smallest power of two scale covering the extent with 255 steps, one step of slack for rounding
+            int exponent = -100;
+            if (upper > lower)
+            {
+                std::frexp((upper - lower) / 254.f, &exponent);
+                exponent = std::max(-100, std::min(127, exponent));
+            }
+            const float scale = powerOfTwo(exponent);
+            node.origin[a] = lower;
+            node.exponent[a] = static_cast<int8_t>(exponent);
+
+            // round outwards, checking the bounds as they are decoded
+            for (int i = 0; i < childCount; ++i)
+            {
+                const BVHNode& child = nodes[children[i]];
+                int qlo = static_cast<int>(std::floor((child.bmin[a] - lower) / scale));
+                int qhi = static_cast<int>(std::ceil((child.bmax[a] - lower) / scale));
+                qlo = std::max(0, std::min(255, qlo));
+                qhi = std::max(0, std::min(255, qhi));
+                while (qlo > 0 && decode(lower, scale, qlo) > child.bmin[a])
+                    --qlo;
+                while (qhi < 255 && decode(lower, scale, qhi) < child.bmax[a])
+                    ++qhi;
+                node.lo[a][i] = static_cast<uint8_t>(qlo);
+                node.hi[a][i] = static_cast<uint8_t>(qhi);
+            }
+        }
+
+        for (int i = 0; i < childCount; ++i)
+        {
+            const BVHNode& child = nodes[children[i]];
+            if (child.count > 0)
+            {
+                node.child[i] = child.child;
+                node.count[i] = static_cast<uint8_t>(child.count);
+            }
+            else
+            {
+                node.child[i] = collapse(nodes, children[i], wide);
+            }
+        }
+
+        wide[index] = node;
+        return index;
+    }
+
+    /**
+     * @brief Entry of the traversal stack.
+     */
+    struct StackEntry
+    {
+        uint32_t child;     //< node index, or first sphere of a leaf
+        uint32_t count;     //< number of spheres of a leaf, 0 for nodes
+        float t;            //< entry distance of the child's box
+    };
+
+    /**
+     * @brief Compute the entry distance of the ray into the four child boxes of a node.
+     * @param node The node.
+     * @param origin Ray origin.
+     * @param invDir Inverse ray direction.
+     * @param t_max Distance of the closest hit so far.
+     * @param t_enter Entry distance per child.
+     * @return Bit mask of the children that are hit.
+     */
+    inline int intersectChildren(const WideBVHNode& node, const float origin[3], const float invDir[3],
+        float t_max, float t_enter[4])
+    {
+        // compensates the rounding of the float slab test, cf. Ize, "Robust BVH Ray Traversal"
+        const float exitScale = 1.f + 4.f * std::numeric_limits<float>::epsilon();
+
+#if defined(__SSE2__)
+        __m128 enter = _mm_setzero_ps();
+        __m128 exit = _mm_set1_ps(t_max);
+        for (int a = 0; a < 3; ++a)
+        {
+            const float scale = powerOfTwo(node.exponent[a]);
+            int packedLo, packedHi;
+            std::memcpy(&packedLo, node.lo[a], sizeof(packedLo));
+            std::memcpy(&packedHi, node.hi[a], sizeof(packedHi));
+
+            // widen the four 8 bit bounds to floats
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i lo = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packedLo), zero), zero);
+            const __m128i hi = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packedHi), zero), zero);
+
+            const __m128 base = _mm_set1_ps(node.origin[a] - origin[a]);
+            const __m128 step = _mm_set1_ps(scale);
+            const __m128 inv = _mm_set1_ps(invDir[a]);
+            const __m128 t0 = _mm_mul_ps(_mm_add_ps(base, _mm_mul_ps(_mm_cvtepi32_ps(lo), step)), inv);
+            const __m128 t1 = _mm_mul_ps(_mm_add_ps(base, _mm_mul_ps(_mm_cvtepi32_ps(hi), step)), inv);
+
+            enter = _mm_max_ps(enter, _mm_min_ps(t0, t1));
+            exit = _mm_min_ps(exit, _mm_max_ps(t0, t1));
+        }
+        exit = _mm_mul_ps(exit, _mm_set1_ps(exitScale));
+
+        _mm_storeu_ps(t_enter, enter);
+        const int mask = _mm_movemask_ps(_mm_cmple_ps(enter, exit));
+#else
+        int mask = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            float enter = 0.f;
+            float exit = t_max;
+            for (int a = 0; a < 3; ++a)
+            {
+                const float scale = powerOfTwo(node.exponent[a]);
+                const float base = node.origin[a] - origin[a];
+                const float t0 = (base + node.lo[a][i] * scale) * invDir[a];
+                const float t1 = (base + node.hi[a][i] * scale) * invDir[a];
+                enter = std::max(enter, std::min(t0, t1));
+                exit = std::min(exit, std::max(t0, t1));
+            }
+            t_enter[i] = enter;
+            if (enter <= exit * exitScale)
+                mask |= 1 << i;
+        }
+#endif
+        return mask & ((1 << node.childCount) - 1);
+    }
+}
+
+/**
+ * @brief collapseBVH
+ */
+std::vector<WideBVHNode> collapseBVH(const BVHNode* nodes, size_t nodeCount)
+{
+    std::vector<WideBVHNode> wide;
+    if (nodeCount == 0)
+        return wide;
+
+    wide.reserve(nodeCount / 2 + 1);
+    collapse(nodes, 0, wide);
+    return wide;
+}
+
+/**
+ * @brief Traverse the wide hierarchy.
+ * @tparam AnyHit Stop at the first hit closer than t_near instead of searching the closest one.
+ */
+template<bool AnyHit>
+static bool traverseWideBVH(const WideBVHNode* nodes, const SphereRecord* spheres, const Ray& ray,
+    double& t_near, uint32_t& index)
+{
+    // boxes are tested in single precision, avoiding 0 * inf for axis parallel rays
+    float origin[3];
+    float invDir[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        origin[a] = static_cast<float>(ray.origin[a]);
+        invDir[a] = (ray.dir[a] != 0.) ? static_cast<float>(1. / ray.dir[a]) : std::copysign(1.e30f, static_cast<float>(ray.dir[a]));
+    }
+
+    StackEntry stack[WIDE_BVH_STACK_SIZE];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, 0, 0.f };
+    bool hit = false;
+
+    while (stackSize > 0)
+    {
+        const StackEntry entry = stack[--stackSize];
+        if (entry.t > t_near)
+            continue;
+
+        if (entry.count > 0)
+        {
+            for (uint32_t i = entry.child; i < entry.child + entry.count; ++i)
+            {
+                double t = std::numeric_limits<double>::max();
+                if (intersectSphere(spheres[i], ray, t) && t < t_near)
+                {
+                    t_near = t;
+                    index = i;
+                    hit = true;
+                    if (AnyHit)
+                        return true;
+                }
+            }
+            continue;
+        }
+
+        const WideBVHNode& node = nodes[entry.child];
+        float t_enter[4];
+        const float t_max = static_cast<float>(std::min(t_near, static_cast<double>(std::numeric_limits<float>::max())));
+        const int mask = intersectChildren(node, origin, invDir, t_max, t_enter);
+
+        if (AnyHit)
+        {
+            for (int i = 0; i < WIDE_BVH_WIDTH; ++i)
+            {
+                if (!(mask & (1 << i)))
+                    continue;
+                assert(stackSize < WIDE_BVH_STACK_SIZE);
+                stack[stackSize++] = { node.child[i], node.count[i], t_enter[i] };
+            }
+            continue;
+        }
+
+        // push the children far to near, so the nearest one is visited next
+        StackEntry children[4];
+        int childCount = 0;
+        for (int i = 0; i < WIDE_BVH_WIDTH; ++i)
+        {
+            if (!(mask & (1 << i)))
+                continue;
+
+            StackEntry child = { node.child[i], node.count[i], t_enter[i] };
+            int k = childCount++;
+            while (k > 0 && children[k - 1].t < child.t)
+            {
+                children[k] = children[k - 1];
+                --k;
+            }
+            children[k] = child;
+        }
+        assert(stackSize + childCount <= WIDE_BVH_STACK_SIZE);
+        for (int k = 0; k < childCount; ++k)
+            stack[stackSize++] = children[k];
+    }
+
+    return hit;
+}
+
+/**
+ * @brief intersectWideBVH
+ */
+bool intersectWideBVH(const WideBVHNode* nodes, const SphereRecord* spheres, const Ray& ray,
+    double& t_near, uint32_t& index)
+{
+    return traverseWideBVH<false>(nodes, spheres, ray, t_near, index);
+}
+
+/**
+ * @brief occludedWideBVH
+ */
+bool occludedWideBVH(const WideBVHNode* nodes, const SphereRecord* spheres, const Ray& ray,
+    double t_max, uint32_t& index)
+{
+    return traverseWideBVH<true>(nodes, spheres, ray, t_max, index);
+}
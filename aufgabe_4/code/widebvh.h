@@ -0,0 +1,58 @@
+#ifndef widebvh_h
+#define widebvh_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "sceneobject.h"
+#include "util.h"
+
+/**
+ * @brief Maximum number of children of a node of the wide hierarchy.
+ */
+static const int WIDE_BVH_WIDTH = 4;
+
+/**
+ * @brief Collapse a binary hierarchy into a 4-wide one with quantized child bounds.
+ *
+ *        Starting from the two children of a binary node, the child with the largest
+ *        surface area is repeatedly replaced by its own children until a node has four
+ *        children or only leaves are left. Leaves of the binary hierarchy are taken over
+ *        unchanged, so the sphere order stays the same. Child bounds are quantized to 8 bits
+ *        per axis relative to the node's bounds, rounded outwards, so every quantized box
+ *        contains its child. Nodes are emitted in depth-first order.
+ *
+ * @param nodes The binary hierarchy as built by buildBVH().
+ * @param nodeCount The number of binary nodes.
+ * @return The nodes of the wide hierarchy, the root is node 0. Empty if there are no nodes.
+ */
+std::vector<WideBVHNode> collapseBVH(const BVHNode* nodes, size_t nodeCount);
+
+/**
+ * @brief Find the closest intersection of a ray with the spheres of a wide hierarchy.
+ *        The four children of a node are tested against the ray at once with SSE.
+ * @param nodes The nodes of the wide hierarchy.
+ * @param spheres The spheres in the order produced by buildBVH().
+ * @param ray The ray to trace.
+ * @param t_near In: only hits closer than t_near are reported. Out: distance of the closest hit.
+ * @param index Index of the closest sphere hit.
+ * @return true if a sphere closer than the incoming t_near was hit.
+ */
+bool intersectWideBVH(const WideBVHNode* nodes, const SphereRecord* spheres, const Ray& ray,
+    double& t_near, uint32_t& index);
+
+/**
+ * @brief Check whether a ray hits any sphere of a wide hierarchy closer than t_max.
+ *        Children are visited in storage order, as any hit ends the traversal.
+ * @param nodes The nodes of the wide hierarchy.
+ * @param spheres The spheres in the order produced by buildBVH().
+ * @param ray The ray to trace.
+ * @param t_max Only hits closer than t_max count.
+ * @param index Index of the first sphere found in between.
+ * @return true if a sphere closer than t_max was hit.
+ */
+bool occludedWideBVH(const WideBVHNode* nodes, const SphereRecord* spheres, const Ray& ray,
+    double t_max, uint32_t& index);
+
+#endif // !widebvh_h